@@ -0,0 +1,117 @@
+/*-------------------------------------------------------------------------
+ *
+ * dspstrlen.c
+ *
+ * Benchmark for FQdspstrlen() over UTF8 strings of varying length and
+ * composition (pure ASCII, mostly ASCII, mixed ASCII/CJK and pure CJK).
+ *
+ * Usage: bench/dspstrlen [iterations]
+ *
+ * This software is released under the PostgreSQL Licence
+ *
+ * bench/dspstrlen.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libfq.h"
+
+#define BENCH_DEFAULT_ITERATIONS 200000
+
+typedef struct BenchCase {
+	const char *name;
+	const char *fragment;
+	int			length;
+} BenchCase;
+
+static BenchCase cases[] = {
+	{ "ascii-short",   "Firebird ",                          16 },
+	{ "ascii-long",    "The quick brown fox jumps. ",      1024 },
+	{ "mostly-ascii",  "Customer name: Jose\xcc\x81 ",       1024 },
+	{ "mixed-cjk",     "id=42 \xe6\x9d\xb1\xe4\xba\xac\xe9\x83\xbd ", 1024 },
+	{ "cjk",           "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e", 1024 },
+	{ NULL, NULL, 0 }
+};
+
+
+static char *
+build_string(const char *fragment, int length)
+{
+	char	   *s = malloc(length + 1);
+	int			fraglen = strlen(fragment);
+	int			pos = 0;
+
+	/* only append complete fragments, to avoid splitting a character */
+	while (pos + fraglen <= length)
+	{
+		memcpy(s + pos, fragment, fraglen);
+		pos += fraglen;
+	}
+
+	s[pos] = '\0';
+
+	return s;
+}
+
+
+static double
+elapsed_ms(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000.0
+		+ (end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+	int			iterations = BENCH_DEFAULT_ITERATIONS;
+	BenchCase  *bc;
+
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+
+	if (iterations <= 0)
+	{
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	printf("%-14s %8s %8s %12s %10s\n",
+		   "case", "bytes", "width", "total ms", "MB/s");
+
+	for (bc = cases; bc->name != NULL; bc++)
+	{
+		char	   *s = build_string(bc->fragment, bc->length);
+		size_t		len = strlen(s);
+		struct timespec start, end;
+		volatile int width = 0;
+		double		ms;
+		int			i;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (i = 0; i < iterations; i++)
+			width = FQdspstrlen(s, FBENC_UTF8);
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		ms = elapsed_ms(&start, &end);
+
+		printf("%-14s %8zu %8i %12.2f %10.1f\n",
+			   bc->name,
+			   len,
+			   width,
+			   ms,
+			   ms > 0 ? ((double)len * iterations / (1024 * 1024)) / (ms / 1000) : 0.0);
+
+		free(s);
+	}
+
+	return 0;
+}
@@ -0,0 +1,443 @@
+/*-------------------------------------------------------------------------
+ *
+ * exec.c
+ *
+ * End-to-end benchmark for query execution and result access, run
+ * against a scratch database created with the embedded engine (so no
+ * server or network is involved). Synthetic tables of varying width
+ * and column types are loaded, then FQexec(), FQexecParams(), BLOB
+ * retrieval, FQgetvalue() loops and FQclear() are timed.
+ *
+ * Usage: bench/exec [-d database] [-r rows] [-i iterations] [-j]
+ *
+ * The database (default: $FQ_BENCH_DATABASE or /tmp/libfq-bench.fdb)
+ * must not exist; it is dropped on completion. With -j, one JSON object
+ * per case is written, for tracking regressions across releases. If
+ * no embedded engine is available, the benchmark is skipped; any other
+ * failure to create the database, including a file left behind by an
+ * interrupted run, is an error. To measure libfq's own overhead
+ * in isolation, run it with bench/fakefbclient.c preloaded instead
+ * ("make bench-fake").
+ *
+ * This software is released under the PostgreSQL Licence
+ *
+ * bench/exec.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "libfq.h"
+
+#define BENCH_DEFAULT_DATABASE "/tmp/libfq-bench.fdb"
+#define BENCH_DEFAULT_ROWS 100000
+#define BENCH_DEFAULT_ITERATIONS 5
+
+/* BLOB rows are much larger, so fewer are loaded */
+#define BENCH_BLOB_ROW_DIVISOR 20
+
+typedef enum {
+	BENCH_EXEC,					/* FQexec() */
+	BENCH_EXEC_PARAMS,			/* FQexecParams() with one parameter */
+	BENCH_GETVALUE,				/* FQgetvalue() over every value of a result */
+	BENCH_CLEAR					/* FQclear() */
+} BenchOperation;
+
+typedef struct BenchTable {
+	const char *name;
+	const char *columns;		/* column definitions */
+	const char *values;			/* value expressions, using loop variable "i" */
+	int			row_divisor;
+} BenchTable;
+
+typedef struct BenchCase {
+	const char *name;
+	const char *table;
+	BenchOperation op;
+} BenchCase;
+
+static BenchTable tables[] = {
+	{
+		"bench_narrow",
+		"id INT NOT NULL, val VARCHAR(20)",
+		":i, 'value ' || :i",
+		1
+	},
+	{
+		"bench_wide",
+		"id INT NOT NULL, small_val SMALLINT, big_val BIGINT, num_val NUMERIC(18,4), "
+		"dbl_val DOUBLE PRECISION, date_val DATE, ts_val TIMESTAMP, time_val TIME, "
+		"char_val CHAR(10), vc_short VARCHAR(20), vc_long VARCHAR(200), "
+		"vc_utf8 VARCHAR(40), null_val INT, bool_val SMALLINT, dec_val NUMERIC(9,2)",
+		":i, MOD(:i, 32000), :i * 1000003, :i / 7.0, :i * 1.5, "
+		"DATEADD(MOD(:i, 3650) DAY TO DATE '2000-01-01'), "
+		"DATEADD(:i SECOND TO TIMESTAMP '2000-01-01 00:00:00'), "
+		"DATEADD(MOD(:i, 86400) SECOND TO TIME '00:00:00'), "
+		"'c' || MOD(:i, 100), 'short ' || :i, "
+		"RPAD('long value ' || :i, 150, '.'), "
+		"'\xe6\x9d\xb1\xe4\xba\xac ' || :i, "
+		"NULL, MOD(:i, 2), :i / 100.0",
+		1
+	},
+	{
+		"bench_blob",
+		"id INT NOT NULL, doc BLOB SUB_TYPE TEXT",
+		":i, RPAD('document ' || :i, 4000, ' lorem ipsum')",
+		BENCH_BLOB_ROW_DIVISOR
+	},
+	{ NULL, NULL, NULL, 0 }
+};
+
+static BenchCase cases[] = {
+	{ "exec-narrow",		"bench_narrow",	BENCH_EXEC },
+	{ "exec-wide",			"bench_wide",	BENCH_EXEC },
+	{ "execparams-narrow",	"bench_narrow",	BENCH_EXEC_PARAMS },
+	{ "execparams-wide",	"bench_wide",	BENCH_EXEC_PARAMS },
+	{ "exec-blob",			"bench_blob",	BENCH_EXEC },
+	{ "getvalue-wide",		"bench_wide",	BENCH_GETVALUE },
+	{ "clear-wide",			"bench_wide",	BENCH_CLEAR },
+	{ NULL, NULL, 0 }
+};
+
+
+static double
+elapsed_ms(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000.0
+		+ (end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+
+static long
+peak_rss_kb(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+
+	/* Linux and the BSDs report kilobytes, macOS bytes */
+#if defined(__APPLE__)
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+}
+
+
+/*
+ * Create the scratch database with the embedded engine; libfq has no
+ * API for this, so the client library is called directly.
+ *
+ * Returns 1 on success, 0 if no embedded engine is available, or -1 on
+ * any other error.
+ */
+static int
+create_database(const char *path)
+{
+	ISC_STATUS	status[ISC_STATUS_LENGTH];
+	isc_db_handle db = 0L;
+	isc_tr_handle trans = 0L;
+	char		sql[1024];
+
+	if (access(path, F_OK) == 0)
+	{
+		fprintf(stderr, "database \"%s\" already exists; remove it if left by an interrupted run\n", path);
+		return -1;
+	}
+
+	snprintf(sql, sizeof(sql),
+			 "CREATE DATABASE '%s' USER 'SYSDBA' PASSWORD 'masterkey' "
+			 "PAGE_SIZE 8192 DEFAULT CHARACTER SET UTF8",
+			 path);
+
+	if (isc_dsql_execute_immediate(status, &db, &trans, 0, sql, SQL_DIALECT_V6, NULL))
+	{
+		/* the client library could not load an engine to handle a local path */
+		if (status[1] == isc_unavailable)
+			return 0;
+
+		isc_print_status(status);
+		return -1;
+	}
+
+	isc_detach_database(status, &db);
+
+	return 1;
+}
+
+
+static void
+drop_database(FBconn *conn)
+{
+	ISC_STATUS	status[ISC_STATUS_LENGTH];
+
+	if (conn->trans != 0L)
+		FQrollbackTransaction(conn);
+
+	if (isc_drop_database(status, &conn->db))
+		isc_print_status(status);
+}
+
+
+static bool
+exec_command(FBconn *conn, const char *sql)
+{
+	FBresult   *res = FQexec(conn, sql);
+	bool		ok = (FQresultStatus(res) == FBRES_COMMAND_OK || FQresultStatus(res) == FBRES_TUPLES_OK);
+
+	if (!ok)
+		fprintf(stderr, "error executing \"%.60s...\":\n%s", sql, FQresultErrorMessage(res));
+
+	FQclear(res);
+
+	return ok;
+}
+
+
+static bool
+load_table(FBconn *conn, BenchTable *table, int rows)
+{
+	char		sql[2048];
+
+	snprintf(sql, sizeof(sql), "CREATE TABLE %s (%s)", table->name, table->columns);
+
+	if (!exec_command(conn, sql))
+		return false;
+
+	/* generate the rows on the server side, so loading is fast */
+	snprintf(sql, sizeof(sql),
+			 "EXECUTE BLOCK AS "
+			 "DECLARE i INT = 1; "
+			 "BEGIN "
+			 "  WHILE (i <= %i) DO "
+			 "  BEGIN "
+			 "    INSERT INTO %s VALUES (%s); "
+			 "    i = i + 1; "
+			 "  END "
+			 "END",
+			 rows / table->row_divisor, table->name, table->values);
+
+	return exec_command(conn, sql);
+}
+
+
+static FBresult *
+run_query(FBconn *conn, BenchCase *bc)
+{
+	char		sql[256];
+
+	if (bc->op == BENCH_EXEC_PARAMS)
+	{
+		const char *params[] = { "0" };
+
+		snprintf(sql, sizeof(sql), "SELECT * FROM %s WHERE id > ?", bc->table);
+
+		return FQexecParams(conn, sql, 1, NULL, params, NULL, NULL, 0);
+	}
+
+	snprintf(sql, sizeof(sql), "SELECT * FROM %s", bc->table);
+
+	return FQexec(conn, sql);
+}
+
+
+/*
+ * Run one iteration of a case, returning the elapsed time of the
+ * operation being measured, and the number of rows and allocations.
+ */
+static double
+run_case(FBconn *conn, BenchCase *bc, int *rows, long *allocations)
+{
+	struct timespec start, end;
+	FBresult   *res;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	res = run_query(conn, bc);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK)
+	{
+		fprintf(stderr, "%s: %s", bc->name, FQresultErrorMessage(res));
+		FQclear(res);
+		return -1;
+	}
+
+	*rows = FQntuples(res);
+	*allocations = FQresultStats(res) != NULL ? FQresultStats(res)->allocations : 0;
+
+	if (bc->op == BENCH_GETVALUE)
+	{
+		volatile size_t total = 0;
+		int			nfields = FQnfields(res);
+		int			row, col;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (row = 0; row < *rows; row++)
+		{
+			for (col = 0; col < nfields; col++)
+			{
+				char	   *value = FQgetvalue(res, row, col);
+
+				if (value != NULL)
+					total += value[0];
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+	}
+	else if (bc->op == BENCH_CLEAR)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		FQclear(res);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		return elapsed_ms(&start, &end);
+	}
+
+	FQclear(res);
+
+	return elapsed_ms(&start, &end);
+}
+
+
+int
+main(int argc, char **argv)
+{
+	const char *database = getenv("FQ_BENCH_DATABASE");
+	int			rows = BENCH_DEFAULT_ROWS;
+	int			iterations = BENCH_DEFAULT_ITERATIONS;
+	bool		json = false;
+	FBconn	   *conn;
+	BenchTable *table;
+	BenchCase  *bc;
+	int			opt;
+	int			created;
+	int			rc = 0;
+
+	if (database == NULL)
+		database = BENCH_DEFAULT_DATABASE;
+
+	while ((opt = getopt(argc, argv, "d:r:i:j")) != -1)
+	{
+		switch (opt)
+		{
+			case 'd':
+				database = optarg;
+				break;
+			case 'r':
+				rows = atoi(optarg);
+				break;
+			case 'i':
+				iterations = atoi(optarg);
+				break;
+			case 'j':
+				json = true;
+				break;
+			default:
+				rows = 0;
+		}
+	}
+
+	if (rows < BENCH_BLOB_ROW_DIVISOR || iterations <= 0)
+	{
+		fprintf(stderr, "usage: %s [-d database] [-r rows] [-i iterations] [-j]\n", argv[0]);
+		return 1;
+	}
+
+	created = create_database(database);
+
+	if (created == 0)
+	{
+		printf("skipped: no embedded engine available to create database \"%s\"\n", database);
+		return 0;
+	}
+
+	if (created < 0)
+	{
+		fprintf(stderr, "unable to create database \"%s\"\n", database);
+		return 1;
+	}
+
+	conn = FQconnect(database, "SYSDBA", "masterkey");
+
+	if (FQstatus(conn) == CONNECTION_BAD)
+	{
+		fprintf(stderr, "unable to connect to \"%s\"\n", database);
+		FQfinish(conn);
+		return 1;
+	}
+
+	/* internal debugging output would distort the timings */
+	FQsetClientMinMessages(conn, WARNING);
+	FQsetResultStats(conn, true);
+
+	for (table = tables; table->name != NULL; table++)
+	{
+		if (!load_table(conn, table, rows))
+		{
+			rc = 1;
+			goto done;
+		}
+	}
+
+	if (!json)
+		printf("%-18s %8s %10s %12s %10s %10s %10s\n",
+			   "case", "rows", "mean ms", "rows/s", "ns/row", "allocs", "rss kB");
+
+	for (bc = cases; bc->name != NULL; bc++)
+	{
+		double		total_ms = 0;
+		double		mean_ms;
+		int			nrows = 0;
+		long		allocations = 0;
+		int			i;
+
+		for (i = 0; i < iterations; i++)
+		{
+			double		ms = run_case(conn, bc, &nrows, &allocations);
+
+			if (ms < 0)
+			{
+				rc = 1;
+				goto done;
+			}
+
+			total_ms += ms;
+		}
+
+		mean_ms = total_ms / iterations;
+
+		if (json)
+		{
+			printf("{\"libfq_version\": \"%s\", \"case\": \"%s\", \"rows\": %i, \"iterations\": %i, "
+				   "\"mean_ms\": %.3f, \"rows_per_sec\": %.0f, \"ns_per_row\": %.1f, "
+				   "\"allocations\": %li, \"peak_rss_kb\": %li}\n",
+				   FQlibVersionString(), bc->name, nrows, iterations, mean_ms,
+				   mean_ms > 0 ? nrows / (mean_ms / 1000) : 0.0,
+				   nrows > 0 ? mean_ms * 1000000 / nrows : 0.0,
+				   allocations, peak_rss_kb());
+		}
+		else
+		{
+			printf("%-18s %8i %10.2f %12.0f %10.1f %10li %10li\n",
+				   bc->name, nrows, mean_ms,
+				   mean_ms > 0 ? nrows / (mean_ms / 1000) : 0.0,
+				   nrows > 0 ? mean_ms * 1000000 / nrows : 0.0,
+				   allocations, peak_rss_kb());
+		}
+	}
+
+done:
+	drop_database(conn);
+	FQfinish(conn);
+
+	return rc;
+}
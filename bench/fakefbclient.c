@@ -0,0 +1,2138 @@
+/*-------------------------------------------------------------------------
+ *
+ * fakefbclient.c
+ *
+ * A stand-in for the Firebird client library implementing the subset
+ * of the isc_* API used by libfq, which serves synthetic result sets
+ * from memory. With no server, network or disk I/O involved, profiles
+ * and timings of libfq's own per-call and per-row overhead are free of
+ * server noise and reproducible between runs.
+ *
+ * Build as a shared library and preload it, so its functions take
+ * precedence over those of the real client library:
+ *
+ *   make bench/libfakefbclient.so
+ *   LD_PRELOAD=bench/libfakefbclient.so bench/exec
+ *
+ * ("make bench-fake" does this for bench/exec).
+ *
+ * All attachments share a single in-memory database, which starts out
+ * empty. "CREATE TABLE" registers a table's columns, and rows are
+ * "inserted" by INSERT, or by an EXECUTE BLOCK containing an INSERT in
+ * a loop bounded with "<= n", which inserts n rows; only the row count
+ * is stored. Fetching from a table produces deterministic values
+ * derived from the row number and column type; every tenth value of a
+ * nullable column is NULL, and text BLOBs are FAKE_BLOB_LENGTH bytes
+ * long. WHERE clauses are not evaluated, DELETE removes all rows, and
+ * select list items which aren't column names are served from the
+ * table's column at the same position. Character columns are UTF8.
+ *
+ * The catalog queries issued by libfq itself on connection are
+ * answered from built-in tables.
+ *
+ * This software is released under the PostgreSQL Licence
+ *
+ * bench/fakefbclient.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ibase.h"
+
+#define FAKE_NAME_LEN 32
+#define FAKE_MAX_COLUMNS 64
+#define FAKE_MAX_TABLES 64
+#define FAKE_MAX_STATEMENTS 1024
+#define FAKE_MAX_BLOBS 64
+#define FAKE_MESSAGE_LEN 256
+
+/* every FAKE_NULL_INTERVAL-th value of a nullable column is NULL */
+#define FAKE_NULL_INTERVAL 10
+
+#define FAKE_BLOB_LENGTH 4000
+
+/* type of parameters whose column can't be determined */
+#define FAKE_PARAM_LEN 255
+
+#define FAKE_UTF8 4
+#define FAKE_UTF8_MAX_BYTES 4
+
+#define FAKE_PAGE_SIZE 8192
+#define FAKE_NUM_BUFFERS 2048
+
+/* 2000-01-01 as a Modified Julian Day number */
+#define FAKE_BASE_DATE 51544
+
+#define FAKE_HANDLE(index) ((FB_API_HANDLE)(intptr_t)((index) + 1))
+#define FAKE_INDEX(handle) ((int)(intptr_t)(handle) - 1)
+
+typedef enum {
+	FAKE_TOK_END,
+	FAKE_TOK_IDENT,
+	FAKE_TOK_NUMBER,
+	FAKE_TOK_STRING,
+	FAKE_TOK_PUNCT
+} FakeTokenType;
+
+typedef struct FakeToken {
+	FakeTokenType type;
+	char		text[FAKE_NAME_LEN];	/* identifiers are upper-cased */
+} FakeToken;
+
+typedef struct FakeColumn {
+	char		name[FAKE_NAME_LEN];
+	short		sqltype;		/* without the nullable flag */
+	short		sqllen;
+	short		sqlscale;
+	short		sqlsubtype;
+	short		chars;			/* declared length of character types */
+	bool		nullable;
+	const char *fixed;			/* constant value, for built-in tables */
+} FakeColumn;
+
+typedef struct FakeTable {
+	char		name[FAKE_NAME_LEN];	/* empty if the slot is free */
+	int			ncols;
+	FakeColumn	cols[FAKE_MAX_COLUMNS];
+	long		rows;
+	bool		builtin;
+} FakeTable;
+
+typedef enum {
+	FAKE_EFFECT_NONE,
+	FAKE_EFFECT_CREATE_TABLE,
+	FAKE_EFFECT_DROP_TABLE,
+	FAKE_EFFECT_INSERT,
+	FAKE_EFFECT_DELETE
+} FakeEffect;
+
+typedef struct FakeStatement {
+	int			type;			/* isc_info_sql_stmt_* value, 0 if not prepared */
+	int			table;			/* index into "tables", or -1 */
+	int			ncols;
+	FakeColumn	cols[FAKE_MAX_COLUMNS];
+	int			nparams;
+	FakeColumn	params[FAKE_MAX_COLUMNS];
+	FakeEffect	effect;			/* change to the database on execution */
+	long		effect_rows;
+	FakeTable	new_table;		/* definition for FAKE_EFFECT_CREATE_TABLE */
+	bool		cursor_open;
+	long		row;			/* next row to fetch */
+} FakeStatement;
+
+typedef struct FakeBlob {
+	bool		used;
+	bool		writing;
+	size_t		offset;
+	size_t		length;
+	char		pattern[FAKE_NAME_LEN * 2];
+	size_t		pattern_len;
+} FakeBlob;
+
+static pthread_mutex_t fake_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static FakeTable tables[FAKE_MAX_TABLES];
+static bool tables_initialised = false;
+static FakeStatement *statements[FAKE_MAX_STATEMENTS];
+static FakeBlob blobs[FAKE_MAX_BLOBS];
+static unsigned int next_db_handle = 0;
+static unsigned int next_trans_handle = 0;
+
+/* referenced from status vectors, so must outlive the call */
+static __thread char fake_message[FAKE_MESSAGE_LEN];
+
+static const char *blob_words = " lorem ipsum dolor sit amet";
+
+
+/*
+ * Status vectors
+ */
+
+static ISC_STATUS
+fake_ok(ISC_STATUS *status)
+{
+	status[0] = isc_arg_gds;
+	status[1] = 0;
+	status[2] = isc_arg_end;
+
+	return 0;
+}
+
+
+static ISC_STATUS
+fake_error(ISC_STATUS *status, ISC_STATUS code, const char *format, ...)
+{
+	va_list		args;
+
+	va_start(args, format);
+	vsnprintf(fake_message, sizeof(fake_message), format, args);
+	va_end(args);
+
+	status[0] = isc_arg_gds;
+	status[1] = code;
+	status[2] = isc_arg_string;
+	status[3] = (ISC_STATUS) fake_message;
+	status[4] = isc_arg_end;
+
+	return code;
+}
+
+
+/*
+ * Tables
+ */
+
+static void
+fake_init_column(FakeColumn *col, const char *name, short sqltype, short chars, bool nullable, const char *fixed)
+{
+	char		col_name[FAKE_NAME_LEN];
+
+	/* "name" may be the column's own */
+	snprintf(col_name, sizeof(col_name), "%s", name);
+
+	memset(col, 0, sizeof(FakeColumn));
+	snprintf(col->name, sizeof(col->name), "%s", col_name);
+	col->sqltype = sqltype;
+	col->nullable = nullable;
+	col->fixed = fixed;
+
+	switch (sqltype)
+	{
+		case SQL_SHORT:
+			col->sqllen = sizeof(ISC_SHORT);
+			break;
+		case SQL_LONG:
+			col->sqllen = sizeof(ISC_LONG);
+			break;
+		case SQL_INT64:
+			col->sqllen = sizeof(ISC_INT64);
+			break;
+		case SQL_FLOAT:
+			col->sqllen = sizeof(float);
+			break;
+		case SQL_DOUBLE:
+			col->sqllen = sizeof(double);
+			break;
+		case SQL_TYPE_DATE:
+			col->sqllen = sizeof(ISC_DATE);
+			break;
+		case SQL_TYPE_TIME:
+			col->sqllen = sizeof(ISC_TIME);
+			break;
+		case SQL_TIMESTAMP:
+			col->sqllen = sizeof(ISC_TIMESTAMP);
+			break;
+		case SQL_BLOB:
+			col->sqllen = sizeof(ISC_QUAD);
+			break;
+#if defined SQL_BOOLEAN
+		case SQL_BOOLEAN:
+			col->sqllen = sizeof(FB_BOOLEAN);
+			break;
+#endif
+		case SQL_TEXT:
+		case SQL_VARYING:
+			col->chars = chars;
+			col->sqllen = chars * FAKE_UTF8_MAX_BYTES;
+			col->sqlsubtype = FAKE_UTF8;
+			break;
+	}
+}
+
+
+/*
+ * Reset the database to its initial state, containing only the tables
+ * queried by libfq when connecting
+ */
+static void
+fake_init_tables(void)
+{
+	FakeTable  *table;
+
+	memset(tables, 0, sizeof(tables));
+
+	/* _FQserverVersionInit() */
+	table = &tables[0];
+	snprintf(table->name, sizeof(table->name), "RDB$DATABASE");
+	fake_init_column(&table->cols[0], "CAST", SQL_VARYING, 10, true, "4.0.0");
+	table->ncols = 1;
+	table->rows = 1;
+	table->builtin = true;
+
+	/* _FQinitClientEncoding() */
+	table = &tables[1];
+	snprintf(table->name, sizeof(table->name), "MON$ATTACHMENTS");
+	fake_init_column(&table->cols[0], "CLIENT_ENCODING", SQL_VARYING, 31, true, "UTF8");
+	fake_init_column(&table->cols[1], "CLIENT_ENCODING_ID", SQL_SHORT, 0, true, "4");
+	table->ncols = 2;
+	table->rows = 1;
+	table->builtin = true;
+
+	tables_initialised = true;
+}
+
+
+static int
+fake_find_table(const char *name)
+{
+	int			i;
+
+	if (tables_initialised == false)
+		fake_init_tables();
+
+	for (i = 0; i < FAKE_MAX_TABLES; i++)
+	{
+		if (tables[i].name[0] != '\0' && strcmp(tables[i].name, name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+
+static FakeColumn *
+fake_find_column(FakeTable *table, const char *name)
+{
+	int			i;
+
+	for (i = 0; i < table->ncols; i++)
+	{
+		if (strcmp(table->cols[i].name, name) == 0)
+			return &table->cols[i];
+	}
+
+	return NULL;
+}
+
+
+/*
+ * SQL parsing, to the extent needed to determine a statement's type,
+ * the table it refers to, its columns and parameters
+ */
+
+static const char *
+fake_token(const char *p, FakeToken *tok)
+{
+	size_t		len = 0;
+
+	for (;;)
+	{
+		while (isspace((unsigned char) *p))
+			p++;
+
+		if (p[0] == '-' && p[1] == '-')
+		{
+			while (*p && *p != '\n')
+				p++;
+		}
+		else if (p[0] == '/' && p[1] == '*')
+		{
+			const char *end = strstr(p + 2, "*/");
+
+			p = end == NULL ? p + strlen(p) : end + 2;
+		}
+		else
+			break;
+	}
+
+	tok->text[0] = '\0';
+
+	if (*p == '\0')
+	{
+		tok->type = FAKE_TOK_END;
+		return p;
+	}
+
+	if (isalpha((unsigned char) *p) || *p == '_')
+	{
+		tok->type = FAKE_TOK_IDENT;
+
+		while (isalnum((unsigned char) *p) || *p == '_' || *p == '$')
+		{
+			if (len < sizeof(tok->text) - 1)
+				tok->text[len++] = toupper((unsigned char) *p);
+			p++;
+		}
+	}
+	else if (*p == '"' || *p == '\'')
+	{
+		char		quote = *p++;
+
+		tok->type = quote == '"' ? FAKE_TOK_IDENT : FAKE_TOK_STRING;
+
+		while (*p)
+		{
+			if (*p == quote)
+			{
+				if (p[1] != quote)
+				{
+					p++;
+					break;
+				}
+				p++;
+			}
+
+			if (len < sizeof(tok->text) - 1)
+				tok->text[len++] = *p;
+			p++;
+		}
+	}
+	else if (isdigit((unsigned char) *p))
+	{
+		tok->type = FAKE_TOK_NUMBER;
+
+		while (isdigit((unsigned char) *p) || *p == '.')
+		{
+			if (len < sizeof(tok->text) - 1)
+				tok->text[len++] = *p;
+			p++;
+		}
+	}
+	else
+	{
+		tok->type = FAKE_TOK_PUNCT;
+		tok->text[len++] = *p;
+
+		if ((p[0] == '<' && (p[1] == '=' || p[1] == '>'))
+		 || ((p[0] == '>' || p[0] == '!') && p[1] == '=')
+		 || (p[0] == '|' && p[1] == '|'))
+			tok->text[len++] = *++p;
+		p++;
+	}
+
+	tok->text[len] = '\0';
+
+	return p;
+}
+
+
+static bool
+fake_is(FakeToken *tok, const char *text)
+{
+	return tok->type != FAKE_TOK_END
+		&& tok->type != FAKE_TOK_STRING
+		&& strcmp(tok->text, text) == 0;
+}
+
+
+/*
+ * Skip to the next comma or closing parenthesis at the current nesting
+ * level, which is returned in "tok"
+ */
+static const char *
+fake_skip_item(const char *p, FakeToken *tok)
+{
+	int			depth = 0;
+
+	for (p = fake_token(p, tok); tok->type != FAKE_TOK_END; p = fake_token(p, tok))
+	{
+		if (fake_is(tok, "("))
+			depth++;
+		else if (fake_is(tok, ")") && depth-- == 0)
+			break;
+		else if (fake_is(tok, ",") && depth == 0)
+			break;
+	}
+
+	return p;
+}
+
+
+static bool
+fake_add_param(ISC_STATUS *status, FakeStatement *stmt, FakeColumn *col)
+{
+	FakeColumn *param;
+
+	if (stmt->nparams == FAKE_MAX_COLUMNS)
+	{
+		fake_error(status, isc_random, "too many parameters");
+		return false;
+	}
+
+	param = &stmt->params[stmt->nparams++];
+
+	if (col != NULL)
+		*param = *col;
+	else
+		fake_init_column(param, "", SQL_VARYING, FAKE_PARAM_LEN, true, NULL);
+
+	param->nullable = true;
+
+	return true;
+}
+
+
+/*
+ * Collect the parameters in the remainder of a statement. A parameter
+ * compared with a column of the statement's table takes that column's
+ * type.
+ */
+static bool
+fake_parse_params(ISC_STATUS *status, FakeStatement *stmt, const char *p)
+{
+	FakeTable  *table = stmt->table >= 0 ? &tables[stmt->table] : NULL;
+	FakeColumn *last_column = NULL;
+	FakeToken	tok;
+
+	for (p = fake_token(p, &tok); tok.type != FAKE_TOK_END; p = fake_token(p, &tok))
+	{
+		if (fake_is(&tok, "?"))
+		{
+			if (!fake_add_param(status, stmt, last_column))
+				return false;
+			last_column = NULL;
+		}
+		else if (tok.type == FAKE_TOK_IDENT && table != NULL && fake_find_column(table, tok.text) != NULL)
+			last_column = fake_find_column(table, tok.text);
+		else if (fake_is(&tok, "AND") || fake_is(&tok, "OR") || fake_is(&tok, ","))
+			last_column = NULL;
+	}
+
+	return true;
+}
+
+
+static bool
+fake_parse_table_name(ISC_STATUS *status, FakeStatement *stmt, const char **p)
+{
+	FakeToken	tok;
+
+	*p = fake_token(*p, &tok);
+
+	if (tok.type != FAKE_TOK_IDENT)
+	{
+		fake_error(status, isc_token_err, "Dynamic SQL Error\nSQL error code = -104\nToken unknown - %s", tok.text);
+		return false;
+	}
+
+	stmt->table = fake_find_table(tok.text);
+
+	if (stmt->table < 0)
+	{
+		fake_error(status, isc_dsql_relation_err, "Dynamic SQL Error\nSQL error code = -204\nTable unknown\n%s", tok.text);
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+fake_parse_select(ISC_STATUS *status, FakeStatement *stmt, const char *p)
+{
+	char		item_names[FAKE_MAX_COLUMNS][FAKE_NAME_LEN];
+	char		item_aliases[FAKE_MAX_COLUMNS][FAKE_NAME_LEN];
+	int			nitems = 0;
+	int			item_tokens = 0;
+	int			depth = 0;
+	bool		star = false;
+	FakeToken	tok;
+	FakeTable  *table;
+	int			i;
+
+	stmt->type = isc_info_sql_stmt_select;
+
+	memset(item_names, 0, sizeof(item_names));
+	memset(item_aliases, 0, sizeof(item_aliases));
+
+	for (p = fake_token(p, &tok); tok.type != FAKE_TOK_END; p = fake_token(p, &tok))
+	{
+		if (depth == 0 && fake_is(&tok, "FROM"))
+			break;
+
+		if (depth == 0 && item_tokens == 0 && (fake_is(&tok, "FIRST") || fake_is(&tok, "SKIP")))
+		{
+			p = fake_token(p, &tok);
+			continue;
+		}
+
+		if (depth == 0 && item_tokens == 0 && (fake_is(&tok, "DISTINCT") || fake_is(&tok, "ALL")))
+			continue;
+
+		if (fake_is(&tok, "("))
+			depth++;
+		else if (fake_is(&tok, ")"))
+			depth--;
+
+		if (depth == 0 && fake_is(&tok, ","))
+		{
+			item_tokens = 0;
+			continue;
+		}
+
+		if (item_tokens == 0)
+		{
+			if (nitems == FAKE_MAX_COLUMNS)
+			{
+				fake_error(status, isc_random, "too many columns");
+				return false;
+			}
+			nitems++;
+		}
+
+		if (depth == 0 && fake_is(&tok, "*"))
+			star = true;
+		else if (depth == 0 && fake_is(&tok, "AS"))
+		{
+			p = fake_token(p, &tok);
+			snprintf(item_aliases[nitems - 1], FAKE_NAME_LEN, "%s", tok.text);
+		}
+		else if (tok.type == FAKE_TOK_IDENT)
+			snprintf(item_names[nitems - 1], FAKE_NAME_LEN, "%s", tok.text);
+
+		item_tokens++;
+	}
+
+	if (tok.type == FAKE_TOK_END)
+	{
+		fake_error(status, isc_token_err, "Dynamic SQL Error\nSQL error code = -104\nUnexpected end of command");
+		return false;
+	}
+
+	if (!fake_parse_table_name(status, stmt, &p))
+		return false;
+
+	table = &tables[stmt->table];
+
+	if (star)
+	{
+		stmt->ncols = table->ncols;
+		memcpy(stmt->cols, table->cols, sizeof(FakeColumn) * table->ncols);
+	}
+	else
+	{
+		for (i = 0; i < nitems; i++)
+		{
+			FakeColumn *col = fake_find_column(table, item_names[i]);
+
+			if (col == NULL && i < table->ncols)
+				col = &table->cols[i];
+
+			if (col == NULL)
+			{
+				fake_error(status, isc_dsql_field_err, "Dynamic SQL Error\nSQL error code = -206\nColumn unknown\n%s", item_names[i]);
+				return false;
+			}
+
+			stmt->cols[i] = *col;
+
+			/* both are FAKE_NAME_LEN, and the alias is NUL-terminated */
+			if (item_aliases[i][0] != '\0')
+				memcpy(stmt->cols[i].name, item_aliases[i], FAKE_NAME_LEN);
+		}
+
+		stmt->ncols = nitems;
+	}
+
+	if (strstr(p, "FOR UPDATE") != NULL || strstr(p, "for update") != NULL)
+		stmt->type = isc_info_sql_stmt_select_for_upd;
+
+	return fake_parse_params(status, stmt, p);
+}
+
+
+/*
+ * INSERT INTO table [(column, ...)] VALUES (...); parameters in the
+ * VALUES list take the type of the corresponding column
+ */
+static bool
+fake_parse_insert(ISC_STATUS *status, FakeStatement *stmt, const char *p)
+{
+	FakeColumn *columns[FAKE_MAX_COLUMNS];
+	int			ncolumns = 0;
+	FakeTable  *table;
+	FakeToken	tok;
+	int			i;
+
+	stmt->type = isc_info_sql_stmt_insert;
+	stmt->effect = FAKE_EFFECT_INSERT;
+	stmt->effect_rows = 1;
+
+	p = fake_token(p, &tok);
+
+	if (!fake_is(&tok, "INTO"))
+	{
+		fake_error(status, isc_token_err, "Dynamic SQL Error\nSQL error code = -104\nToken unknown - %s", tok.text);
+		return false;
+	}
+
+	if (!fake_parse_table_name(status, stmt, &p))
+		return false;
+
+	table = &tables[stmt->table];
+
+	for (i = 0; i < table->ncols; i++)
+		columns[i] = &table->cols[i];
+	ncolumns = table->ncols;
+
+	p = fake_token(p, &tok);
+
+	if (fake_is(&tok, "("))
+	{
+		ncolumns = 0;
+
+		for (p = fake_token(p, &tok); tok.type == FAKE_TOK_IDENT && ncolumns < FAKE_MAX_COLUMNS; p = fake_token(p, &tok))
+		{
+			columns[ncolumns] = fake_find_column(table, tok.text);
+
+			if (columns[ncolumns] == NULL)
+			{
+				fake_error(status, isc_dsql_field_err, "Dynamic SQL Error\nSQL error code = -206\nColumn unknown\n%s", tok.text);
+				return false;
+			}
+
+			ncolumns++;
+
+			p = fake_token(p, &tok);
+			if (!fake_is(&tok, ","))
+				break;
+		}
+
+		p = fake_token(p, &tok);
+	}
+
+	if (!fake_is(&tok, "VALUES"))
+		return fake_parse_params(status, stmt, p);
+
+	p = fake_token(p, &tok);
+
+	for (i = 0; fake_is(&tok, "(") || fake_is(&tok, ","); i++)
+	{
+		const char *item = p;
+
+		p = fake_token(p, &tok);
+
+		if (fake_is(&tok, "?"))
+		{
+			if (!fake_add_param(status, stmt, i < ncolumns ? columns[i] : NULL))
+				return false;
+			p = fake_token(p, &tok);
+		}
+		else
+			p = fake_skip_item(item, &tok);
+	}
+
+	return fake_parse_params(status, stmt, p);
+}
+
+
+/*
+ * Parse a column's data type; character sets and collations are
+ * ignored
+ */
+static bool
+fake_parse_type(ISC_STATUS *status, FakeColumn *col, const char **p)
+{
+	FakeToken	tok;
+	int			args[2] = { 0, 0 };
+	int			nargs = 0;
+	char		type[FAKE_NAME_LEN];
+	const char *next;
+
+	*p = fake_token(*p, &tok);
+	snprintf(type, sizeof(type), "%s", tok.text);
+
+	/* type arguments, e.g. VARCHAR(20), NUMERIC(18,4) */
+	next = fake_token(*p, &tok);
+	if (fake_is(&tok, "("))
+	{
+		for (next = fake_token(next, &tok); tok.type == FAKE_TOK_NUMBER && nargs < 2; next = fake_token(next, &tok))
+		{
+			args[nargs++] = atoi(tok.text);
+
+			next = fake_token(next, &tok);
+			if (!fake_is(&tok, ","))
+				break;
+		}
+		*p = next;
+	}
+
+	if (strcmp(type, "SMALLINT") == 0)
+		fake_init_column(col, col->name, SQL_SHORT, 0, true, NULL);
+	else if (strcmp(type, "INT") == 0 || strcmp(type, "INTEGER") == 0)
+		fake_init_column(col, col->name, SQL_LONG, 0, true, NULL);
+	else if (strcmp(type, "BIGINT") == 0)
+		fake_init_column(col, col->name, SQL_INT64, 0, true, NULL);
+	else if (strcmp(type, "NUMERIC") == 0 || strcmp(type, "DECIMAL") == 0)
+	{
+		int			precision = nargs > 0 ? args[0] : 9;
+
+		if (precision <= 4)
+			fake_init_column(col, col->name, SQL_SHORT, 0, true, NULL);
+		else if (precision <= 9)
+			fake_init_column(col, col->name, SQL_LONG, 0, true, NULL);
+		else
+			fake_init_column(col, col->name, SQL_INT64, 0, true, NULL);
+
+		col->sqlscale = -args[1];
+		col->sqlsubtype = strcmp(type, "NUMERIC") == 0 ? 1 : 2;
+	}
+	else if (strcmp(type, "FLOAT") == 0)
+		fake_init_column(col, col->name, SQL_FLOAT, 0, true, NULL);
+	else if (strcmp(type, "DOUBLE") == 0)
+	{
+		/* "PRECISION" */
+		*p = fake_token(*p, &tok);
+		fake_init_column(col, col->name, SQL_DOUBLE, 0, true, NULL);
+	}
+	else if (strcmp(type, "DATE") == 0)
+		fake_init_column(col, col->name, SQL_TYPE_DATE, 0, true, NULL);
+	else if (strcmp(type, "TIME") == 0)
+		fake_init_column(col, col->name, SQL_TYPE_TIME, 0, true, NULL);
+	else if (strcmp(type, "TIMESTAMP") == 0)
+		fake_init_column(col, col->name, SQL_TIMESTAMP, 0, true, NULL);
+	else if (strcmp(type, "CHAR") == 0 || strcmp(type, "CHARACTER") == 0)
+		fake_init_column(col, col->name, SQL_TEXT, nargs > 0 ? args[0] : 1, true, NULL);
+	else if (strcmp(type, "VARCHAR") == 0)
+		fake_init_column(col, col->name, SQL_VARYING, args[0], true, NULL);
+	else if (strcmp(type, "BLOB") == 0)
+	{
+		fake_init_column(col, col->name, SQL_BLOB, 0, true, NULL);
+
+		next = fake_token(*p, &tok);
+		if (fake_is(&tok, "SUB_TYPE"))
+		{
+			*p = fake_token(next, &tok);
+			if (fake_is(&tok, "TEXT") || fake_is(&tok, "1"))
+				col->sqlsubtype = 1;
+		}
+	}
+#if defined SQL_BOOLEAN
+	else if (strcmp(type, "BOOLEAN") == 0)
+		fake_init_column(col, col->name, SQL_BOOLEAN, 0, true, NULL);
+#endif
+	else
+	{
+		fake_error(status, isc_random, "Dynamic SQL Error\nSQL error code = -104\nunsupported data type %s", type);
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * CREATE TABLE name (column type [NOT NULL] ..., ...); table
+ * constraints are ignored
+ */
+static bool
+fake_parse_create_table(ISC_STATUS *status, FakeStatement *stmt, const char *p)
+{
+	FakeTable  *table = &stmt->new_table;
+	FakeToken	tok;
+
+	stmt->type = isc_info_sql_stmt_ddl;
+	stmt->effect = FAKE_EFFECT_CREATE_TABLE;
+
+	memset(table, 0, sizeof(FakeTable));
+
+	p = fake_token(p, &tok);
+	snprintf(table->name, sizeof(table->name), "%s", tok.text);
+
+	p = fake_token(p, &tok);
+	if (!fake_is(&tok, "("))
+	{
+		fake_error(status, isc_token_err, "Dynamic SQL Error\nSQL error code = -104\nToken unknown - %s", tok.text);
+		return false;
+	}
+
+	while (!fake_is(&tok, ")") && tok.type != FAKE_TOK_END)
+	{
+		FakeColumn *col = &table->cols[table->ncols];
+
+		p = fake_token(p, &tok);
+
+		if (fake_is(&tok, "CONSTRAINT") || fake_is(&tok, "PRIMARY") || fake_is(&tok, "UNIQUE")
+		 || fake_is(&tok, "FOREIGN") || fake_is(&tok, "CHECK"))
+		{
+			p = fake_skip_item(p, &tok);
+			continue;
+		}
+
+		if (tok.type != FAKE_TOK_IDENT)
+		{
+			fake_error(status, isc_token_err, "Dynamic SQL Error\nSQL error code = -104\nToken unknown - %s", tok.text);
+			return false;
+		}
+
+		if (table->ncols == FAKE_MAX_COLUMNS)
+		{
+			fake_error(status, isc_random, "too many columns");
+			return false;
+		}
+
+		snprintf(col->name, sizeof(col->name), "%s", tok.text);
+
+		if (!fake_parse_type(status, col, &p))
+			return false;
+
+		table->ncols++;
+
+		/* column constraints */
+		for (;;)
+		{
+			const char *next = fake_token(p, &tok);
+
+			if (fake_is(&tok, "NOT"))
+			{
+				next = fake_token(next, &tok);
+				if (fake_is(&tok, "NULL"))
+					col->nullable = false;
+			}
+			else if (fake_is(&tok, "PRIMARY"))
+				col->nullable = false;
+
+			if (fake_is(&tok, "(") || fake_is(&tok, ",") || fake_is(&tok, ")") || tok.type == FAKE_TOK_END)
+				break;
+
+			p = next;
+		}
+
+		p = fake_skip_item(p, &tok);
+	}
+
+	return true;
+}
+
+
+/*
+ * The body of an EXECUTE BLOCK is not executed; an INSERT inside it
+ * inserts the number of rows given by the first "<= n" condition, or
+ * a single row
+ */
+static bool
+fake_parse_execute_block(ISC_STATUS *status, FakeStatement *stmt, const char *p)
+{
+	FakeToken	tok;
+	long		rows = 1;
+
+	stmt->type = isc_info_sql_stmt_exec_procedure;
+
+	for (p = fake_token(p, &tok); tok.type != FAKE_TOK_END; p = fake_token(p, &tok))
+	{
+		if (fake_is(&tok, "<=") && rows == 1)
+		{
+			p = fake_token(p, &tok);
+			if (tok.type == FAKE_TOK_NUMBER)
+				rows = atol(tok.text);
+		}
+		else if (fake_is(&tok, "INSERT"))
+		{
+			p = fake_token(p, &tok);
+
+			if (!fake_parse_table_name(status, stmt, &p))
+				return false;
+
+			stmt->effect = FAKE_EFFECT_INSERT;
+			stmt->effect_rows = rows;
+		}
+	}
+
+	return true;
+}
+
+
+static bool
+fake_parse_statement(ISC_STATUS *status, FakeStatement *stmt, const char *sql)
+{
+	FakeToken	tok;
+	const char *p = fake_token(sql, &tok);
+
+	stmt->type = 0;
+	stmt->table = -1;
+	stmt->ncols = 0;
+	stmt->nparams = 0;
+	stmt->effect = FAKE_EFFECT_NONE;
+	stmt->effect_rows = 0;
+	stmt->cursor_open = false;
+	stmt->row = 0;
+
+	if (fake_is(&tok, "SELECT"))
+		return fake_parse_select(status, stmt, p);
+
+	if (fake_is(&tok, "INSERT"))
+		return fake_parse_insert(status, stmt, p);
+
+	if (fake_is(&tok, "UPDATE"))
+	{
+		stmt->type = isc_info_sql_stmt_update;
+
+		if (!fake_parse_table_name(status, stmt, &p))
+			return false;
+
+		return fake_parse_params(status, stmt, p);
+	}
+
+	if (fake_is(&tok, "DELETE"))
+	{
+		stmt->type = isc_info_sql_stmt_delete;
+		stmt->effect = FAKE_EFFECT_DELETE;
+
+		p = fake_token(p, &tok);
+		if (!fake_parse_table_name(status, stmt, &p))
+			return false;
+
+		return fake_parse_params(status, stmt, p);
+	}
+
+	if (fake_is(&tok, "CREATE") || fake_is(&tok, "RECREATE"))
+	{
+		const char *next = fake_token(p, &tok);
+
+		if (fake_is(&tok, "TABLE"))
+			return fake_parse_create_table(status, stmt, next);
+
+		if (fake_is(&tok, "DATABASE"))
+		{
+			fake_error(status, isc_random, "CREATE DATABASE must be executed with isc_dsql_execute_immediate()");
+			return false;
+		}
+
+		stmt->type = isc_info_sql_stmt_ddl;
+		return true;
+	}
+
+	if (fake_is(&tok, "DROP"))
+	{
+		stmt->type = isc_info_sql_stmt_ddl;
+
+		p = fake_token(p, &tok);
+		if (fake_is(&tok, "TABLE"))
+		{
+			stmt->effect = FAKE_EFFECT_DROP_TABLE;
+			return fake_parse_table_name(status, stmt, &p);
+		}
+
+		return true;
+	}
+
+	if (fake_is(&tok, "ALTER") || fake_is(&tok, "COMMENT") || fake_is(&tok, "DECLARE")
+	 || fake_is(&tok, "GRANT") || fake_is(&tok, "REVOKE"))
+	{
+		stmt->type = isc_info_sql_stmt_ddl;
+		return true;
+	}
+
+	if (fake_is(&tok, "EXECUTE"))
+	{
+		p = fake_token(p, &tok);
+
+		if (fake_is(&tok, "BLOCK"))
+			return fake_parse_execute_block(status, stmt, p);
+
+		stmt->type = isc_info_sql_stmt_exec_procedure;
+		return true;
+	}
+
+	if (fake_is(&tok, "SET"))
+	{
+		p = fake_token(p, &tok);
+
+		if (fake_is(&tok, "TRANSACTION"))
+			stmt->type = isc_info_sql_stmt_start_trans;
+		else if (fake_is(&tok, "GENERATOR"))
+			stmt->type = isc_info_sql_stmt_set_generator;
+		else
+			stmt->type = isc_info_sql_stmt_ddl;
+
+		return true;
+	}
+
+	if (fake_is(&tok, "COMMIT"))
+	{
+		stmt->type = isc_info_sql_stmt_commit;
+		return true;
+	}
+
+	if (fake_is(&tok, "ROLLBACK"))
+	{
+		stmt->type = isc_info_sql_stmt_rollback;
+		return true;
+	}
+
+	if (fake_is(&tok, "SAVEPOINT") || fake_is(&tok, "RELEASE"))
+	{
+		stmt->type = isc_info_sql_stmt_savepoint;
+		return true;
+	}
+
+	fake_error(status, isc_token_err, "Dynamic SQL Error\nSQL error code = -104\nToken unknown - %s", tok.text);
+
+	return false;
+}
+
+
+/*
+ * Apply a statement's change to the database
+ */
+static ISC_STATUS
+fake_execute_statement(ISC_STATUS *status, FakeStatement *stmt)
+{
+	int			i;
+
+	switch (stmt->effect)
+	{
+		case FAKE_EFFECT_CREATE_TABLE:
+			i = fake_find_table(stmt->new_table.name);
+
+			if (i >= 0 && tables[i].builtin == false)
+				memset(&tables[i], 0, sizeof(FakeTable));
+			else if (i >= 0)
+				return fake_error(status, isc_random, "unsuccessful metadata update\nTable %s already exists", stmt->new_table.name);
+
+			for (i = 0; i < FAKE_MAX_TABLES; i++)
+			{
+				if (tables[i].name[0] == '\0')
+				{
+					tables[i] = stmt->new_table;
+					break;
+				}
+			}
+
+			if (i == FAKE_MAX_TABLES)
+				return fake_error(status, isc_random, "unsuccessful metadata update\ntoo many tables");
+			break;
+
+		case FAKE_EFFECT_DROP_TABLE:
+			if (tables[stmt->table].builtin == false)
+				memset(&tables[stmt->table], 0, sizeof(FakeTable));
+			break;
+
+		case FAKE_EFFECT_INSERT:
+			tables[stmt->table].rows += stmt->effect_rows;
+			break;
+
+		case FAKE_EFFECT_DELETE:
+			if (tables[stmt->table].builtin == false)
+				tables[stmt->table].rows = 0;
+			break;
+
+		case FAKE_EFFECT_NONE:
+			break;
+	}
+
+	if (stmt->type == isc_info_sql_stmt_select || stmt->type == isc_info_sql_stmt_select_for_upd)
+	{
+		stmt->cursor_open = true;
+		stmt->row = 0;
+	}
+
+	return fake_ok(status);
+}
+
+
+/*
+ * Describe "ncols" columns in "sqlda", as far as it has room
+ */
+static void
+fake_describe(XSQLDA *sqlda, FakeColumn *cols, int ncols, const char *relname)
+{
+	int			i;
+
+	if (sqlda == NULL)
+		return;
+
+	sqlda->sqld = ncols;
+
+	for (i = 0; i < ncols && i < sqlda->sqln; i++)
+	{
+		XSQLVAR    *var = &sqlda->sqlvar[i];
+		FakeColumn *col = &cols[i];
+
+		var->sqltype = col->sqltype | (col->nullable ? 1 : 0);
+		var->sqllen = col->sqllen;
+		var->sqlscale = col->sqlscale;
+		var->sqlsubtype = col->sqlsubtype;
+
+		snprintf(var->sqlname, sizeof(var->sqlname), "%s", col->name);
+		var->sqlname_length = strlen(var->sqlname);
+		snprintf(var->aliasname, sizeof(var->aliasname), "%s", col->name);
+		var->aliasname_length = strlen(var->aliasname);
+		snprintf(var->relname, sizeof(var->relname), "%s", relname);
+		var->relname_length = strlen(var->relname);
+		snprintf(var->ownname, sizeof(var->ownname), "SYSDBA");
+		var->ownname_length = strlen(var->ownname);
+	}
+}
+
+
+/*
+ * Write a character value of at most "maxlen" bytes, padding it with the
+ * column's repeated name to roughly three quarters of its declared
+ * length so longer columns carry longer values
+ */
+static int
+fake_text_value(FakeColumn *col, long row, char *buf, int maxlen)
+{
+	int			len;
+	int			target = col->chars * 3 / 4;
+
+	if (col->fixed != NULL)
+		len = snprintf(buf, maxlen + 1, "%s", col->fixed);
+	else
+		len = snprintf(buf, maxlen + 1, "%ld", row + 1);
+
+	if (len > maxlen)
+		len = maxlen;
+
+	if (target > maxlen)
+		target = maxlen;
+
+	while (col->fixed == NULL && len < target)
+	{
+		int			name_len = strlen(col->name);
+
+		buf[len++] = ' ';
+		if (len + name_len > target)
+			break;
+		memcpy(buf + len, col->name, name_len);
+		len += name_len;
+	}
+
+	return len;
+}
+
+
+static void
+fake_fill_value(FakeColumn *col, int colno, XSQLVAR *var, long row)
+{
+	char	   *data = var->sqldata;
+	ISC_INT64	n = col->fixed != NULL ? atoll(col->fixed) : row + 1;
+	ISC_INT64	scale = col->fixed != NULL ? 1 : 1000003;
+
+	if ((var->sqltype & 1) && var->sqlind != NULL)
+	{
+		if (col->nullable && col->fixed == NULL
+		 && (row + colno) % FAKE_NULL_INTERVAL == FAKE_NULL_INTERVAL - 1)
+		{
+			*var->sqlind = -1;
+			return;
+		}
+
+		*var->sqlind = 0;
+	}
+
+	if (data == NULL)
+		return;
+
+	switch (col->sqltype)
+	{
+		case SQL_SHORT:
+			*(ISC_SHORT *) data = (ISC_SHORT) (n % 32000);
+			break;
+
+		case SQL_LONG:
+			*(ISC_LONG *) data = (ISC_LONG) n;
+			break;
+
+		case SQL_INT64:
+			*(ISC_INT64 *) data = n * scale;
+			break;
+
+		case SQL_FLOAT:
+			*(float *) data = n * 1.5;
+			break;
+
+		case SQL_DOUBLE:
+			*(double *) data = n * 1.5;
+			break;
+
+		case SQL_TYPE_DATE:
+			*(ISC_DATE *) data = FAKE_BASE_DATE + row % 3650;
+			break;
+
+		case SQL_TYPE_TIME:
+			*(ISC_TIME *) data = (row % 86400) * 10000;
+			break;
+
+		case SQL_TIMESTAMP:
+			((ISC_TIMESTAMP *) data)->timestamp_date = FAKE_BASE_DATE + row / 86400;
+			((ISC_TIMESTAMP *) data)->timestamp_time = (row % 86400) * 10000;
+			break;
+
+		case SQL_TEXT:
+		{
+			int			len = fake_text_value(col, row, data, var->sqllen);
+
+			memset(data + len, ' ', var->sqllen - len);
+			break;
+		}
+
+		case SQL_VARYING:
+			((PARAMVARY *) data)->vary_length =
+				fake_text_value(col, row, (char *) ((PARAMVARY *) data)->vary_string, var->sqllen);
+			break;
+
+		case SQL_BLOB:
+			((ISC_QUAD *) data)->gds_quad_high = colno + 1;
+			((ISC_QUAD *) data)->gds_quad_low = row;
+			break;
+
+#if defined SQL_BOOLEAN
+		case SQL_BOOLEAN:
+			*(FB_BOOLEAN *) data = row % 2 ? FB_TRUE : FB_FALSE;
+			break;
+#endif
+	}
+}
+
+
+static FakeStatement *
+fake_statement(ISC_STATUS *status, isc_stmt_handle *handle)
+{
+	int			index = handle != NULL ? FAKE_INDEX(*handle) : -1;
+
+	if (index < 0 || index >= FAKE_MAX_STATEMENTS || statements[index] == NULL)
+	{
+		fake_error(status, isc_bad_stmt_handle, "invalid statement handle");
+		return NULL;
+	}
+
+	return statements[index];
+}
+
+
+static FakeBlob *
+fake_blob(ISC_STATUS *status, isc_blob_handle *handle)
+{
+	int			index = handle != NULL ? FAKE_INDEX(*handle) : -1;
+
+	if (index < 0 || index >= FAKE_MAX_BLOBS || blobs[index].used == false)
+	{
+		fake_error(status, isc_bad_segstr_handle, "invalid BLOB handle");
+		return NULL;
+	}
+
+	return &blobs[index];
+}
+
+
+static FakeBlob *
+fake_alloc_blob(ISC_STATUS *status, isc_blob_handle *handle)
+{
+	int			i;
+
+	for (i = 0; i < FAKE_MAX_BLOBS; i++)
+	{
+		if (blobs[i].used == false)
+		{
+			memset(&blobs[i], 0, sizeof(FakeBlob));
+			blobs[i].used = true;
+			*handle = FAKE_HANDLE(i);
+			return &blobs[i];
+		}
+	}
+
+	fake_error(status, isc_random, "too many open BLOBs");
+	return NULL;
+}
+
+
+/*
+ * Append an info item to an info buffer, returning false if there's
+ * no room
+ */
+static bool
+fake_put_info(char **p, char *end, char item, const char *data, short len)
+{
+	if (*p + 3 + len >= end)
+		return false;
+
+	*(*p)++ = item;
+	*(*p)++ = len & 0xff;
+	*(*p)++ = (len >> 8) & 0xff;
+	memcpy(*p, data, len);
+	*p += len;
+
+	return true;
+}
+
+
+static bool
+fake_put_info_int(char **p, char *end, char item, ISC_LONG value)
+{
+	char		data[4];
+
+	data[0] = value & 0xff;
+	data[1] = (value >> 8) & 0xff;
+	data[2] = (value >> 16) & 0xff;
+	data[3] = (value >> 24) & 0xff;
+
+	return fake_put_info(p, end, item, data, sizeof(data));
+}
+
+
+static void
+fake_decode_date(ISC_DATE date, struct tm *tm)
+{
+	/* Modified Julian Day to the Gregorian calendar */
+	long		a = date + 2400001 + 32044;
+	long		b = (4 * a + 3) / 146097;
+	long		c = a - 146097 * b / 4;
+	long		d = (4 * c + 3) / 1461;
+	long		e = c - 1461 * d / 4;
+	long		m = (5 * e + 2) / 153;
+
+	tm->tm_mday = e - (153 * m + 2) / 5 + 1;
+	tm->tm_mon = m + 3 - 12 * (m / 10) - 1;
+	tm->tm_year = 100 * b + d - 4800 + m / 10 - 1900;
+	tm->tm_wday = (date + 3) % 7;
+}
+
+
+static void
+fake_decode_time(ISC_TIME time, struct tm *tm)
+{
+	ISC_TIME	seconds = time / 10000;
+
+	tm->tm_hour = seconds / 3600;
+	tm->tm_min = seconds / 60 % 60;
+	tm->tm_sec = seconds % 60;
+}
+
+
+/*
+ * Attachments
+ */
+
+ISC_STATUS
+isc_attach_database(ISC_STATUS *status, short db_name_length, const ISC_SCHAR *db_name,
+					isc_db_handle *db, short dpb_length, const ISC_SCHAR *dpb)
+{
+	pthread_mutex_lock(&fake_mutex);
+	*db = ++next_db_handle;
+	pthread_mutex_unlock(&fake_mutex);
+
+	return fake_ok(status);
+}
+
+
+ISC_STATUS
+isc_detach_database(ISC_STATUS *status, isc_db_handle *db)
+{
+	if (*db == 0)
+		return fake_error(status, isc_bad_db_handle, "invalid database handle (no active connection)");
+
+	*db = 0;
+
+	return fake_ok(status);
+}
+
+
+ISC_STATUS
+isc_drop_database(ISC_STATUS *status, isc_db_handle *db)
+{
+	if (*db == 0)
+		return fake_error(status, isc_bad_db_handle, "invalid database handle (no active connection)");
+
+	pthread_mutex_lock(&fake_mutex);
+	fake_init_tables();
+	pthread_mutex_unlock(&fake_mutex);
+
+	*db = 0;
+
+	return fake_ok(status);
+}
+
+
+ISC_STATUS
+isc_database_info(ISC_STATUS *status, isc_db_handle *db, short item_length, const ISC_SCHAR *items,
+				  short buffer_length, ISC_SCHAR *buffer)
+{
+	char	   *p = buffer;
+	char	   *end = buffer + buffer_length;
+	int			i;
+
+	if (*db == 0)
+		return fake_error(status, isc_bad_db_handle, "invalid database handle (no active connection)");
+
+	for (i = 0; i < item_length && items[i] != isc_info_end; i++)
+	{
+		bool		ok = true;
+
+		if (items[i] == isc_info_page_size)
+			ok = fake_put_info_int(&p, end, items[i], FAKE_PAGE_SIZE);
+		else if (items[i] == isc_info_num_buffers)
+			ok = fake_put_info_int(&p, end, items[i], FAKE_NUM_BUFFERS);
+
+		if (!ok)
+		{
+			*p = isc_info_truncated;
+			return fake_ok(status);
+		}
+	}
+
+	if (p < end)
+		*p = isc_info_end;
+
+	return fake_ok(status);
+}
+
+
+/*
+ * Appends an item to a database parameter buffer, which like the
+ * original is always reallocated
+ */
+int
+isc_modify_dpb(ISC_SCHAR **dpb, short *dpb_length, unsigned short type,
+			   const ISC_SCHAR *str, short str_length)
+{
+	short		old_length = (*dpb != NULL && *dpb_length > 0) ? *dpb_length : 1;
+	char	   *new_dpb = malloc(old_length + 2 + str_length);
+
+	if (new_dpb == NULL)
+		return 1;
+
+	if (old_length > 1)
+		memcpy(new_dpb, *dpb, old_length);
+	else
+		new_dpb[0] = isc_dpb_version1;
+
+	new_dpb[old_length] = type;
+	new_dpb[old_length + 1] = str_length;
+	memcpy(new_dpb + old_length + 2, str, str_length);
+
+	*dpb = new_dpb;
+	*dpb_length = old_length + 2 + str_length;
+
+	return 0;
+}
+
+
+/*
+ * Transactions; these have no effect on the data
+ */
+
+ISC_STATUS
+isc_start_transaction(ISC_STATUS *status, isc_tr_handle *trans, short count, ...)
+{
+	if (*trans != 0)
+		return fake_error(status, isc_bad_trans_handle, "invalid transaction handle (expecting explicit transaction start)");
+
+	pthread_mutex_lock(&fake_mutex);
+	*trans = ++next_trans_handle;
+	pthread_mutex_unlock(&fake_mutex);
+
+	return fake_ok(status);
+}
+
+
+ISC_STATUS
+isc_commit_transaction(ISC_STATUS *status, isc_tr_handle *trans)
+{
+	if (*trans == 0)
+		return fake_error(status, isc_bad_trans_handle, "invalid transaction handle (expecting explicit transaction start)");
+
+	*trans = 0;
+
+	return fake_ok(status);
+}
+
+
+ISC_STATUS
+isc_commit_retaining(ISC_STATUS *status, isc_tr_handle *trans)
+{
+	if (*trans == 0)
+		return fake_error(status, isc_bad_trans_handle, "invalid transaction handle (expecting explicit transaction start)");
+
+	return fake_ok(status);
+}
+
+
+ISC_STATUS
+isc_rollback_transaction(ISC_STATUS *status, isc_tr_handle *trans)
+{
+	if (*trans == 0)
+		return fake_error(status, isc_bad_trans_handle, "invalid transaction handle (expecting explicit transaction start)");
+
+	*trans = 0;
+
+	return fake_ok(status);
+}
+
+
+/*
+ * Dynamic SQL
+ */
+
+ISC_STATUS
+isc_dsql_alloc_statement2(ISC_STATUS *status, isc_db_handle *db, isc_stmt_handle *stmt_handle)
+{
+	ISC_STATUS	rc = 0;
+	int			i;
+
+	if (*db == 0)
+		return fake_error(status, isc_bad_db_handle, "invalid database handle (no active connection)");
+
+	pthread_mutex_lock(&fake_mutex);
+
+	for (i = 0; i < FAKE_MAX_STATEMENTS; i++)
+	{
+		if (statements[i] == NULL)
+			break;
+	}
+
+	if (i == FAKE_MAX_STATEMENTS || (statements[i] = calloc(1, sizeof(FakeStatement))) == NULL)
+		rc = fake_error(status, isc_random, "too many statements");
+	else
+	{
+		statements[i]->table = -1;
+		*stmt_handle = FAKE_HANDLE(i);
+		rc = fake_ok(status);
+	}
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_dsql_free_statement(ISC_STATUS *status, isc_stmt_handle *stmt_handle, unsigned short option)
+{
+	FakeStatement *stmt;
+	ISC_STATUS	rc;
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if ((stmt = fake_statement(status, stmt_handle)) == NULL)
+		rc = status[1];
+	else
+	{
+		stmt->cursor_open = false;
+
+		if (option & DSQL_drop)
+		{
+			free(stmt);
+			statements[FAKE_INDEX(*stmt_handle)] = NULL;
+			*stmt_handle = 0;
+		}
+		else if (option & DSQL_unprepare)
+			stmt->type = 0;
+
+		rc = fake_ok(status);
+	}
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_dsql_prepare(ISC_STATUS *status, isc_tr_handle *trans, isc_stmt_handle *stmt_handle,
+				 unsigned short length, const ISC_SCHAR *sql, unsigned short dialect, XSQLDA *sqlda)
+{
+	FakeStatement *stmt;
+	ISC_STATUS	rc;
+
+	if (trans == NULL || *trans == 0)
+		return fake_error(status, isc_bad_trans_handle, "invalid transaction handle (expecting explicit transaction start)");
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if ((stmt = fake_statement(status, stmt_handle)) == NULL)
+		rc = status[1];
+	else if (!fake_parse_statement(status, stmt, sql))
+	{
+		stmt->type = 0;
+		rc = status[1];
+	}
+	else
+	{
+		fake_describe(sqlda, stmt->cols, stmt->ncols, stmt->table >= 0 ? tables[stmt->table].name : "");
+		rc = fake_ok(status);
+	}
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_dsql_describe(ISC_STATUS *status, isc_stmt_handle *stmt_handle, unsigned short dialect, XSQLDA *sqlda)
+{
+	FakeStatement *stmt;
+	ISC_STATUS	rc;
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if ((stmt = fake_statement(status, stmt_handle)) == NULL)
+		rc = status[1];
+	else
+	{
+		fake_describe(sqlda, stmt->cols, stmt->ncols, stmt->table >= 0 ? tables[stmt->table].name : "");
+		rc = fake_ok(status);
+	}
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_dsql_describe_bind(ISC_STATUS *status, isc_stmt_handle *stmt_handle, unsigned short dialect, XSQLDA *sqlda)
+{
+	FakeStatement *stmt;
+	ISC_STATUS	rc;
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if ((stmt = fake_statement(status, stmt_handle)) == NULL)
+		rc = status[1];
+	else
+	{
+		fake_describe(sqlda, stmt->params, stmt->nparams, "");
+		rc = fake_ok(status);
+	}
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_dsql_execute2(ISC_STATUS *status, isc_tr_handle *trans, isc_stmt_handle *stmt_handle,
+				  unsigned short dialect, const XSQLDA *in_sqlda, const XSQLDA *out_sqlda)
+{
+	FakeStatement *stmt;
+	ISC_STATUS	rc;
+
+	if (trans == NULL || *trans == 0)
+		return fake_error(status, isc_bad_trans_handle, "invalid transaction handle (expecting explicit transaction start)");
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if ((stmt = fake_statement(status, stmt_handle)) == NULL)
+		rc = status[1];
+	else if (stmt->type == 0)
+		rc = fake_error(status, isc_random, "Attempt to execute an unprepared dynamic SQL statement");
+	else if (stmt->nparams > 0 && (in_sqlda == NULL || in_sqlda->sqld < stmt->nparams))
+		rc = fake_error(status, isc_random, "Dynamic SQL Error\nSQLDA error\nWrong number of parameters (expected %i)", stmt->nparams);
+	else
+		rc = fake_execute_statement(status, stmt);
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_dsql_execute(ISC_STATUS *status, isc_tr_handle *trans, isc_stmt_handle *stmt_handle,
+				 unsigned short dialect, const XSQLDA *sqlda)
+{
+	return isc_dsql_execute2(status, trans, stmt_handle, dialect, sqlda, NULL);
+}
+
+
+ISC_STATUS
+isc_dsql_execute_immediate(ISC_STATUS *status, isc_db_handle *db, isc_tr_handle *trans,
+						   unsigned short length, const ISC_SCHAR *sql, unsigned short dialect,
+						   const XSQLDA *sqlda)
+{
+	FakeStatement *stmt;
+	FakeToken	tok;
+	const char *p = fake_token(sql, &tok);
+	ISC_STATUS	rc;
+
+	/* CREATE DATABASE needs neither an attachment nor a transaction */
+	if (fake_is(&tok, "CREATE"))
+	{
+		fake_token(p, &tok);
+
+		if (fake_is(&tok, "DATABASE"))
+		{
+			pthread_mutex_lock(&fake_mutex);
+			fake_init_tables();
+			*db = ++next_db_handle;
+			pthread_mutex_unlock(&fake_mutex);
+
+			return fake_ok(status);
+		}
+	}
+
+	if (*db == 0)
+		return fake_error(status, isc_bad_db_handle, "invalid database handle (no active connection)");
+
+	if ((stmt = calloc(1, sizeof(FakeStatement))) == NULL)
+		return fake_error(status, isc_random, "out of memory");
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if (!fake_parse_statement(status, stmt, sql))
+		rc = status[1];
+	else if (stmt->type == isc_info_sql_stmt_start_trans)
+	{
+		*trans = ++next_trans_handle;
+		rc = fake_ok(status);
+	}
+	else if (stmt->type == isc_info_sql_stmt_commit || stmt->type == isc_info_sql_stmt_rollback)
+	{
+		*trans = 0;
+		rc = fake_ok(status);
+	}
+	else if (trans == NULL || *trans == 0)
+		rc = fake_error(status, isc_bad_trans_handle, "invalid transaction handle (expecting explicit transaction start)");
+	else
+		rc = fake_execute_statement(status, stmt);
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	free(stmt);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_dsql_fetch(ISC_STATUS *status, isc_stmt_handle *stmt_handle, unsigned short dialect, const XSQLDA *sqlda)
+{
+	FakeStatement *stmt;
+	ISC_STATUS	rc;
+	int			i;
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if ((stmt = fake_statement(status, stmt_handle)) == NULL)
+		rc = status[1];
+	else if (stmt->cursor_open == false)
+		rc = fake_error(status, isc_dsql_cursor_err, "Dynamic SQL Error\nSQL error code = -504\nAttempt to reclose a closed cursor");
+	else if (stmt->row >= tables[stmt->table].rows)
+	{
+		fake_ok(status);
+		rc = 100;
+	}
+	else
+	{
+		for (i = 0; i < stmt->ncols && i < sqlda->sqld; i++)
+			fake_fill_value(&stmt->cols[i], i, (XSQLVAR *) &sqlda->sqlvar[i], stmt->row);
+
+		stmt->row++;
+		rc = fake_ok(status);
+	}
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_dsql_set_cursor_name(ISC_STATUS *status, isc_stmt_handle *stmt_handle, const ISC_SCHAR *name,
+						 unsigned short type)
+{
+	return fake_ok(status);
+}
+
+
+ISC_STATUS
+isc_dsql_sql_info(ISC_STATUS *status, isc_stmt_handle *stmt_handle, short item_length,
+				  const ISC_SCHAR *items, short buffer_length, ISC_SCHAR *buffer)
+{
+	FakeStatement *stmt;
+	char	   *p = buffer;
+	char	   *end = buffer + buffer_length;
+	bool		ok = true;
+	int			i;
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if ((stmt = fake_statement(status, stmt_handle)) == NULL)
+	{
+		pthread_mutex_unlock(&fake_mutex);
+		return status[1];
+	}
+
+	for (i = 0; ok && i < item_length && items[i] != isc_info_end; i++)
+	{
+
+		if (items[i] == isc_info_sql_stmt_type)
+			ok = fake_put_info_int(&p, end, items[i], stmt->type);
+		else if (items[i] == isc_info_sql_get_plan)
+		{
+			char		plan[FAKE_NAME_LEN * 2] = "";
+
+			if (stmt->table >= 0 && stmt->type != isc_info_sql_stmt_insert)
+				snprintf(plan, sizeof(plan), "\nPLAN (%s NATURAL)", tables[stmt->table].name);
+
+			ok = fake_put_info(&p, end, items[i], plan, strlen(plan));
+		}
+
+	}
+
+	if (p < end)
+		*p = ok ? isc_info_end : isc_info_truncated;
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return fake_ok(status);
+}
+
+
+/*
+ * BLOBs; the content of a BLOB read back is generated from its row
+ * number, and written BLOBs are discarded
+ */
+
+ISC_STATUS
+isc_open_blob2(ISC_STATUS *status, isc_db_handle *db, isc_tr_handle *trans, isc_blob_handle *blob_handle,
+			   ISC_QUAD *blob_id, ISC_USHORT bpb_length, const ISC_UCHAR *bpb)
+{
+	FakeBlob   *blob;
+	ISC_STATUS	rc;
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if ((blob = fake_alloc_blob(status, blob_handle)) == NULL)
+		rc = status[1];
+	else
+	{
+		blob->length = FAKE_BLOB_LENGTH;
+		blob->pattern_len = snprintf(blob->pattern, sizeof(blob->pattern), "document %lu%s",
+									 (unsigned long) blob_id->gds_quad_low + 1, blob_words);
+		rc = fake_ok(status);
+	}
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_create_blob2(ISC_STATUS *status, isc_db_handle *db, isc_tr_handle *trans, isc_blob_handle *blob_handle,
+				 ISC_QUAD *blob_id, short bpb_length, const ISC_SCHAR *bpb)
+{
+	FakeBlob   *blob;
+	ISC_STATUS	rc;
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if ((blob = fake_alloc_blob(status, blob_handle)) == NULL)
+		rc = status[1];
+	else
+	{
+		blob->writing = true;
+		blob_id->gds_quad_high = 0;
+		blob_id->gds_quad_low = FAKE_INDEX(*blob_handle);
+		rc = fake_ok(status);
+	}
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_get_segment(ISC_STATUS *status, isc_blob_handle *blob_handle, unsigned short *length,
+				unsigned short buffer_length, ISC_SCHAR *buffer)
+{
+	FakeBlob   *blob;
+	ISC_STATUS	rc;
+	size_t		i;
+
+	pthread_mutex_lock(&fake_mutex);
+
+	*length = 0;
+
+	if ((blob = fake_blob(status, blob_handle)) == NULL)
+		rc = status[1];
+	else if (blob->offset >= blob->length)
+		rc = fake_error(status, isc_segstr_eof, "end of BLOB");
+	else
+	{
+		for (i = 0; i < buffer_length && blob->offset < blob->length; i++, blob->offset++)
+			buffer[i] = blob->pattern[blob->offset % blob->pattern_len];
+
+		*length = i;
+		rc = fake_ok(status);
+	}
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_put_segment(ISC_STATUS *status, isc_blob_handle *blob_handle, unsigned short length,
+				const ISC_SCHAR *buffer)
+{
+	FakeBlob   *blob;
+	ISC_STATUS	rc;
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if ((blob = fake_blob(status, blob_handle)) == NULL)
+		rc = status[1];
+	else
+	{
+		blob->length += length;
+		rc = fake_ok(status);
+	}
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+ISC_STATUS
+isc_close_blob(ISC_STATUS *status, isc_blob_handle *blob_handle)
+{
+	FakeBlob   *blob;
+	ISC_STATUS	rc;
+
+	pthread_mutex_lock(&fake_mutex);
+
+	if ((blob = fake_blob(status, blob_handle)) == NULL)
+		rc = status[1];
+	else
+	{
+		blob->used = false;
+		*blob_handle = 0;
+		rc = fake_ok(status);
+	}
+
+	pthread_mutex_unlock(&fake_mutex);
+
+	return rc;
+}
+
+
+/*
+ * Utility functions
+ */
+
+ISC_LONG
+isc_vax_integer(const ISC_SCHAR *ptr, short length)
+{
+	ISC_LONG	value = 0;
+	int			shift = 0;
+
+	if (ptr == NULL || length <= 0 || length > 4)
+		return 0;
+
+	while (--length > 0)
+	{
+		value += ((ISC_LONG) (unsigned char) *ptr++) << shift;
+		shift += 8;
+	}
+
+	/* the most significant byte carries the sign */
+	value += ((ISC_LONG) (signed char) *ptr) << shift;
+
+	return value;
+}
+
+
+ISC_LONG
+isc_sqlcode(const ISC_STATUS *status)
+{
+	if (status[1] == 0)
+		return 0;
+
+	switch (status[1])
+	{
+		case isc_token_err:
+			return -104;
+		case isc_dsql_relation_err:
+			return -204;
+		case isc_dsql_field_err:
+			return -206;
+		case isc_dsql_cursor_err:
+			return -504;
+		case isc_segstr_eof:
+			return 100;
+	}
+
+	return -901;
+}
+
+
+ISC_LONG
+fb_interpret(ISC_SCHAR *buffer, unsigned int buffer_length, const ISC_STATUS **vector)
+{
+	const ISC_STATUS *v = *vector;
+	const char *message = NULL;
+	ISC_STATUS	code;
+
+	if (v[0] != isc_arg_gds || v[1] == 0)
+		return 0;
+
+	code = v[1];
+
+	/* arguments up to the next error code */
+	for (v += 2; *v != isc_arg_end && *v != isc_arg_gds; v += 2)
+	{
+		if (*v == isc_arg_string)
+			message = (const char *) v[1];
+	}
+
+	if (message != NULL)
+		snprintf(buffer, buffer_length, "%s", message);
+	else
+		snprintf(buffer, buffer_length, "Firebird error %ld", (long) code);
+
+	*vector = v;
+
+	return strlen(buffer);
+}
+
+
+ISC_STATUS
+isc_print_status(const ISC_STATUS *status)
+{
+	const ISC_STATUS *v = status;
+	char		message[FAKE_MESSAGE_LEN];
+
+	while (fb_interpret(message, sizeof(message), &v))
+		fprintf(stderr, "%s\n", message);
+
+	return status[1];
+}
+
+
+void
+isc_decode_sql_date(const ISC_DATE *date, void *tm_ptr)
+{
+	struct tm  *tm = (struct tm *) tm_ptr;
+
+	memset(tm, 0, sizeof(struct tm));
+	fake_decode_date(*date, tm);
+}
+
+
+void
+isc_decode_sql_time(const ISC_TIME *time, void *tm_ptr)
+{
+	struct tm  *tm = (struct tm *) tm_ptr;
+
+	memset(tm, 0, sizeof(struct tm));
+	fake_decode_time(*time, tm);
+}
+
+
+void
+isc_decode_timestamp(const ISC_TIMESTAMP *timestamp, void *tm_ptr)
+{
+	struct tm  *tm = (struct tm *) tm_ptr;
+
+	memset(tm, 0, sizeof(struct tm));
+	fake_decode_date(timestamp->timestamp_date, tm);
+	fake_decode_time(timestamp->timestamp_time, tm);
+}
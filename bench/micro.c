@@ -0,0 +1,311 @@
+/*-------------------------------------------------------------------------
+ *
+ * micro.c
+ *
+ * Micro-benchmarks for the per-row and per-parameter code paths which
+ * don't depend on the server: datum formatting (_FQformatDatum()),
+ * parameter binding (_FQexecBindParam()), RDB$DB_KEY conversion,
+ * character display width calculation and FQExpBuffer appends. Values
+ * are provided in synthetic XSQLVARs, so no Firebird instance is
+ * needed.
+ *
+ * Usage: bench/micro [iterations]
+ *
+ * This software is released under the PostgreSQL Licence
+ *
+ * bench/micro.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libfq-int.h"
+
+#define BENCH_DEFAULT_ITERATIONS 1000000
+
+/* Number of values formatted into a result before it is cleared */
+#define BENCH_RESULT_VALUES 10000
+
+/* Storage for a synthetic datum, aligned for any type */
+typedef union BenchValue {
+	ISC_INT64	align;
+	char		data[512];
+} BenchValue;
+
+/* A multi-line ASCII value, such as a text column might contain */
+#define BENCH_TEXT \
+	"Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod\n" \
+	"tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim\n" \
+	"veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea\n" \
+	"commodo consequat. Duis aute irure dolor in reprehenderit in voluptate\n" \
+	"velit esse cillum dolore eu fugiat nulla pariatur."
+
+typedef struct BenchCase {
+	const char *name;
+	void		(*run)(FBconn *conn, struct BenchCase *bc, int iterations);
+	short		sqltype;		/* type of the synthetic XSQLVAR */
+	short		sqllen;
+	short		sqlscale;
+	const char *text;			/* parameter value, or string to process */
+	bool		get_dsp_len;
+} BenchCase;
+
+static void bench_format(FBconn *conn, BenchCase *bc, int iterations);
+static void bench_bind(FBconn *conn, BenchCase *bc, int iterations);
+static void bench_parse_dbkey(FBconn *conn, BenchCase *bc, int iterations);
+static void bench_deparse_dbkey(FBconn *conn, BenchCase *bc, int iterations);
+static void bench_dsplen(FBconn *conn, BenchCase *bc, int iterations);
+static void bench_expbuffer(FBconn *conn, BenchCase *bc, int iterations);
+
+static BenchCase cases[] = {
+	{ "format-short",		bench_format, SQL_SHORT,		2,	0,	NULL,	false },
+	{ "format-long",		bench_format, SQL_LONG,			4,	0,	NULL,	false },
+	{ "format-numeric",		bench_format, SQL_INT64,		8,	-4,	NULL,	false },
+	{ "format-double",		bench_format, SQL_DOUBLE,		8,	0,	NULL,	false },
+	{ "format-date",		bench_format, SQL_TYPE_DATE,	4,	0,	NULL,	false },
+	{ "format-timestamp",	bench_format, SQL_TIMESTAMP,	8,	0,	NULL,	false },
+	{ "format-char",		bench_format, SQL_TEXT,			10,	0,	"abcdefghij", false },
+	{ "format-varchar",		bench_format, SQL_VARYING,		40,	0,	"The quick brown fox jumps", false },
+	{ "format-varchar-dsp",	bench_format, SQL_VARYING,		40,	0,	"id=42 \xe6\x9d\xb1\xe4\xba\xac\xe9\x83\xbd", true },
+	{ "format-text",		bench_format, SQL_VARYING,		400,	0,	BENCH_TEXT, false },
+	{ "format-text-dsp",	bench_format, SQL_VARYING,		400,	0,	BENCH_TEXT, true },
+	{ "bind-long",			bench_bind, SQL_LONG,			4,	0,	"1234567",	false },
+	{ "bind-numeric",		bench_bind, SQL_INT64,			8,	-4,	"123456.7890", false },
+	{ "bind-double",		bench_bind, SQL_DOUBLE,			8,	0,	"3.14159265", false },
+	{ "bind-timestamp",		bench_bind, SQL_TIMESTAMP,		8,	0,	"2020-02-29 12:34:56", false },
+	{ "bind-varchar",		bench_bind, SQL_VARYING,		40,	0,	"The quick brown fox jumps", false },
+	{ "dbkey-parse",		bench_parse_dbkey, 0,			0,	0,	"\x81\x00\x00\x00\x01\x00\x00\x00", false },
+	{ "dbkey-deparse",		bench_deparse_dbkey, 0,			0,	0,	"8100000001000000", false },
+	{ "dsplen-ascii",		bench_dsplen, 0,				0,	0,	"The quick brown fox jumps over the lazy dog", false },
+	{ "dsplen-cjk",			bench_dsplen, 0,				0,	0,	"\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe6\x96\x87\xe7\xab\xa0", false },
+	{ "expbuffer-append",	bench_expbuffer, 0,				0,	0,	"value,", false },
+	{ NULL, NULL, 0, 0, 0, NULL, false }
+};
+
+
+static double
+elapsed_ms(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000.0
+		+ (end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+
+/*
+ * Fill "var" with a synthetic non-NULL value of the case's type
+ */
+static void
+init_var(XSQLVAR *var, BenchValue *value, BenchCase *bc)
+{
+	memset(var, 0, sizeof(XSQLVAR));
+	memset(value, 0, sizeof(BenchValue));
+
+	var->sqltype = bc->sqltype;
+	var->sqllen = bc->sqllen;
+	var->sqlscale = bc->sqlscale;
+	var->sqlsubtype = FBENC_UTF8;
+	var->sqldata = value->data;
+
+	switch (bc->sqltype)
+	{
+		case SQL_SHORT:
+			*(short *)value->data = -12345;
+			break;
+		case SQL_LONG:
+			*(int *)value->data = 1234567890;
+			break;
+		case SQL_INT64:
+			*(ISC_INT64 *)value->data = 12345678901234LL;
+			break;
+		case SQL_DOUBLE:
+			*(double *)value->data = 12345.6789;
+			break;
+		case SQL_TYPE_DATE:
+			/* 2020-02-29 */
+			*(ISC_DATE *)value->data = 58908;
+			break;
+		case SQL_TIMESTAMP:
+			((ISC_TIMESTAMP *)value->data)->timestamp_date = 58908;
+			((ISC_TIMESTAMP *)value->data)->timestamp_time = 452961234;
+			break;
+		case SQL_TEXT:
+			memcpy(value->data, bc->text, bc->sqllen);
+			break;
+		case SQL_VARYING:
+			((PARAMVARY *)value->data)->vary_length = strlen(bc->text);
+			memcpy(((PARAMVARY *)value->data)->vary_string, bc->text, strlen(bc->text));
+			break;
+	}
+}
+
+
+static void
+bench_format(FBconn *conn, BenchCase *bc, int iterations)
+{
+	FBresult   *result = _FQinitResult(conn, false);
+	FQresTupleAttDesc att_desc;
+	XSQLVAR		var;
+	BenchValue	value;
+	int			i;
+
+	init_var(&var, &value, bc);
+
+	memset(&att_desc, 0, sizeof(FQresTupleAttDesc));
+	att_desc.type = bc->sqltype;
+
+	conn->get_dsp_len = bc->get_dsp_len;
+
+	for (i = 0; i < iterations; i++)
+	{
+		FQresTupleAtt *att = _FQformatDatum(conn, result, &att_desc, &var);
+
+		_FQfree(att);
+
+		if ((i + 1) % BENCH_RESULT_VALUES == 0)
+		{
+			FQclear(result);
+			result = _FQinitResult(conn, false);
+		}
+	}
+
+	FQclear(result);
+}
+
+
+static void
+bench_bind(FBconn *conn, BenchCase *bc, int iterations)
+{
+	XSQLVAR		var;
+	BenchValue	value;
+	char		error_message[1024];
+	int			i;
+
+	init_var(&var, &value, bc);
+
+	for (i = 0; i < iterations; i++)
+	{
+		/* parameters may be coerced to another type when bound */
+		var.sqltype = bc->sqltype | 1;
+		var.sqllen = bc->sqllen;
+		var.sqlind = NULL;
+
+		if (!_FQexecBindParam(conn, &var, bc->text, 0, error_message))
+		{
+			fprintf(stderr, "%s: %s\n", bc->name, error_message);
+			exit(1);
+		}
+
+		_FQfree(var.sqldata);
+		_FQfree(var.sqlind);
+	}
+}
+
+
+static void
+bench_parse_dbkey(FBconn *conn, BenchCase *bc, int iterations)
+{
+	int			i;
+
+	for (i = 0; i < iterations; i++)
+		_FQfree(_FQparseDbKey(bc->text));
+}
+
+
+static void
+bench_deparse_dbkey(FBconn *conn, BenchCase *bc, int iterations)
+{
+	int			i;
+
+	for (i = 0; i < iterations; i++)
+		_FQfree(_FQdeparseDbKey(bc->text));
+}
+
+
+/*
+ * Display width of a UTF-8 string, as calculated by FQdspstrlen()
+ */
+static void
+bench_dsplen(FBconn *conn, BenchCase *bc, int iterations)
+{
+	volatile int width = 0;
+	int			i;
+
+	for (i = 0; i < iterations; i++)
+		width = FQdspstrlen(bc->text, FBENC_UTF8);
+
+	(void) width;
+}
+
+
+static void
+bench_expbuffer(FBconn *conn, BenchCase *bc, int iterations)
+{
+	FQExpBufferData buf;
+	int			i;
+
+	initFQExpBuffer(&buf);
+
+	for (i = 0; i < iterations; i++)
+	{
+		appendFQExpBufferStr(&buf, bc->text);
+		appendFQExpBuffer(&buf, "%i;", i);
+		appendFQExpBufferChar(&buf, '\n');
+
+		if (buf.len > 65536)
+			resetFQExpBuffer(&buf);
+	}
+
+	termFQExpBuffer(&buf);
+}
+
+
+int
+main(int argc, char **argv)
+{
+	int			iterations = BENCH_DEFAULT_ITERATIONS;
+	FBconn		conn;
+	BenchCase  *bc;
+
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+
+	if (iterations <= 0)
+	{
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	/* a connection object which is never connected */
+	memset(&conn, 0, sizeof(FBconn));
+	conn.client_encoding_id = FBENC_UTF8;
+	conn.client_min_messages = WARNING;
+
+	printf("%-20s %10s %12s %10s\n",
+		   "case", "iterations", "total ms", "ns/op");
+
+	for (bc = cases; bc->name != NULL; bc++)
+	{
+		struct timespec start, end;
+		double		ms;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		bc->run(&conn, bc, iterations);
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		ms = elapsed_ms(&start, &end);
+
+		printf("%-20s %10i %12.2f %10.1f\n",
+			   bc->name,
+			   iterations,
+			   ms,
+			   ms * 1000000 / iterations);
+	}
+
+	return 0;
+}
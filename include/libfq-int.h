@@ -1,6 +1,8 @@
 #ifndef LIBFQ_INT_H
 #define LIBFQ_INT_H
 
+#include "libfq.h"
+
 typedef PARAMVARY VARY2;
 typedef unsigned int fb_wchar;
 
@@ -19,6 +21,88 @@ typedef unsigned int fb_wchar;
  */
 #define FB_XSQLDA_INITLEN 15
 
+/* Size of the blocks in which an FBresult's tuple values are stored */
+#define FB_RESULT_BLOCK_SIZE 8192
+
+typedef struct FQresultBlock
+{
+	struct FQresultBlock *next;
+	size_t		size;
+	size_t		used;
+	char		data[];
+} FQresultBlock;
+
+/*
+ * Memory held by the results of a connection, shared between the
+ * connection and each of its results so results can outlive it;
+ * see FQconnMemorySize() and FQsetMemoryLimit()
+ */
+typedef struct FQmemAccount
+{
+	size_t		size;			/* bytes allocated by live results */
+	size_t		limit;			/* maximum for "size" while fetching rows; 0 = none */
+	int			refcount;		/* connection plus each live result */
+} FQmemAccount;
+
+/*
+ * Initial and maximum sizes of the buffer used to retrieve a statement's
+ * plan; isc_dsql_sql_info() buffer lengths are a short
+ */
+#define FB_PLAN_BUFFER_SIZE 2048
+#define FB_PLAN_BUFFER_MAX 32767
+
+/* Amount of output FQcopyOut() accumulates before writing it */
+#define FB_COPY_BUFFER_SIZE 65536
+
+/* Default number of rows in each record batch produced by FQexecArrow() */
+#define FB_ARROW_BATCH_ROWS 65536
+
+/* ISC_DATE value (days since 1858-11-17) of the Unix epoch */
+#define FB_ARROW_EPOCH_DATE 40587
+
+/*
+ * Record statistics for an FBresult, if being collected; FB_STATS_PHASE()
+ * adds the time since "start" (from _FQstatsClock()) to a phase's timing.
+ */
+#define FB_STATS_ADD(result, field, value) \
+	do { if ((result)->stats != NULL) (result)->stats->field += (value); } while (0)
+
+#define FB_STATS_PHASE(result, field, start, calls) \
+	do { \
+		if ((result)->stats != NULL) \
+		{ \
+			(result)->stats->field += _FQstatsClock(result) - (start); \
+			(result)->stats->round_trips += (calls); \
+		} \
+	} while (0)
+
+/*
+ * Wrap a call to the Firebird client library, evaluating to its return
+ * value; if tracing callbacks are set, they are invoked around the call.
+ * The comma operator ensures _FQtraceBegin() is called before the call
+ * itself is evaluated.
+ */
+#define FB_TRACE(conn, operation, call) \
+	(((conn)->trace_begin == NULL && (conn)->trace_end == NULL) \
+	 ? (call) \
+	 : (_FQtraceBegin((conn), (operation)), _FQtraceEnd((conn), (call))))
+
+/*
+ * Log a message with FQlog(); the level is checked before the message's
+ * arguments are evaluated or formatted.
+ */
+#define FB_LOG(conn, loglevel, ...) \
+	do { if ((loglevel) >= (conn)->client_min_messages) FQlog((conn), (loglevel), __VA_ARGS__); } while (0)
+
+/* Maximum length of a message passed to a log receiver or notice processor */
+#define FB_LOG_MESSAGE_LEN 1024
+
+/* Default number of messages buffered by FQsetAsyncLog() */
+#define FB_ASYNC_LOG_MESSAGES 1024
+
+/* Alignment of each datum within a row buffer */
+#define FB_BUFFER_ALIGN(len) (((len) + 7) & ~((size_t) 7))
+
 /*
  * INT64 sscanf formats for various platforms
  */
@@ -44,4 +128,38 @@ extern int pg_utf_dsplen(const unsigned char *s);
 
 extern int pg_utf_mblen(const unsigned char *s);
 
+extern int utf8_dspstrlen(const unsigned char *s, int len);
+
+extern int ascii_prefix_dsplen(const unsigned char *s, int len, int *consumed);
+
+extern int mb_encoding_mblen(const unsigned char *s, short encoding_id);
+
+extern int mb_encoding_dsplen(const unsigned char *s, short encoding_id);
+
+/*
+ * Allocation with the allocator set by FQsetAllocator(); used by
+ * libfq.c and fqexpbuffer.c for everything except result memory
+ */
+extern void *_FQmalloc(size_t size);
+
+extern void *_FQrealloc(void *ptr, size_t size);
+
+extern void _FQfree(void *ptr);
+
+extern char *_FQstrdup(const char *str);
+
+/*
+ * Internal units of libfq.c which don't require a server, exported so
+ * they can be exercised in isolation (see bench/micro.c)
+ */
+extern FBresult *_FQinitResult(const FBconn *conn, bool init_sqlda_in);
+
+extern FQresTupleAtt *_FQformatDatum(FBconn *conn, FBresult *result, FQresTupleAttDesc *att_desc, XSQLVAR *var);
+
+extern bool _FQexecBindParam(FBconn *conn, XSQLVAR *var, const char *value, int param_format, char *error_message);
+
+extern char *_FQparseDbKey(const char *db_key);
+
+extern char *_FQdeparseDbKey(const char *db_key);
+
 #endif   /* LIBFQ_INT_H */
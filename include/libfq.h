@@ -2,6 +2,7 @@
 #define LIBFQ_H
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <ibase.h>
 
 #ifndef C_H
@@ -168,6 +169,9 @@ typedef uint32 bits32;                  /* >= 32 bits */
 
 #define BLOB_SEGMENT_LEN 80
 
+/* Number of released statement handles each connection keeps for reuse */
+#define FB_STMT_POOL_SIZE 8
+
 typedef enum
 {
 	CONNECTION_OK = 0,
@@ -203,6 +207,83 @@ typedef enum {
 } FQtransactionStatusType;
 
 
+/* Size of the statement type and SQLCODE arrays of FQconnMetrics */
+#define FB_METRICS_STMT_TYPES 16
+#define FB_METRICS_SQLCODES 16
+
+/* Cumulative metrics for a connection; see FQconnStats() */
+typedef struct FQconnMetrics
+{
+	long	statements[FB_METRICS_STMT_TYPES];	/* statements executed, by isc_info_sql_stmt_* type (0 = other) */
+	long	prepares;
+	long	commits;
+	long	rollbacks;
+	long	errors;
+	struct
+	{
+		long sqlcode;
+		long count;
+	}		error_sqlcodes[FB_METRICS_SQLCODES];	/* errors by SQLCODE, for the first distinct codes seen */
+	long	rows_fetched;
+	size_t	bytes_stored;		/* size of the values of fetched rows */
+	int64_t	fbclient_usecs;		/* time spent in fbclient calls, for statements with stats */
+	int64_t	libfq_usecs;		/* time spent in libfq, for statements with stats */
+} FQconnMetrics;
+
+struct FBconn;
+struct FBresult;
+
+/* Called after each statement has been executed; see FQsetMetricsCallback() */
+typedef void (*FQmetricsCallback)(const struct FBconn *conn, const struct FBresult *res, void *arg);
+
+/* A call to the Firebird client library; see FQsetTraceCallbacks() */
+typedef struct FQtraceEvent
+{
+	const char *operation;		/* name of the function called, e.g. "isc_dsql_prepare" */
+	uint32_t	stmt_hash;		/* hash of the statement being executed, or 0 */
+	int64_t		start_usecs;	/* monotonic clock time at which the call started */
+	int64_t		duration_usecs;	/* duration of the call (end callback only) */
+	ISC_STATUS	status;			/* value returned by the call (end callback only) */
+	void	   *span;			/* free for use by the callbacks, NULL at the start of each call */
+} FQtraceEvent;
+
+/* Called before and after each traced call; see FQsetTraceCallbacks() */
+typedef void (*FQtraceCallback)(const struct FBconn *conn, FQtraceEvent *event, void *arg);
+
+/* Called with each notice (non-fatal error); see FQsetNoticeProcessor() */
+typedef void (*FQnoticeProcessor)(void *arg, const char *message);
+
+/* Called with each message logged with FQlog(); see FQsetLogReceiver() */
+typedef void (*FQlogReceiver)(void *arg, short loglevel, const char *message);
+
+struct FQasyncLog;
+
+struct FQmemAccount;
+
+/* A statement which exceeded the slow query threshold; see FQsetSlowQueryLog() */
+typedef struct FQslowQuery
+{
+	const char	*stmt;					/* statement text */
+	int			 nparams;
+	const char * const *param_values;	/* as passed to FQexecParams(); NULL if redacted or none */
+	const int	*param_formats;
+	int64_t		 duration_usecs;		/* total execution time */
+	const char	*plan;					/* plan from isc_info_sql_get_plan, or NULL */
+	const struct FBresult *result;		/* the statement's result, with FQresultStats() available */
+} FQslowQuery;
+
+typedef void (*FQslowQueryCallback)(const struct FBconn *conn, const FQslowQuery *query, void *arg);
+
+/* Memory allocation functions; see FQsetAllocator() and FQsetConnAllocator() */
+typedef struct FQallocator
+{
+	void	   *(*malloc_func)(size_t size, void *arg);
+	void	   *(*realloc_func)(void *ptr, size_t size, void *arg);
+	void		(*free_func)(void *ptr, void *arg);
+	void	   *arg;					/* passed to each function */
+} FQallocator;
+
+
 typedef struct FBconn {
 	isc_db_handle  db;
 	isc_tr_handle  trans;
@@ -221,7 +302,31 @@ typedef struct FBconn {
 	short		   client_encoding_id;	  /* corresponds to MON$ATTACHMENTS.MON$CHARACTER_SET_ID */
 	char		  *client_encoding;		  /* client encoding, default UTF8 */
 	bool		   get_dsp_len;			  /* calculate display length in single characters of each datum */
+	int			   fetch_pipeline_rows;	  /* number of rows to fetch ahead in a background thread (0 = disabled) */
+	bool		   trim_char;			  /* remove trailing pad spaces from CHAR values */
+	bool		   collect_stats;		  /* record FQresStats for each result */
+	FQconnMetrics  metrics;				  /* cumulative metrics */
+	FQmetricsCallback metrics_callback;	  /* called after each statement is executed */
+	void		  *metrics_callback_arg;
+	FQtraceCallback trace_begin;		  /* called before each call to the Firebird client library */
+	FQtraceCallback trace_end;			  /* called after each call to the Firebird client library */
+	void		  *trace_arg;
+	FQtraceEvent   trace_event;			  /* call currently being traced */
+	uint32_t	   trace_stmt_hash;		  /* hash of the statement currently being executed */
+	FQnoticeProcessor notice_processor;	  /* called with each notice; writes to stderr by default */
+	void		  *notice_arg;
+	FQlogReceiver  log_receiver;		  /* called with each logged message; writes to stdout by default */
+	void		  *log_arg;
+	struct FQasyncLog *async_log;		  /* background log writer, if started with FQsetAsyncLog() */
+	int64_t		   slow_query_usecs;	  /* threshold above which statements are reported */
+	bool		   slow_query_redact;	  /* omit parameter values from slow query reports */
+	FQslowQueryCallback slow_query_callback; /* called with each slow statement */
+	void		  *slow_query_arg;
 	char		  *errMsg;		  		  /* most recently generated error message */
+	isc_stmt_handle stmt_pool[FB_STMT_POOL_SIZE]; /* released statement handles available for reuse */
+	int			   stmt_pool_count;		  /* number of handles in stmt_pool */
+	struct FQmemAccount *mem_account;	  /* memory held by this connection's results */
+	FQallocator	   allocator;			  /* used for this connection's results */
 } FBconn;
 
 
@@ -277,6 +382,102 @@ typedef struct fbMessageField
 } FBMessageField;
 
 
+/* Data formats supported by FQcopyOut() */
+typedef enum {
+	FQCOPY_FORMAT_CSV = 0,
+	FQCOPY_FORMAT_TEXT			/* tab-separated, with backslash escapes */
+} FQcopyFormat;
+
+
+/*
+ * Options for FQcopyOut() and FQcopyIn(); zero-initialise for the
+ * defaults (CSV format, no header line).
+ */
+typedef struct FQcopyOptions
+{
+	FQcopyFormat format;
+	char		 delimiter;		/* field delimiter; default ',' (CSV) or tab (text) */
+	char		 quote;			/* CSV quote character; default '"' */
+	const char	*null_string;	/* representation of NULL; default "" (CSV) or "\N" (text) */
+	bool		 header;		/* first line contains the column names */
+	int			 batch_size;	/* FQcopyIn(): rows per commit in autocommit mode; 0 = commit once at the end */
+} FQcopyOptions;
+
+
+/*
+ * Callback receiving the output of FQexecJSON() and FQresultToJSON()
+ * in chunks; return false to abort the output.
+ */
+typedef bool (*FQjsonWriter)(const char *data, size_t len, void *arg);
+
+
+/*
+ * Arrow C data interface structures, as defined in the Arrow
+ * specification; see FQexecArrow().
+ */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+	const char *format;
+	const char *name;
+	const char *metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema **children;
+	struct ArrowSchema *dictionary;
+	void (*release)(struct ArrowSchema *);
+	void *private_data;
+};
+
+struct ArrowArray {
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void **buffers;
+	struct ArrowArray **children;
+	struct ArrowArray *dictionary;
+	void (*release)(struct ArrowArray *);
+	void *private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+/*
+ * Callback receiving each record batch produced by FQexecArrow(), which
+ * it must move or release; return false to abort the query.
+ */
+typedef bool (*FQarrowBatchCallback)(struct ArrowSchema *schema, struct ArrowArray *batch, void *arg);
+
+
+/*
+ * Timings (in microseconds) and counters recorded for each phase of
+ * query execution, if enabled with FQsetResultStats()
+ */
+typedef struct FQresStats
+{
+	int64_t prepare_usecs;		/* statement allocation, preparation and type lookup */
+	int64_t describe_usecs;		/* describing parameters and output columns, binding parameters */
+	int64_t execute_usecs;		/* statement execution */
+	int64_t fetch_usecs;		/* waiting for rows to be fetched */
+	int64_t format_usecs;		/* converting and storing fetched rows, including BLOB reads */
+	int64_t fill_usecs;			/* building the array of tuples */
+	int64_t total_usecs;		/* total, including transaction handling */
+	int		statement_type;		/* isc_info_sql_stmt_* type, if determined */
+	long	round_trips;		/* fbclient calls which may involve a server round trip */
+	long	rows_fetched;
+	long	blobs_opened;
+	size_t	bytes_stored;		/* size of stored tuple values */
+	long	allocations;		/* memory allocations for stored rows and values */
+} FQresStats;
+
+
 /* Initialised with _FQinitResult() */
 typedef struct FBresult
 {
@@ -285,6 +486,14 @@ typedef struct FBresult
 									 * NOTE: the XSQLDA pointers are only used during query execution and will be
 									 * freed once execution has completed; see _FQexecClearResult().
 									 */
+	char   *sqlda_out_buffer;		/* Single buffer holding the data and NULL indicators of sqlda_out */
+	struct FQresultBlock *value_blocks;	/* Storage for tuple values; see _FQresultAlloc() */
+	FQresStats *stats;				/* Execution statistics, if enabled with FQsetResultStats() */
+	int64_t stats_start;			/* clock time at which execution started, if stats set */
+	const char *exec_stmt;			/* statement text and parameters, set during execution only */
+	int exec_nparams;
+	const char * const *exec_param_values;
+	const int *exec_param_formats;
 	isc_stmt_handle stmt_handle;
 	FQexecStatusType resultStatus;
 	int ntups;						/* The number of rows (tuples) returned by a query.
@@ -308,6 +517,12 @@ typedef struct FBresult
 	long	   fbSQLCODE;		/* Firebird SQL code */
 	int	   	   errLine;
 	int	   	   errCol;
+
+	struct FBresult *next;		/* next result, if executed as part of a script */
+
+	struct FQmemAccount *mem_account;	/* connection's account, or NULL; see _FQresultMalloc() */
+	size_t mem_size;			/* bytes currently allocated for this result */
+	FQallocator allocator;		/* allocator of the result's memory, from its connection */
 } FBresult;
 
 extern char *const fbresStatus[];
@@ -374,6 +589,18 @@ FQexecParams(FBconn *conn,
 
 extern FBresult *FQexecTransaction(FBconn *conn, const char *stmt);
 
+extern FBresult *FQexecImmediate(FBconn *conn, const char *stmt);
+
+extern FBresult *FQexecScript(FBconn *conn, const char *script);
+
+extern FBresult *FQcopyOut(FBconn *conn, const char *stmt, int fd, const FQcopyOptions *options);
+
+extern FBresult *FQcopyIn(FBconn *conn, const char *table, const char * const *columns, int fd, const FQcopyOptions *options);
+
+extern FBresult *FQexecJSON(FBconn *conn, const char *stmt, FQjsonWriter writer, void *arg);
+
+extern FBresult *FQexecArrow(FBconn *conn, const char *stmt, int batch_rows, FQarrowBatchCallback callback, void *arg);
+
 /*
  * =========================
  * Result handling functions
@@ -425,9 +652,54 @@ FQfformat(const FBresult *res, int column_number);
 extern short
 FQftype(const FBresult *res, int column_number);
 
+extern bool
+FQresultToJSON(const FBresult *res, FQjsonWriter writer, void *arg);
+
 extern void
 FQsetGetdsplen(FBconn *conn, bool get_dsp_len);
 
+extern void
+FQsetFetchPipeline(FBconn *conn, int rows);
+
+extern void
+FQsetTrimChar(FBconn *conn, bool trim_char);
+
+extern void
+FQsetResultStats(FBconn *conn, bool collect_stats);
+
+extern const FQresStats *
+FQresultStats(const FBresult *res);
+
+extern const FQconnMetrics *
+FQconnStats(const FBconn *conn);
+
+extern void
+FQsetMetricsCallback(FBconn *conn, FQmetricsCallback callback, void *arg);
+
+extern void
+FQsetTraceCallbacks(FBconn *conn, FQtraceCallback begin, FQtraceCallback end, void *arg);
+
+extern void
+FQsetSlowQueryLog(FBconn *conn, int64_t threshold_usecs, bool redact_params, FQslowQueryCallback callback, void *arg);
+
+extern void
+FQsetMemoryLimit(FBconn *conn, size_t limit);
+
+extern size_t
+FQresultMemorySize(const FBresult *res);
+
+extern size_t
+FQconnMemorySize(const FBconn *conn);
+
+extern void
+FQsetAllocator(const FQallocator *allocator);
+
+extern void
+FQsetConnAllocator(FBconn *conn, const FQallocator *allocator);
+
+extern void
+FQfreemem(void *ptr);
+
 extern int
 FQgetlength(const FBresult *res,
             int row_number,
@@ -447,6 +719,9 @@ FQformatDbKey(const FBresult *res,
               int row_number,
               int column_number);
 
+extern FBresult *
+FQnextResult(const FBresult *res);
+
 extern void
 FQclear(FBresult *res);
 
@@ -505,6 +780,18 @@ FQexplainStatement(FBconn *conn, const char *stmt);
 extern void
 FQlog(FBconn *conn, short loglevel, const char *msg, ...);
 
+extern void
+FQsetClientMinMessages(FBconn *conn, short loglevel);
+
+extern FQnoticeProcessor
+FQsetNoticeProcessor(FBconn *conn, FQnoticeProcessor proc, void *arg);
+
+extern FQlogReceiver
+FQsetLogReceiver(FBconn *conn, FQlogReceiver receiver, void *arg);
+
+extern bool
+FQsetAsyncLog(FBconn *conn, int fd, int nmessages);
+
 /* handling for character/encoding */
 
 extern int FQmblen(const char *s, short encoding_id);
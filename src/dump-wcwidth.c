@@ -0,0 +1,72 @@
+/*-------------------------------------------------------------------------
+ *
+ * dump-wcwidth.c
+ *
+ * Write the column width calculated by pg_utf_dsplen() (and hence
+ * ucs_wcwidth()) for every codepoint, one "codepoint width" pair per
+ * line in hexadecimal and decimal, preceded by the Unicode version of
+ * the width table. Used by "make check-wcwidth", which compares the
+ * output with the Unicode database:
+ *
+ *   src/dump-wcwidth | src/generate-wcwidth-table.py --check
+ *
+ * This software is released under the PostgreSQL Licence
+ *
+ * src/dump-wcwidth.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+
+#include "libfq-int.h"
+#include "fqwcwidth_table.h"
+
+/*
+ * Encode a codepoint as UTF-8 in the same way as utf8_to_unicode()
+ * decodes it; surrogates are encoded like any other codepoint.
+ */
+static void
+encode_utf8(unsigned int cp, unsigned char *buf)
+{
+	if (cp < 0x80)
+	{
+		buf[0] = cp;
+	}
+	else if (cp < 0x800)
+	{
+		buf[0] = 0xc0 | (cp >> 6);
+		buf[1] = 0x80 | (cp & 0x3f);
+	}
+	else if (cp < 0x10000)
+	{
+		buf[0] = 0xe0 | (cp >> 12);
+		buf[1] = 0x80 | ((cp >> 6) & 0x3f);
+		buf[2] = 0x80 | (cp & 0x3f);
+	}
+	else
+	{
+		buf[0] = 0xf0 | (cp >> 18);
+		buf[1] = 0x80 | ((cp >> 12) & 0x3f);
+		buf[2] = 0x80 | ((cp >> 6) & 0x3f);
+		buf[3] = 0x80 | (cp & 0x3f);
+	}
+}
+
+
+int
+main(void)
+{
+	unsigned char buf[4];
+	unsigned int cp;
+
+	printf("unicode %s\n", WCWIDTH_UNICODE_VERSION);
+
+	for (cp = 0; cp <= 0x10ffff; cp++)
+	{
+		encode_utf8(cp, buf);
+		printf("%x %i\n", cp, pg_utf_dsplen(buf));
+	}
+
+	return 0;
+}
@@ -4,7 +4,8 @@
  *
  * FQExpBuffer provides an indefinitely-extensible string data type.
  * It can be used to buffer either ordinary C strings (null-terminated text)
- * or arbitrary binary data.  All storage is allocated with malloc().
+ * or arbitrary binary data.  All storage is allocated with _FQmalloc(),
+ * i.e. with the allocator set by FQsetAllocator().
  *
  * This module is essentially a copy of PostgreSQL's pqexpbuffer.c; see:
  *
@@ -28,6 +29,7 @@
  */
 
 #include "libfq.h"
+#include "libfq-int.h"
 
 #include <limits.h>
 
@@ -47,7 +49,7 @@ static void
 markFQExpBufferBroken(FQExpBuffer str)
 {
 	if (str->data != oom_buffer)
-		free(str->data);
+		_FQfree(str->data);
 
 	/*
 	 * Casting away const here is a bit ugly, but it seems preferable to not
@@ -70,7 +72,7 @@ createFQExpBuffer(void)
 {
 	FQExpBuffer res;
 
-	res = (FQExpBuffer) malloc(sizeof(FQExpBufferData));
+	res = (FQExpBuffer) _FQmalloc(sizeof(FQExpBufferData));
 	if (res != NULL)
 		initFQExpBuffer(res);
 
@@ -86,7 +88,7 @@ createFQExpBuffer(void)
 void
 initFQExpBuffer(FQExpBuffer str)
 {
-	str->data = (char *) malloc(INITIAL_EXPBUFFER_SIZE);
+	str->data = (char *) _FQmalloc(INITIAL_EXPBUFFER_SIZE);
 	if (str->data == NULL)
 	{
 		str->data = (char *) oom_buffer;		/* see comment above */
@@ -113,7 +115,7 @@ destroyFQExpBuffer(FQExpBuffer str)
 	if (str)
 	{
 		termFQExpBuffer(str);
-		free(str);
+		_FQfree(str);
 	}
 }
 
@@ -126,7 +128,7 @@ void
 termFQExpBuffer(FQExpBuffer str)
 {
 	if (str->data != oom_buffer)
-		free(str->data);
+		_FQfree(str->data);
 	/* just for luck, make the buffer validly empty. */
 	str->data = (char *) oom_buffer;	/* see comment above */
 	str->maxlen = 0;
@@ -209,7 +211,7 @@ enlargeFQExpBuffer(FQExpBuffer str, size_t needed)
 	if (newlen > (size_t) INT_MAX)
 		newlen = (size_t) INT_MAX;
 
-	newdata = (char *) realloc(str->data, newlen);
+	newdata = (char *) _FQrealloc(str->data, newlen);
 	if (newdata != NULL)
 	{
 		str->data = newdata;
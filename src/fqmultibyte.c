@@ -16,8 +16,20 @@
  *----------------------------------------------------------------------
  */
 
+#include <string.h>
+
+/*
+ * SSE2 is always available on x86-64, but only on i386 if the compiler
+ * targets it (-msse2); the AVX2 path is selected at runtime.
+ */
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <immintrin.h>
+#define FQ_USE_X86_SIMD 1
+#endif
+
 #include "ibase.h"
 #include "libfq-int.h"
+#include "libfq.h"
 
 /*
  * This is an implementation of wcwidth() and wcswidth() as defined in
@@ -31,38 +43,7 @@
  * original available at : http://www.cl.cam.ac.uk/~mgk25/ucs/wcwidth.c
  */
 
-struct mbinterval
-{
-	unsigned short first;
-	unsigned short last;
-};
-
-/* auxiliary function for binary search in interval table */
-static int
-mbbisearch(fb_wchar ucs, const struct mbinterval * table, int max)
-{
-	int			min = 0;
-	int			mid;
-
-	if (ucs < table[0].first || ucs > table[max].last)
-		return 0;
-	while (max >= min)
-	{
-		mid = (min + max) / 2;
-		if (ucs > table[mid].last)
-			min = mid + 1;
-		else if (ucs < table[mid].first)
-			max = mid - 1;
-		else
-			return 1;
-	}
-
-	return 0;
-}
-
-
-
-
+#include "fqwcwidth_table.h"
 
 /* The following functions define the column width of an ISO 10646
  * character as follows:
@@ -79,8 +60,8 @@ mbbisearch(fb_wchar ucs, const struct mbinterval * table, int max)
  *	  - Other format characters (general category code Cf in the Unicode
  *		database) and ZERO WIDTH SPACE (U+200B) have a column width of 0.
  *
- *	  - Hangul Jamo medial vowels and final consonants (U+1160-U+11FF)
- *		have a column width of 0.
+ *	  - Hangul Jamo medial vowels and final consonants (U+1160-U+11FF,
+ *		U+D7B0-U+D7FF) have a column width of 0.
  *
  *	  - Spacing characters in the East Asian Wide (W) or East Asian
  *		FullWidth (F) category as defined in Unicode Technical
@@ -92,77 +73,25 @@ mbbisearch(fb_wchar ucs, const struct mbinterval * table, int max)
  *
  * This implementation assumes that wchar_t characters are encoded
  * in ISO 10646.
+ *
+ * The widths are precomputed for all codepoints by
+ * src/generate-wcwidth-table.py; see fqwcwidth_table.h for the table
+ * layout.
  */
 
 static int
 ucs_wcwidth(fb_wchar ucs)
 {
-	/* sorted list of non-overlapping intervals of non-spacing characters */
-	static const struct mbinterval combining[] = {
-		{0x0300, 0x034E}, {0x0360, 0x0362}, {0x0483, 0x0486},
-		{0x0488, 0x0489}, {0x0591, 0x05A1}, {0x05A3, 0x05B9},
-		{0x05BB, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
-		{0x05C4, 0x05C4}, {0x064B, 0x0655}, {0x0670, 0x0670},
-		{0x06D6, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED},
-		{0x070F, 0x070F}, {0x0711, 0x0711}, {0x0730, 0x074A},
-		{0x07A6, 0x07B0}, {0x0901, 0x0902}, {0x093C, 0x093C},
-		{0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0954},
-		{0x0962, 0x0963}, {0x0981, 0x0981}, {0x09BC, 0x09BC},
-		{0x09C1, 0x09C4}, {0x09CD, 0x09CD}, {0x09E2, 0x09E3},
-		{0x0A02, 0x0A02}, {0x0A3C, 0x0A3C}, {0x0A41, 0x0A42},
-		{0x0A47, 0x0A48}, {0x0A4B, 0x0A4D}, {0x0A70, 0x0A71},
-		{0x0A81, 0x0A82}, {0x0ABC, 0x0ABC}, {0x0AC1, 0x0AC5},
-		{0x0AC7, 0x0AC8}, {0x0ACD, 0x0ACD}, {0x0B01, 0x0B01},
-		{0x0B3C, 0x0B3C}, {0x0B3F, 0x0B3F}, {0x0B41, 0x0B43},
-		{0x0B4D, 0x0B4D}, {0x0B56, 0x0B56}, {0x0B82, 0x0B82},
-		{0x0BC0, 0x0BC0}, {0x0BCD, 0x0BCD}, {0x0C3E, 0x0C40},
-		{0x0C46, 0x0C48}, {0x0C4A, 0x0C4D}, {0x0C55, 0x0C56},
-		{0x0CBF, 0x0CBF}, {0x0CC6, 0x0CC6}, {0x0CCC, 0x0CCD},
-		{0x0D41, 0x0D43}, {0x0D4D, 0x0D4D}, {0x0DCA, 0x0DCA},
-		{0x0DD2, 0x0DD4}, {0x0DD6, 0x0DD6}, {0x0E31, 0x0E31},
-		{0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x0EB1, 0x0EB1},
-		{0x0EB4, 0x0EB9}, {0x0EBB, 0x0EBC}, {0x0EC8, 0x0ECD},
-		{0x0F18, 0x0F19}, {0x0F35, 0x0F35}, {0x0F37, 0x0F37},
-		{0x0F39, 0x0F39}, {0x0F71, 0x0F7E}, {0x0F80, 0x0F84},
-		{0x0F86, 0x0F87}, {0x0F90, 0x0F97}, {0x0F99, 0x0FBC},
-		{0x0FC6, 0x0FC6}, {0x102D, 0x1030}, {0x1032, 0x1032},
-		{0x1036, 0x1037}, {0x1039, 0x1039}, {0x1058, 0x1059},
-		{0x1160, 0x11FF}, {0x17B7, 0x17BD}, {0x17C6, 0x17C6},
-		{0x17C9, 0x17D3}, {0x180B, 0x180E}, {0x18A9, 0x18A9},
-		{0x200B, 0x200F}, {0x202A, 0x202E}, {0x206A, 0x206F},
-		{0x20D0, 0x20E3}, {0x302A, 0x302F}, {0x3099, 0x309A},
-		{0xFB1E, 0xFB1E}, {0xFE20, 0xFE23}, {0xFEFF, 0xFEFF},
-		{0xFFF9, 0xFFFB}
-	};
-
-	/* test for 8-bit control characters */
-	if (ucs == 0)
-		return 0;
-
-	if (ucs < 0x20 || (ucs >= 0x7f && ucs < 0xa0) || ucs > 0x0010ffff)
+	int			code;
+
+	if (ucs > 0x0010ffff)
 		return -1;
 
-	/* binary search in table of non-spacing characters */
-	if (mbbisearch(ucs, combining,
-				   sizeof(combining) / sizeof(struct mbinterval) - 1))
-		return 0;
-
-	/*
-	 * if we arrive here, ucs is not a combining or C0/C1 control character
-	 */
-
-	return 1 +
-		(ucs >= 0x1100 &&
-		 (ucs <= 0x115f ||		/* Hangul Jamo init. consonants */
-		  (ucs >= 0x2e80 && ucs <= 0xa4cf && (ucs & ~0x0011) != 0x300a &&
-		   ucs != 0x303f) ||	/* CJK ... Yi */
-		  (ucs >= 0xac00 && ucs <= 0xd7a3) ||	/* Hangul Syllables */
-		  (ucs >= 0xf900 && ucs <= 0xfaff) ||	/* CJK Compatibility
-												 * Ideographs */
-		  (ucs >= 0xfe30 && ucs <= 0xfe6f) ||	/* CJK Compatibility Forms */
-		  (ucs >= 0xff00 && ucs <= 0xff5f) ||	/* Fullwidth Forms */
-		  (ucs >= 0xffe0 && ucs <= 0xffe6) ||
-		  (ucs >= 0x20000 && ucs <= 0x2ffff)));
+	code = wcwidth_pages[wcwidth_index[ucs >> WCWIDTH_PAGE_BITS]][(ucs & 0xff) >> 2];
+	code = (code >> ((ucs & 3) * 2)) & 3;
+
+	/* code 3 denotes a control character */
+	return code == 3 ? -1 : code;
 }
 
 /*
@@ -228,3 +157,341 @@ pg_utf_mblen(const unsigned char *s)
 		len = 1;
 	return len;
 }
+
+
+
+/*
+ * Lead byte classification for Firebird's multibyte client encodings
+ * other than UTF8.
+ *
+ * For each encoding, the non-ASCII lead byte values are divided into
+ * ranges giving the byte length and display width of the character
+ * each introduces; bytes not covered by any range are treated as
+ * single-byte, single-width characters. GB18030 four-byte sequences,
+ * which are distinguished by their second byte, are handled in
+ * mb_encoding_mblen().
+ */
+
+struct mbleadrange
+{
+	unsigned char first;
+	unsigned char last;
+	unsigned char mblen;
+	unsigned char dsplen;
+};
+
+/* SJIS_0208, CP943C: half-width katakana are single-byte */
+static const struct mbleadrange sjis_ranges[] = {
+	{0x81, 0x9f, 2, 2},
+	{0xa1, 0xdf, 1, 1},
+	{0xe0, 0xfc, 2, 2},
+};
+
+/* EUCJ_0208: SS2 introduces half-width katakana, SS3 JIS X 0212 */
+static const struct mbleadrange eucjp_ranges[] = {
+	{0x8e, 0x8e, 2, 1},
+	{0x8f, 0x8f, 3, 2},
+	{0xa1, 0xfe, 2, 2},
+};
+
+/* KSC_5601, GB_2312 */
+static const struct mbleadrange euc_ranges[] = {
+	{0xa1, 0xfe, 2, 2},
+};
+
+/* BIG_5, GBK, GB18030 */
+static const struct mbleadrange dbcs_ranges[] = {
+	{0x81, 0xfe, 2, 2},
+};
+
+typedef struct mbencoding
+{
+	short		encoding_id;
+	const struct mbleadrange *ranges;
+	int			nranges;
+} mbencoding;
+
+#define MBENCODING(id, ranges) { id, ranges, sizeof(ranges) / sizeof(struct mbleadrange) }
+
+static const mbencoding mbencodings[] = {
+	MBENCODING(FBENC_SJIS_0208, sjis_ranges),
+	MBENCODING(FBENC_CP943C, sjis_ranges),
+	MBENCODING(FBENC_EUCJ_0208, eucjp_ranges),
+	MBENCODING(FBENC_KSC_5601, euc_ranges),
+	MBENCODING(FBENC_GB_2312, euc_ranges),
+	MBENCODING(FBENC_BIG_5, dbcs_ranges),
+	MBENCODING(FBENC_GBK, dbcs_ranges),
+	MBENCODING(FBENC_GB18030, dbcs_ranges),
+};
+
+
+static const struct mbleadrange *
+mb_lead_range(const unsigned char *s, short encoding_id)
+{
+	int			i;
+
+	for (i = 0; i < sizeof(mbencodings) / sizeof(mbencoding); i++)
+	{
+		const mbencoding *enc = &mbencodings[i];
+		int			j;
+
+		if (enc->encoding_id != encoding_id)
+			continue;
+
+		for (j = 0; j < enc->nranges; j++)
+		{
+			if (*s >= enc->ranges[j].first && *s <= enc->ranges[j].last)
+				return &enc->ranges[j];
+		}
+
+		break;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Return the byte length of the character pointed to by s in one of the
+ * non-UTF8 multibyte encodings; 1 for single-byte encodings.
+ */
+int
+mb_encoding_mblen(const unsigned char *s, short encoding_id)
+{
+	const struct mbleadrange *range;
+
+	if ((*s & 0x80) == 0)
+		return 1;
+
+	range = mb_lead_range(s, encoding_id);
+
+	if (range == NULL)
+		return 1;
+
+	/* GB18030 four-byte sequences have a digit as the second byte */
+	if (encoding_id == FBENC_GB18030 && s[1] >= 0x30 && s[1] <= 0x39)
+		return 4;
+
+	return range->mblen;
+}
+
+
+/*
+ * Return the display width of the character pointed to by s in one of
+ * the non-UTF8 multibyte encodings; ASCII characters have the same
+ * widths as in UTF8.
+ */
+int
+mb_encoding_dsplen(const unsigned char *s, short encoding_id)
+{
+	const struct mbleadrange *range;
+
+	if ((*s & 0x80) == 0)
+	{
+		if (*s == 0)
+			return 0;
+
+		return (*s < 0x20 || *s == 0x7f) ? -1 : 1;
+	}
+
+	range = mb_lead_range(s, encoding_id);
+
+	if (range == NULL)
+		return 1;
+
+	return range->dsplen;
+}
+
+/*
+ * Display width of a run of ASCII characters, which is one for each
+ * printable character and -1 for each control character, as returned
+ * by ucs_wcwidth().
+ */
+static int
+ascii_dsplen(const unsigned char *s, int len)
+{
+	int			dsplen = 0;
+	int			i;
+
+	for (i = 0; i < len; i++)
+		dsplen += (s[i] < 0x20 || s[i] == 0x7f) ? -1 : 1;
+
+	return dsplen;
+}
+
+#ifdef FQ_USE_X86_SIMD
+
+/*
+ * Determine the display width of the leading run of 16-byte blocks
+ * which contain only ASCII characters; 'consumed' is set to the number
+ * of bytes examined.
+ */
+static int
+ascii_blocks_dsplen_sse2(const unsigned char *s, int len, int *consumed)
+{
+	const __m128i space = _mm_set1_epi8(0x20);
+	const __m128i del = _mm_set1_epi8(0x7f);
+	int			dsplen = 0;
+	int			i = 0;
+
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i		v = _mm_loadu_si128((const __m128i *) (s + i));
+		__m128i		ctrl;
+
+		/* stop at the first block containing a non-ASCII byte */
+		if (_mm_movemask_epi8(v) != 0)
+			break;
+
+		ctrl = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del));
+		dsplen += 16 - 2 * __builtin_popcount(_mm_movemask_epi8(ctrl));
+	}
+
+	*consumed = i;
+
+	return dsplen;
+}
+
+/* As above, for AVX2-capable CPUs, using 32-byte blocks */
+__attribute__((target("avx2")))
+static int
+ascii_blocks_dsplen_avx2(const unsigned char *s, int len, int *consumed)
+{
+	const __m256i space = _mm256_set1_epi8(0x20);
+	const __m256i del = _mm256_set1_epi8(0x7f);
+	int			dsplen = 0;
+	int			i = 0;
+
+	for (; i + 32 <= len; i += 32)
+	{
+		__m256i		v = _mm256_loadu_si256((const __m256i *) (s + i));
+		__m256i		ctrl;
+
+		if (_mm256_movemask_epi8(v) != 0)
+			break;
+
+		ctrl = _mm256_or_si256(_mm256_cmpgt_epi8(space, v), _mm256_cmpeq_epi8(v, del));
+		dsplen += 32 - 2 * __builtin_popcount((unsigned int) _mm256_movemask_epi8(ctrl));
+	}
+
+	*consumed = i;
+
+	return dsplen;
+}
+
+static int
+ascii_blocks_dsplen(const unsigned char *s, int len, int *consumed)
+{
+	static int	have_avx2 = -1;
+
+	if (have_avx2 == -1)
+	{
+		__builtin_cpu_init();
+		have_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+
+	if (have_avx2 == 1 && len >= 32)
+	{
+		int			dsplen = ascii_blocks_dsplen_avx2(s, len, consumed);
+		int			sse2_consumed;
+
+		/* pick up any remaining 16-byte block */
+		dsplen += ascii_blocks_dsplen_sse2(s + *consumed, len - *consumed, &sse2_consumed);
+		*consumed += sse2_consumed;
+
+		return dsplen;
+	}
+
+	return ascii_blocks_dsplen_sse2(s, len, consumed);
+}
+
+#else
+
+/*
+ * Portable version, examining 8 bytes at a time to find the leading
+ * run of ASCII-only blocks.
+ */
+static int
+ascii_blocks_dsplen(const unsigned char *s, int len, int *consumed)
+{
+	int			i = 0;
+
+	for (; i + 8 <= len; i += 8)
+	{
+		unsigned long long word;
+
+		memcpy(&word, s + i, sizeof(word));
+
+		if (word & 0x8080808080808080ULL)
+			break;
+	}
+
+	*consumed = i;
+
+	return ascii_dsplen(s, i);
+}
+
+#endif   /* FQ_USE_X86_SIMD */
+
+
+/*
+ * Return the display width of the leading run of ASCII characters in
+ * the first 'len' bytes of 's', setting 'consumed' to its length in
+ * bytes. Complete blocks are counted with the vectorised functions
+ * above.
+ */
+int
+ascii_prefix_dsplen(const unsigned char *s, int len, int *consumed)
+{
+	int			dsplen = ascii_blocks_dsplen(s, len, consumed);
+	int			i = *consumed;
+
+	/* ASCII characters which did not fill a complete block */
+	while (i < len && !(s[i] & 0x80))
+		i++;
+
+	dsplen += ascii_dsplen(s + *consumed, i - *consumed);
+	*consumed = i;
+
+	return dsplen;
+}
+
+
+/*
+ * Return the display width of the first 'len' bytes of the UTF8 string
+ * 's', as the sum of pg_utf_dsplen() for each character. A trailing
+ * incomplete character is ignored.
+ *
+ * Runs of ASCII characters, which are by far the most common, are
+ * counted in bulk, with only non-ASCII characters requiring a width
+ * lookup.
+ */
+int
+utf8_dspstrlen(const unsigned char *s, int len)
+{
+	int			dsplen = 0;
+
+	while (len > 0)
+	{
+		int			consumed;
+		int			chlen;
+
+		dsplen += ascii_prefix_dsplen(s, len, &consumed);
+		s += consumed;
+		len -= consumed;
+
+		if (len <= 0)
+			break;
+
+		chlen = pg_utf_mblen(s);
+
+		if (len < chlen)
+			break;
+
+		dsplen += pg_utf_dsplen(s);
+		s += chlen;
+		len -= chlen;
+	}
+
+	return dsplen;
+}
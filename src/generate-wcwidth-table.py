@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+#
+# generate-wcwidth-table.py
+#
+# Generate src/fqwcwidth_table.h, the two-level lookup table used by
+# ucs_wcwidth() in src/fqmultibyte.c, from the Unicode character
+# database bundled with the Python interpreter (see
+# unicodedata.unidata_version).
+#
+# Usage: src/generate-wcwidth-table.py > src/fqwcwidth_table.h
+#
+# With --check, instead read the widths calculated by libfq for every
+# codepoint, as written by src/dump-wcwidth, from standard input and
+# compare them with those derived from the Unicode database and a set of
+# known widths; see "make check-wcwidth".
+#
+# The column width of each codepoint is determined as follows, following
+# Markus Kuhn's wcwidth() implementation:
+#
+#   - U+0000 has a width of 0
+#   - other C0/C1 control characters and DEL have a width of -1
+#   - non-spacing and enclosing combining characters (Mn, Me), format
+#     characters (Cf) other than SOFT HYPHEN, and Hangul Jamo medial
+#     vowels and final consonants have a width of 0
+#   - characters in the East Asian Wide (W) or Fullwidth (F) categories
+#     have a width of 2
+#   - all other characters have a width of 1
+#
+# This software is released under the PostgreSQL Licence
+
+import sys
+import unicodedata
+
+MAX_CODEPOINT = 0x10FFFF
+PAGE_BITS = 8
+PAGE_SIZE = 1 << PAGE_BITS
+BYTES_PER_PAGE = PAGE_SIZE // 4
+
+# two-bit width codes as stored in the table
+WIDTH_CODE = {0: 0, 1: 1, 2: 2, -1: 3}
+
+# widths which must hold regardless of the rules above
+KNOWN_WIDTHS = [
+    (0x0000, 0),    # NULL
+    (0x0007, -1),   # BELL
+    (0x0041, 1),    # LATIN CAPITAL LETTER A
+    (0x007F, -1),   # DELETE
+    (0x00AD, 1),    # SOFT HYPHEN
+    (0x0300, 0),    # COMBINING GRAVE ACCENT
+    (0x1100, 2),    # HANGUL CHOSEONG KIYEOK
+    (0x1160, 0),    # HANGUL JUNGSEONG FILLER
+    (0x200B, 0),    # ZERO WIDTH SPACE
+    (0x3000, 2),    # IDEOGRAPHIC SPACE
+    (0xFF21, 2),    # FULLWIDTH LATIN CAPITAL LETTER A
+    (0x1F600, 2),   # GRINNING FACE
+    (0x20000, 2),   # CJK UNIFIED IDEOGRAPH-20000
+    (0xE0001, 0),   # LANGUAGE TAG
+]
+
+# number of mismatches to report individually
+MAX_REPORTED = 20
+
+
+def wcwidth(cp):
+    if cp == 0:
+        return 0
+
+    if cp < 0x20 or 0x7F <= cp < 0xA0:
+        return -1
+
+    ch = chr(cp)
+    category = unicodedata.category(ch)
+
+    if category in ('Mn', 'Me'):
+        return 0
+
+    if category == 'Cf' and cp != 0x00AD:
+        return 0
+
+    if cp == 0x200B or 0x1160 <= cp <= 0x11FF or 0xD7B0 <= cp <= 0xD7FF:
+        return 0
+
+    if unicodedata.east_asian_width(ch) in ('W', 'F'):
+        return 2
+
+    return 1
+
+
+def build_pages():
+    pages = []
+    page_index = {}
+    stage1 = []
+
+    for base in range(0, MAX_CODEPOINT + 1, PAGE_SIZE):
+        packed = bytearray(BYTES_PER_PAGE)
+
+        for offset in range(PAGE_SIZE):
+            code = WIDTH_CODE[wcwidth(base + offset)]
+            packed[offset >> 2] |= code << ((offset & 3) * 2)
+
+        packed = bytes(packed)
+
+        if packed not in page_index:
+            page_index[packed] = len(pages)
+            pages.append(packed)
+
+        stage1.append(page_index[packed])
+
+    return stage1, pages
+
+
+def check(stream):
+    header = stream.readline().split()
+
+    if len(header) != 2 or header[0] != 'unicode':
+        sys.exit("unexpected input; expected the output of src/dump-wcwidth")
+
+    if header[1] != unicodedata.unidata_version:
+        sys.exit("the width table was generated from Unicode %s, but this Python "
+                 "provides Unicode %s; use a matching Python or run "
+                 "\"make update-wcwidth-table\"" % (header[1], unicodedata.unidata_version))
+
+    widths = {}
+    mismatches = 0
+
+    for line in stream:
+        cp, width = line.split()
+        cp = int(cp, 16)
+        width = int(width)
+        widths[cp] = width
+
+        expected = wcwidth(cp)
+
+        if width != expected:
+            mismatches += 1
+            if mismatches <= MAX_REPORTED:
+                print("U+%04X: width %i, expected %i (category %s, east asian width %s)"
+                      % (cp, width, expected, unicodedata.category(chr(cp)),
+                         unicodedata.east_asian_width(chr(cp))))
+
+    if len(widths) != MAX_CODEPOINT + 1:
+        sys.exit("expected %i codepoints, read %i" % (MAX_CODEPOINT + 1, len(widths)))
+
+    for cp, expected in KNOWN_WIDTHS:
+        if wcwidth(cp) != expected or widths[cp] != expected:
+            mismatches += 1
+            print("U+%04X: width %i (generator %i), expected %i"
+                  % (cp, widths[cp], wcwidth(cp), expected))
+
+    if mismatches > 0:
+        sys.exit("%i mismatches found" % mismatches)
+
+    print("widths of all %i codepoints match Unicode %s"
+          % (len(widths), unicodedata.unidata_version))
+
+
+def main():
+    if sys.argv[1:] == ['--check']:
+        check(sys.stdin)
+        return
+
+    stage1, pages = build_pages()
+
+    if len(pages) > 256:
+        sys.exit("too many distinct pages (%i) for an 8-bit index" % len(pages))
+
+    out = sys.stdout
+
+    out.write("/*\n")
+    out.write(" * fqwcwidth_table.h\n")
+    out.write(" *\n")
+    out.write(" * Character column widths, generated from Unicode %s by\n"
+              % unicodedata.unidata_version)
+    out.write(" * src/generate-wcwidth-table.py; do not edit.\n")
+    out.write(" *\n")
+    out.write(" * The width of codepoint 'ucs' is stored as a two-bit code in\n")
+    out.write(" * wcwidth_pages[wcwidth_index[ucs >> %i]], at bit offset\n" % PAGE_BITS)
+    out.write(" * (ucs & 3) * 2 of byte (ucs & 0x%02x) >> 2; codes 0, 1 and 2 are\n"
+              % (PAGE_SIZE - 1))
+    out.write(" * the width itself, 3 denotes a control character (width -1).\n")
+    out.write(" */\n\n")
+
+    out.write("#define WCWIDTH_UNICODE_VERSION \"%s\"\n\n" % unicodedata.unidata_version)
+    out.write("#define WCWIDTH_PAGE_BITS %i\n" % PAGE_BITS)
+    out.write("#define WCWIDTH_PAGE_COUNT %i\n\n" % len(stage1))
+
+    out.write("static const unsigned char wcwidth_index[%i] = {\n" % len(stage1))
+    for i in range(0, len(stage1), 16):
+        out.write("\t" + ", ".join("%3i" % v for v in stage1[i:i + 16]) + ",\n")
+    out.write("};\n\n")
+
+    out.write("static const unsigned char wcwidth_pages[%i][%i] = {\n"
+              % (len(pages), BYTES_PER_PAGE))
+    for page in pages:
+        out.write("\t{\n")
+        for i in range(0, BYTES_PER_PAGE, 16):
+            out.write("\t\t" + ", ".join("0x%02x" % v for v in page[i:i + 16]) + ",\n")
+        out.write("\t},\n")
+    out.write("};\n")
+
+
+if __name__ == '__main__':
+    main()
@@ -14,12 +14,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
+#include <errno.h>
 #include <math.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "ibase.h"
 
@@ -39,15 +42,67 @@ _FQrollbackTransaction(FBconn *conn, isc_tr_handle *trans);
 static FQtransactionStatusType
 _FQstartTransaction(FBconn *conn, isc_tr_handle *trans);
 
-static FQresTupleAtt *_FQformatDatum (FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var);
-static FBresult *_FQinitResult(bool init_sqlda_in);
-static void _FQexecClearResult(FBresult *result);
+static char *_FQformatValue(FBconn *conn, FBresult *result, short datatype, XSQLVAR *var, int *len);
+static char *_FQresultAlloc(FBresult *result, size_t len);
+static void _FQresultResetValues(FBresult *result);
+static void *_FQresultMalloc(FBresult *result, size_t size);
+static void _FQresultFree(FBresult *result, void *ptr, size_t size);
+static void _FQresultAllocSQLDA(FBresult *result, XSQLDA **sqlda, short sqln);
+static bool _FQresultMemoryExceeded(const FBresult *result);
+static void _FQmemAccountRelease(FQmemAccount *account);
+
+static bool _FQexecOpenCursor(FBconn *conn, FBresult *result, const char *stmt);
+static void _FQcopyInitOptions(const FQcopyOptions *options, FQcopyOptions *opts);
+static void _FQcopyAppendValue(FQExpBuffer buf, const char *value, int len, const FQcopyOptions *opts);
+static void _FQcopyAppendIdentifier(FQExpBuffer buf, const char *name);
+static bool _FQcopyWrite(int fd, FQExpBuffer buf);
+
+typedef struct FQcopyInState FQcopyInState;
+static int _FQcopyReadRecord(FQcopyInState *state);
+static int _FQcopyParseRecord(FQcopyInState *state);
+
+static void _FQjsonAppendString(FQExpBuffer buf, const char *value, int len);
+static void _FQjsonAppendKey(FQExpBuffer buf, int column_number, const char *name, int len);
+static void _FQjsonAppendValue(FQExpBuffer buf, short datatype, const char *value, int len);
+static bool _FQjsonWrite(FQExpBuffer buf, FQjsonWriter writer, void *arg);
+
+typedef struct FQarrowColumn FQarrowColumn;
+static void _FQarrowInitColumn(FBconn *conn, FQarrowColumn *column, XSQLVAR *var);
+static void _FQarrowResetColumn(FQarrowColumn *column, int batch_rows);
+static void _FQarrowAppendValue(FBconn *conn, FBresult *result, FQarrowColumn *column, XSQLVAR *var, int row);
+static bool _FQarrowEmitBatch(FBresult *result, FQarrowColumn *columns, int nrows, FQarrowBatchCallback callback, void *arg);
+static void _FQarrowInitSchema(struct ArrowSchema *schema, const char *format, const char *name, int64_t flags, int64_t n_children);
+static void _FQarrowInitArray(struct ArrowArray *array, int64_t length, int64_t null_count, int64_t n_buffers, int64_t n_children);
+static void _FQarrowReleaseSchema(struct ArrowSchema *schema);
+static void _FQarrowReleaseArray(struct ArrowArray *array);
+
+static void _FQstatsInit(const FBconn *conn, FBresult *result);
+static int64_t _FQstatsClock(const FBresult *result);
+static void _FQmetricsCountStatement(FBconn *conn, FBresult *result, int statement_type);
+static void _FQmetricsCountError(FBconn *conn, long sqlcode);
+static void _FQmetricsRecord(FBconn *conn, FBresult *result);
+static void _FQslowQueryRecord(FBconn *conn, FBresult *result);
+static int64_t _FQclockUsecs(void);
+static void _FQtraceStatement(FBconn *conn, const char *stmt);
+static void _FQtraceBegin(FBconn *conn, const char *operation);
+static ISC_STATUS _FQtraceEnd(FBconn *conn, ISC_STATUS status);
+static size_t _FQresultValueSize(const FBresult *result);
+static void _FQclearResult(FBresult *result);
+static void _FQexecClearResult(FBconn *conn, FBresult *result);
 static void _FQexecClearSQLDA(FBresult *result, XSQLDA *sqlda);
+static ISC_STATUS _FQallocStatement(FBconn *conn, isc_stmt_handle *stmt_handle);
+static void _FQreleaseStatement(FBconn *conn, isc_stmt_handle *stmt_handle);
 static void _FQexecFillTuplesArray(FBresult *result);
+static void _FQexecDiscardTuples(FBresult *result);
 static void _FQexecInitOutputSQLDA(FBconn *conn, FBresult *result);
 static ISC_LONG _FQexecParseStatementType(char *info_buffer);
+static ISC_STATUS _FQexecGetPlan(FBconn *conn, ISC_STATUS *status, isc_stmt_handle *stmt_handle, char **plan);
+static int _FQexecGuessStatementType(const char *stmt);
+static char *_FQexecScriptNextStatement(const char **script, const char *term);
+static bool _FQexecScriptIsSetTerm(const char *stmt, char *term, size_t term_size);
 
 static FBresult *_FQexec(FBconn *conn, isc_tr_handle *trans, const char *stmt);
+static FBresult *_FQexecImmediate(FBconn *conn, isc_tr_handle *trans, const char *stmt, int statement_type);
 static FBresult *_FQexecParams(FBconn *conn,
 							   isc_tr_handle *trans,
 							   const char *stmt,
@@ -58,18 +113,43 @@ static FBresult *_FQexecParams(FBconn *conn,
 							   const int *paramFormats,
 							   int resultFormat);
 
+static int _FQexecFetch(FBconn *conn, FBresult *result, long *fetch_stat);
+static int _FQexecFetchPipelined(FBconn *conn, FBresult *result, long *fetch_stat);
+static void *_FQexecFetchThread(void *arg);
+static size_t _FQexecRowBufferSize(const XSQLDA *sqlda);
+static void _FQexecBindRowBuffer(XSQLDA *sqlda, char *buffer);
+static void _FQexecInitHeader(FBconn *conn, FBresult *result);
 static void _FQstoreResult(FBresult *result, FBconn *conn, int num_rows);
 static char *_FQlogLevel(short errlevel);
 static void _FQsetResultError(FBconn *conn, FBresult *res);
 static void _FQsetResultNonFatalError(const FBconn *conn, FBresult *res, short errlevel, char *msg);
+static void _FQdefaultNoticeProcessor(void *arg, const char *message);
+static void _FQdefaultLogReceiver(void *arg, short loglevel, const char *message);
+
+typedef struct FQasyncLog FQasyncLog;
+static void _FQasyncLogReceiver(void *arg, short loglevel, const char *message);
+static void *_FQasyncLogThread(void *arg);
+static void _FQasyncLogStop(FBconn *conn);
+static size_t _FQasyncLogMemorySize(const FBconn *conn);
+static void _FQsetResultLibraryError(FBconn *conn, FBresult *res, const char *msg, ...);
 static void _FQsaveMessageField(FBresult **res, FQdiagType code, const char *value, ...);
-static char *_FQdeparseDbKey(const char *db_key);
-static char *_FQparseDbKey(const char *db_key);
 
 static void _FQinitClientEncoding(FBconn *conn);
 static const char *_FQclientEncoding(const FBconn *conn);
 
-static int _FQdspstrlen_line(FQresTupleAtt *att, short encoding_id);
+static void _FQscanDatum(FQresTupleAtt *att, int len, short encoding_id, bool get_dsp_len);
+
+static void *_FQdefaultMalloc(size_t size, void *arg);
+static void *_FQdefaultRealloc(void *ptr, size_t size, void *arg);
+static void _FQdefaultFree(void *ptr, void *arg);
+
+/* used for all allocations other than those of results; see FQsetAllocator() */
+static FQallocator _FQallocator = {
+	_FQdefaultMalloc,
+	_FQdefaultRealloc,
+	_FQdefaultFree,
+	NULL
+};
 
 /* keep this in same order as FQexecStatusType in libfq.h */
 char *const fbresStatus[] = {
@@ -174,23 +254,51 @@ FQconnectdbParams(const char * const *keywords,
 		return NULL;
 
 	/* initialise libfq's connection struct */
-	conn = (FBconn *)malloc(sizeof(FBconn));
+	conn = (FBconn *)_FQmalloc(sizeof(FBconn));
 
 	conn->db = 0L;
+	conn->uname = NULL;
+	conn->upass = NULL;
 	conn->trans = 0L;
 	conn->trans_internal = 0L;
 	conn->autocommit = true;
 	conn->in_user_transaction = false;
-	conn->status = (ISC_STATUS *) malloc(sizeof(ISC_STATUS) * ISC_STATUS_LENGTH);
+	conn->status = (ISC_STATUS *) _FQmalloc(sizeof(ISC_STATUS) * ISC_STATUS_LENGTH);
 	conn->engine_version = NULL;
 	conn->client_min_messages = DEBUG1;
 	conn->client_encoding = NULL;
 	conn->client_encoding_id = -1;	/* indicate the server-parsed value has not yet been retrieved */
 	conn->get_dsp_len = false;
+	conn->fetch_pipeline_rows = 0;
+	conn->trim_char = false;
+	conn->collect_stats = false;
+	memset(&conn->metrics, 0, sizeof(FQconnMetrics));
+	conn->metrics_callback = NULL;
+	conn->metrics_callback_arg = NULL;
+	conn->trace_begin = NULL;
+	conn->trace_end = NULL;
+	conn->trace_arg = NULL;
+	memset(&conn->trace_event, 0, sizeof(FQtraceEvent));
+	conn->trace_stmt_hash = 0;
+	conn->notice_processor = _FQdefaultNoticeProcessor;
+	conn->notice_arg = NULL;
+	conn->log_receiver = _FQdefaultLogReceiver;
+	conn->log_arg = NULL;
+	conn->async_log = NULL;
+	conn->slow_query_usecs = 0;
+	conn->slow_query_redact = false;
+	conn->slow_query_callback = NULL;
+	conn->slow_query_arg = NULL;
 	conn->errMsg = NULL;
+	memset(conn->stmt_pool, 0, sizeof(conn->stmt_pool));
+	conn->stmt_pool_count = 0;
+	conn->allocator = _FQallocator;
+	conn->mem_account = (FQmemAccount *)_FQmalloc(sizeof(FQmemAccount));
+	memset(conn->mem_account, 0, sizeof(FQmemAccount));
+	conn->mem_account->refcount = 1;
 
 	/* Initialise the Firebird parameter buffer */
-	conn->dpb_buffer = (char *) malloc((size_t)256);
+	conn->dpb_buffer = (char *) _FQmalloc((size_t)256);
 
 	dpb = (char *)conn->dpb_buffer;
 
@@ -201,7 +309,7 @@ FQconnectdbParams(const char * const *keywords,
 
 	/* store database path */
 	db_path_len = strlen(db_path);
-	conn->db_path = malloc(db_path_len + 1);
+	conn->db_path = _FQmalloc(db_path_len + 1);
 	strncpy(conn->db_path, db_path, db_path_len);
 	conn->db_path[db_path_len] = '\0';
 
@@ -212,7 +320,7 @@ FQconnectdbParams(const char * const *keywords,
 
 		isc_modify_dpb(&dpb, &conn->dpb_length, isc_dpb_user_name, uname, uname_len);
 
-		conn->uname = malloc(uname_len + 1);
+		conn->uname = _FQmalloc(uname_len + 1);
 		strncpy(conn->uname, uname, uname_len);
 		conn->uname[uname_len] = '\0';
 	}
@@ -223,7 +331,7 @@ FQconnectdbParams(const char * const *keywords,
 
 		isc_modify_dpb(&dpb, &conn->dpb_length, isc_dpb_password, upass, upass_len);
 
-		conn->upass = malloc(upass_len + 1);
+		conn->upass = _FQmalloc(upass_len + 1);
 		strncpy(conn->upass, upass, upass_len);
 		conn->upass[upass_len] = '\0';
 	}
@@ -238,14 +346,14 @@ FQconnectdbParams(const char * const *keywords,
 	isc_modify_dpb(&dpb, &conn->dpb_length, isc_dpb_lc_ctype, client_encoding, strlen(client_encoding));
 
 	/* actually attach to the database */
-	isc_attach_database(
+	FB_TRACE(conn, "isc_attach_database", isc_attach_database(
 		conn->status,
 		0,
 		db_path,
 		&conn->db,
 		conn->dpb_length,
 		dpb
-	);
+	));
 
 	if (conn->status[0] == 1 && conn->status[1])
 	{
@@ -279,10 +387,10 @@ FQconnectdbParams(const char * const *keywords,
 
 		if (conn->errMsg != NULL)
 		{
-			free(conn->errMsg);
+			_FQfree(conn->errMsg);
 		}
 
-		conn->errMsg = (char *)malloc(msg_len + 1);
+		conn->errMsg = (char *)_FQmalloc(msg_len + 1);
 		memset(conn->errMsg, '\0', msg_len + 1);
 		strncpy(conn->errMsg, buf.data, msg_len);
 
@@ -364,37 +472,50 @@ FQfinish(FBconn *conn)
 	if (conn == NULL)
 		return;
 
+	_FQtraceStatement(conn, NULL);
+
 	if (conn->trans != 0L)
 		FQrollbackTransaction(conn);
 
+	while (conn->stmt_pool_count > 0)
+	{
+		conn->stmt_pool_count--;
+		FB_TRACE(conn, "isc_dsql_free_statement", isc_dsql_free_statement(conn->status, &conn->stmt_pool[conn->stmt_pool_count], DSQL_drop));
+	}
+
 	if (conn->db != 0L)
-		isc_detach_database(conn->status, &conn->db);
+		FB_TRACE(conn, "isc_detach_database", isc_detach_database(conn->status, &conn->db));
+
+	_FQasyncLogStop(conn);
 
 	if (conn->status != NULL)
-		free(conn->status);
+		_FQfree(conn->status);
 
 	if (conn->dpb_buffer != NULL)
-		free(conn->dpb_buffer);
+		_FQfree(conn->dpb_buffer);
 
 	if (conn->engine_version != NULL)
-		free(conn->engine_version);
+		_FQfree(conn->engine_version);
 
 	if (conn->db_path != NULL)
-		free(conn->db_path);
+		_FQfree(conn->db_path);
 
 	if (conn->uname != NULL)
-		free(conn->uname);
+		_FQfree(conn->uname);
 
 	if (conn->upass != NULL)
-		free(conn->upass);
+		_FQfree(conn->upass);
 
 	if (conn->client_encoding != NULL)
-		free(conn->client_encoding);
+		_FQfree(conn->client_encoding);
 
 	if (conn->errMsg != NULL)
-		free(conn->errMsg);
+		_FQfree(conn->errMsg);
 
-	free(conn);
+	/* the account is freed once any results still held are cleared */
+	_FQmemAccountRelease(conn->mem_account);
+
+	_FQfree(conn);
 }
 
 
@@ -426,15 +547,17 @@ FQstatus(FBconn *conn)
 	if (conn == NULL || conn->db == 0L)
 		return CONNECTION_BAD;
 
+	_FQtraceStatement(conn, NULL);
+
 	/* (mis)use isc_database_info() to see if the connection is still active */
 
-	isc_database_info(
+	FB_TRACE(conn, "isc_database_info", isc_database_info(
 		conn->status,
 		&conn->db,
 		sizeof(db_items),
 		db_items,
 		sizeof(res_buffer),
-		res_buffer);
+		res_buffer));
 
 	if (conn->status[0] == 1 && conn->status[1])
 	{
@@ -548,7 +671,7 @@ _FQserverVersionInit(FBconn *conn)
 			char buf[10] = "";
 			int engine_version_len = sizeof(FQgetvalue(res, 0, 0));
 
-			conn->engine_version = malloc(engine_version_len + 1);
+			conn->engine_version = _FQmalloc(engine_version_len + 1);
 			strncpy(conn->engine_version, FQgetvalue(res, 0, 0), engine_version_len);
 			conn->engine_version[engine_version_len] = '\0';
 
@@ -564,7 +687,7 @@ _FQserverVersionInit(FBconn *conn)
 		}
 		else
 		{
-			conn->engine_version = malloc(1);
+			conn->engine_version = _FQmalloc(1);
 			conn->engine_version[0] = '\0';
 			conn->engine_version_number = -1;
 		}
@@ -624,9 +747,9 @@ _FQinitClientEncoding(FBconn *conn)
 		int client_encoding_len = strlen(FQgetvalue(res, 0, 0));
 
 		if (conn->client_encoding != NULL)
-			free(conn->client_encoding);
+			_FQfree(conn->client_encoding);
 
-		conn->client_encoding =	malloc(client_encoding_len + 1);
+		conn->client_encoding =	_FQmalloc(client_encoding_len + 1);
 		memset(conn->client_encoding, '\0', client_encoding_len + 1);
 		strncpy(conn->client_encoding, FQgetvalue(res, 0, 0), client_encoding_len);
 		conn->client_encoding[client_encoding_len] = '\0';
@@ -678,1587 +801,5108 @@ FQsetGetdsplen(FBconn *conn, bool get_dsp_len)
 
 
 /**
- * _FQinitResult()
+ * FQsetFetchPipeline()
  *
- * Initialise an FBresult object with sensible defaults and
- * preallocate in/out SQLDAs.
+ * Set the number of rows which may be fetched ahead by a background
+ * thread while previously fetched rows are being formatted; this can
+ * improve throughput for large result sets, particularly over
+ * high-latency connections. 0 (the default) disables pipelining.
  */
-static FBresult *
-_FQinitResult(bool init_sqlda_in)
+void
+FQsetFetchPipeline(FBconn *conn, int rows)
 {
-	FBresult *result;
-
-	result = malloc(sizeof(FBresult));
+	if (conn != NULL)
+		conn->fetch_pipeline_rows = rows > 0 ? rows : 0;
+}
 
-	if (init_sqlda_in == true)
-	{
-		result->sqlda_in = (XSQLDA *) malloc(XSQLDA_LENGTH(FB_XSQLDA_INITLEN));
-		memset(result->sqlda_in, '\0', XSQLDA_LENGTH(FB_XSQLDA_INITLEN));
-		result->sqlda_in->sqln = FB_XSQLDA_INITLEN;
-		result->sqlda_in->version = SQLDA_VERSION1;
-	}
-	else
-	{
-		result->sqlda_in = NULL;
-	}
 
-	result->sqlda_out = (XSQLDA *) malloc(XSQLDA_LENGTH(FB_XSQLDA_INITLEN));
-	memset(result->sqlda_out, '\0', XSQLDA_LENGTH(FB_XSQLDA_INITLEN));
-	result->sqlda_out->sqln = FB_XSQLDA_INITLEN;
-	result->sqlda_out->version = SQLDA_VERSION1;
+/**
+ * FQsetTrimChar()
+ *
+ * Determine whether trailing pad spaces are removed from CHAR values
+ * when they are stored in a result. This reduces the memory used by
+ * results containing wide CHAR columns. The setting applies to all
+ * queries subsequently executed on the connection, and is off by default.
+ */
+void
+FQsetTrimChar(FBconn *conn, bool trim_char)
+{
+	if (conn != NULL)
+		conn->trim_char = trim_char;
+}
 
-	result->stmt_handle = 0L;
-	result->ntups = -1;
-	result->ncols = -1;
-	result->resultStatus = FBRES_NO_ACTION;
-	result->errMsg = NULL;
-	result->errFields = NULL;
-	result->fbSQLCODE = -1L;
-	result->errLine = -1;
-	result->errCol = -1;
 
-	return result;
+/**
+ * FQsetResultStats()
+ *
+ * Determine whether timings and counters are collected for each phase
+ * of query execution, for retrieval with FQresultStats(). This is off
+ * by default; when disabled, the only overhead is a NULL pointer check
+ * at each point where statistics would be recorded.
+ */
+void
+FQsetResultStats(FBconn *conn, bool collect_stats)
+{
+	if (conn != NULL)
+		conn->collect_stats = collect_stats;
 }
 
 
 /**
- * _FQexecClearResult()
+ * _FQstatsInit()
  *
- * Free a result object's temporary memory allocations assigned
- * during query execution
+ * Allocate the statistics of a result about to be executed, if the
+ * connection collects them or has a metrics or slow query callback.
  */
 static void
-_FQexecClearResult(FBresult *result)
+_FQstatsInit(const FBconn *conn, FBresult *result)
 {
-	if (result->sqlda_in != NULL)
-	{
-		_FQexecClearSQLDA(result, result->sqlda_in);
-		free(result->sqlda_in);
-		result->sqlda_in = NULL;
-	}
-
-	if (result->sqlda_out != NULL)
-	{
-		_FQexecClearSQLDA(result, result->sqlda_out);
+	if (conn->collect_stats == false && conn->metrics_callback == NULL && conn->slow_query_callback == NULL)
+		return;
 
-		free(result->sqlda_out);
-		result->sqlda_out = NULL;
-	}
+	result->stats = (FQresStats *)_FQresultMalloc(result, sizeof(FQresStats));
+	memset(result->stats, 0, sizeof(FQresStats));
+	result->stats_start = _FQstatsClock(result);
 }
 
 
 /**
- * _FQexecClearSQLDA()
+ * _FQstatsClock()
  *
+ * Return the monotonic clock time in microseconds if statistics are
+ * being collected for the result, otherwise 0.
+ */
+static int64_t
+_FQstatsClock(const FBresult *result)
+{
+	if (result->stats == NULL)
+		return 0;
+
+	return _FQclockUsecs();
+}
+
+
+/**
+ * _FQclockUsecs()
  *
+ * Return the monotonic clock time in microseconds.
  */
-static
-void _FQexecClearSQLDA(FBresult *result, XSQLDA *sqlda)
+static int64_t
+_FQclockUsecs(void)
 {
-	XSQLVAR *var;
-	short	 i;
+	struct timespec ts;
 
-	for (i = 0, var = result->sqlda_out->sqlvar; i < result->ncols; var++, i++)
-	{
-		if (var->sqldata != NULL)
-		{
-			free(var->sqldata);
-			var->sqldata = NULL;
-		}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-		if (var->sqltype & 1 && var->sqlind != NULL)
-		{
-			/* deallocate NULL status indicator if necessary */
-			free(var->sqlind);
-			var->sqlind = NULL;
-		}
-	}
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
 
 /**
- * _FQexecInitOutputSQLDA()
+ * FQconnStats()
  *
- * Initialise an output SQLDA to hold a retrieved row
+ * Return the cumulative metrics recorded for the connection. The
+ * returned pointer is valid until the connection is closed with
+ * FQfinish().
+ */
+const FQconnMetrics *
+FQconnStats(const FBconn *conn)
+{
+	if (conn == NULL)
+		return NULL;
+
+	return &conn->metrics;
+}
+
+
+/**
+ * FQsetMetricsCallback()
+ *
+ * Register a function to be called after each statement executed with
+ * FQexec(), FQexecParams() or FQexecImmediate() has completed, with the
+ * statement's result (from which FQresultStats() is always available)
+ * and "arg". The result must not be freed by the callback. NULL removes
+ * the callback.
+ */
+void
+FQsetMetricsCallback(FBconn *conn, FQmetricsCallback callback, void *arg)
+{
+	if (conn == NULL)
+		return;
+
+	conn->metrics_callback = callback;
+	conn->metrics_callback_arg = arg;
+}
+
+
+/**
+ * FQsetTraceCallbacks()
  *
- * This initialises a storage location for each column and additionally
- * a flag to indicate NULL status if required.
+ * Register functions to be called before and after each call libfq makes
+ * to the Firebird client library on this connection, e.g. to emit
+ * tracing spans or USDT probes. Either callback may be NULL; setting
+ * both to NULL disables tracing, which then costs a single check per
+ * call.
+ */
+void
+FQsetTraceCallbacks(FBconn *conn, FQtraceCallback begin, FQtraceCallback end, void *arg)
+{
+	if (conn == NULL)
+		return;
+
+	conn->trace_begin = begin;
+	conn->trace_end = end;
+	conn->trace_arg = arg;
+}
+
+
+/**
+ * _FQtraceStatement()
  *
- * It might be slightly more efficient to calculate the total size of
- * required storage and allocate a single buffer, pointing each SQLVAR
- * and NULL status indicator to a location in that buffer, but that is
- * somewhat tricky to get right.
+ * Set the statement reported to the tracing callbacks for subsequent
+ * calls, identified by a 32-bit FNV-1a hash of its text; NULL
+ * indicates calls which are not associated with a statement. The hash
+ * is only calculated if tracing is enabled.
  */
 static void
-_FQexecInitOutputSQLDA(FBconn *conn, FBresult *result)
+_FQtraceStatement(FBconn *conn, const char *stmt)
 {
-	XSQLVAR *var;
-	short	 sqltype, i;
-	char	 error_message[1024];
+	uint32_t hash = 2166136261u;
+	const unsigned char *ptr;
 
-	for (i = 0, var = result->sqlda_out->sqlvar; i < result->ncols; var++, i++)
+	if (stmt == NULL || (conn->trace_begin == NULL && conn->trace_end == NULL))
 	{
-		sqltype = (var->sqltype & ~1); /* drop flag bit for now */
-		switch(sqltype)
-		{
-			case SQL_VARYING:
-				var->sqldata = (char *)malloc(sizeof(char)*var->sqllen + 2);
-				break;
-			case SQL_TEXT:
-				var->sqldata = (char *)malloc(sizeof(char)*var->sqllen);
-				break;
-
-			case SQL_SHORT:
-				var->sqldata = (char *)malloc(sizeof(ISC_SHORT));
-				break;
-			case SQL_LONG:
-				var->sqldata = (char *)malloc(sizeof(ISC_LONG));
-				break;
-			case SQL_INT64:
-				var->sqldata = (char *)malloc(sizeof(ISC_INT64));
-				break;
+		conn->trace_stmt_hash = 0;
+		return;
+	}
 
-			case SQL_FLOAT:
-				var->sqldata = (char *)malloc(sizeof(float));
-				break;
-			case SQL_DOUBLE:
-				var->sqldata = (char *)malloc(sizeof(double));
-				break;
+	for (ptr = (const unsigned char *)stmt; *ptr != '\0'; ptr++)
+	{
+		hash ^= *ptr;
+		hash *= 16777619u;
+	}
 
-			case SQL_TIMESTAMP:
-				var->sqldata = (char *)malloc(sizeof(ISC_TIMESTAMP));
-				break;
-			case SQL_TYPE_DATE:
-				var->sqldata = (char *)malloc(sizeof(ISC_DATE));
-				break;
-			case SQL_TYPE_TIME:
-				var->sqldata = (char *)malloc(sizeof(ISC_TIME));
-				break;
+	conn->trace_stmt_hash = hash;
+}
 
-			case SQL_BLOB:
-				var->sqldata = (char *)malloc(sizeof(ISC_QUAD));
-				break;
 
-#if defined SQL_BOOLEAN
-			/* Firebird 3.0 and later */
-			case SQL_BOOLEAN:
-				var->sqldata = (char *)malloc(sizeof(FB_BOOLEAN));
-				break;
-#endif
+/**
+ * _FQtraceBegin()
+ *
+ * Start tracing a call to the Firebird client library; see FB_TRACE().
+ */
+static void
+_FQtraceBegin(FBconn *conn, const char *operation)
+{
+	FQtraceEvent *event = &conn->trace_event;
 
-			default:
-				sprintf(error_message, "Unhandled sqlda_out type: %i", sqltype);
+	event->operation = operation;
+	event->stmt_hash = conn->trace_stmt_hash;
+	event->duration_usecs = 0;
+	event->status = 0;
+	event->span = NULL;
+	event->start_usecs = _FQclockUsecs();
 
-				_FQsetResultError(conn, result);
-				_FQsaveMessageField(&result, FB_DIAG_DEBUG, error_message);
+	if (conn->trace_begin != NULL)
+		conn->trace_begin(conn, event, conn->trace_arg);
+}
 
-				result->resultStatus = FBRES_FATAL_ERROR;
 
-				_FQexecClearResult(result);
+/**
+ * _FQtraceEnd()
+ *
+ * Finish tracing a call to the Firebird client library, returning
+ * the call's return value.
+ */
+static ISC_STATUS
+_FQtraceEnd(FBconn *conn, ISC_STATUS status)
+{
+	FQtraceEvent *event = &conn->trace_event;
 
-				return;
+	event->duration_usecs = _FQclockUsecs() - event->start_usecs;
+	event->status = status;
 
-		}
-		if (var->sqltype & 1)
-		{
-			/* allocate variable to hold NULL status */
-			var->sqlind = (short *)malloc(sizeof(short));
-		}
-	}
+	if (conn->trace_end != NULL)
+		conn->trace_end(conn, event, conn->trace_arg);
 
+	return status;
 }
 
 
 /**
- * _FQexecParseStatementType()
+ * _FQmetricsCountStatement()
  *
- * info_buffer contains a isc_info_sql_stmt_type in the first byte,
- * two bytes of length, and a statement_type token.
+ * Count a statement of the given isc_info_sql_stmt_* type.
  */
-static ISC_LONG
-_FQexecParseStatementType(char *info_buffer)
+static void
+_FQmetricsCountStatement(FBconn *conn, FBresult *result, int statement_type)
 {
-	short l = (short) isc_vax_integer((char *) info_buffer + 1, 2);
-	return isc_vax_integer((char *) info_buffer + 3, l);
+	if (statement_type < 0 || statement_type >= FB_METRICS_STMT_TYPES)
+		statement_type = 0;
+
+	conn->metrics.statements[statement_type]++;
+
+	if (result->stats != NULL)
+		result->stats->statement_type = statement_type;
 }
 
 
 /**
- * _FQexecFillTuplesArray()
+ * _FQmetricsCountError()
  *
- * Create an array of tuple pointers to provide fast offset-based
- * access to individual tuples.
+ * Count an error reported by the server. The first FB_METRICS_SQLCODES
+ * distinct SQLCODEs are counted individually.
  */
 static void
-_FQexecFillTuplesArray(FBresult *result)
+_FQmetricsCountError(FBconn *conn, long sqlcode)
 {
-	FQresTuple	  *tuple_ptr;
 	int i;
 
-	result->tuples = malloc(sizeof(FQresTuple *) * result->ntups);
-	tuple_ptr = result->tuple_first;
-	for (i = 0; i < result->ntups; i++)
+	conn->metrics.errors++;
+
+	for (i = 0; i < FB_METRICS_SQLCODES; i++)
 	{
-		result->tuples[i] = tuple_ptr;
-		tuple_ptr = tuple_ptr->next;
+		if (conn->metrics.error_sqlcodes[i].count == 0)
+			conn->metrics.error_sqlcodes[i].sqlcode = sqlcode;
+
+		if (conn->metrics.error_sqlcodes[i].sqlcode == sqlcode)
+		{
+			conn->metrics.error_sqlcodes[i].count++;
+			return;
+		}
 	}
 }
 
 
 /**
- * FQexec()
+ * _FQmetricsRecord()
  *
- * Execute the query specified in 'stmt'. Note that only one query
- * can be provided.
- *
- * Returns NULL when no server connection available.
+ * Add the timings of a completed statement to the connection's metrics,
+ * and pass its result to the metrics callback.
+ */
+static void
+_FQmetricsRecord(FBconn *conn, FBresult *result)
+{
+	FQresStats *stats = result->stats;
+	int64_t fbclient_usecs = stats->prepare_usecs + stats->describe_usecs
+		+ stats->execute_usecs + stats->fetch_usecs;
+
+	conn->metrics.fbclient_usecs += fbclient_usecs;
+	conn->metrics.libfq_usecs += stats->total_usecs - fbclient_usecs;
+
+	if (conn->metrics_callback != NULL)
+		conn->metrics_callback(conn, result, conn->metrics_callback_arg);
+}
+
+
+/**
+ * FQsetSlowQueryLog()
  *
- * This function is a wrapper around _FQexec(), and calls it with the
- * connection's default transaction handle.
+ * Register a function to be called with the text, parameters (unless
+ * "redact_params" is set), timings and plan of each statement executed
+ * with FQexec(), FQexecParams() or FQexecImmediate() which takes at
+ * least "threshold_usecs" microseconds. The plan is retrieved before
+ * the statement handle is released, so the statement need not be
+ * prepared again. NULL removes the callback.
  *
- * To execute parameterized queries, use FQexecParams().
+ * While a callback is set, FQexec() prepares INSERT, UPDATE and DELETE
+ * statements rather than executing them immediately, so that their
+ * plans are available; the plan is NULL for DDL and for statements
+ * executed with FQexecImmediate().
  */
-FBresult *
-FQexec(FBconn *conn, const char *stmt)
+void
+FQsetSlowQueryLog(FBconn *conn, int64_t threshold_usecs, bool redact_params, FQslowQueryCallback callback, void *arg)
 {
-	if (!conn)
-	{
-		return NULL;
-	}
+	if (conn == NULL)
+		return;
 
-	return(_FQexec(conn, &conn->trans, stmt));
+	conn->slow_query_usecs = threshold_usecs;
+	conn->slow_query_redact = redact_params;
+	conn->slow_query_callback = callback;
+	conn->slow_query_arg = arg;
 }
 
 
 /**
- * _FQexec()
+ * _FQslowQueryRecord()
  *
- * Execute the query specified in 'stmt' using the transaction handle
- * pointed to by 'trans'
+ * Report a completed statement to the slow query callback, if it
+ * exceeded the threshold; called while the statement is still prepared.
+ *
+ * A separate status vector is used to retrieve the plan, so any error
+ * information for the statement is not overwritten.
  */
-static FBresult *
-_FQexec(FBconn *conn, isc_tr_handle *trans, const char *stmt)
+static void
+_FQslowQueryRecord(FBconn *conn, FBresult *result)
 {
-	FBresult	  *result;
+	FQslowQuery query;
+	ISC_STATUS status[ISC_STATUS_LENGTH];
+	char *plan = NULL;
 
-	static char	  stmt_info[] = { isc_info_sql_stmt_type };
-	char		  info_buffer[20];
-	int			  statement_type;
+	if (conn->slow_query_callback == NULL || result->exec_stmt == NULL)
+		return;
 
-	int			  num_rows = 0;
-	long		  fetch_stat;
+	if (result->stats->total_usecs < conn->slow_query_usecs)
+		return;
 
-	bool		  temp_trans = false;
+	/* statements executed with isc_dsql_execute_immediate() have no handle */
+	if (result->stmt_handle != 0L)
+		_FQexecGetPlan(conn, status, &result->stmt_handle, &plan);
 
-	result = _FQinitResult(false);
+	query.stmt = result->exec_stmt;
+	query.nparams = result->exec_nparams;
+	query.param_values = conn->slow_query_redact ? NULL : result->exec_param_values;
+	query.param_formats = result->exec_param_formats;
+	query.duration_usecs = result->stats->total_usecs;
+	query.plan = plan;
+	query.result = result;
 
-	/* Allocate a statement. */
-	if (isc_dsql_allocate_statement(conn->status, &conn->db, &result->stmt_handle))
-	{
-		result->resultStatus = FBRES_FATAL_ERROR;
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_allocate_statement");
-		_FQsetResultError(conn, result);
+	conn->slow_query_callback(conn, &query, conn->slow_query_arg);
 
-		_FQexecClearResult(result);
-		return result;
-	}
+	if (plan != NULL)
+		_FQfree(plan);
+}
 
-	/* An active transaction is required to prepare the statement -
-	 * if no transaction handle was provided by the caller,
+
+/**
+ * FQsetMemoryLimit()
+ *
+ * Set the maximum number of bytes the connection's results may hold in
+ * total, as reported by FQconnMemorySize() less the connection's own
+ * allocations. If the limit is exceeded while rows are being fetched,
+ * fetching stops and the query fails with an error rather than
+ * exhausting the memory of the host process. 0 (the default) means no
+ * limit.
+ *
+ * The limit is checked after each row is stored, so may be exceeded
+ * by up to one row.
+ */
+void
+FQsetMemoryLimit(FBconn *conn, size_t limit)
+{
+	if (conn == NULL)
+		return;
+
+	conn->mem_account->limit = limit;
+}
+
+
+/**
+ * FQresultMemorySize()
+ *
+ * Return the number of bytes currently allocated for the result:
+ * its header, tuples, values, error fields and any SQLDAs still held.
+ * Only the result itself is included, not any further results of a
+ * script (see FQnextResult()).
+ */
+size_t
+FQresultMemorySize(const FBresult *res)
+{
+	if (res == NULL)
+		return 0;
+
+	return res->mem_size;
+}
+
+
+/**
+ * FQconnMemorySize()
+ *
+ * Return the number of bytes currently allocated for the connection,
+ * including each of its results which has not yet been freed with
+ * FQclear().
+ */
+size_t
+FQconnMemorySize(const FBconn *conn)
+{
+	size_t size;
+
+	if (conn == NULL)
+		return 0;
+
+	size = sizeof(FBconn)
+		+ sizeof(ISC_STATUS) * ISC_STATUS_LENGTH
+		+ 256	/* DPB, see FQconnectdbParams() */
+		+ sizeof(FQmemAccount)
+		+ _FQasyncLogMemorySize(conn);
+
+	if (conn->db_path != NULL)
+		size += strlen(conn->db_path) + 1;
+
+	if (conn->uname != NULL)
+		size += strlen(conn->uname) + 1;
+
+	if (conn->upass != NULL)
+		size += strlen(conn->upass) + 1;
+
+	if (conn->engine_version != NULL)
+		size += strlen(conn->engine_version) + 1;
+
+	if (conn->client_encoding != NULL)
+		size += strlen(conn->client_encoding) + 1;
+
+	if (conn->errMsg != NULL)
+		size += strlen(conn->errMsg) + 1;
+
+	return size + conn->mem_account->size;
+}
+
+
+/**
+ * FQsetAllocator()
+ *
+ * Set the functions used for all memory allocated by libfq, other than
+ * that of results belonging to a connection with its own allocator (see
+ * FQsetConnAllocator()). NULL restores malloc(), realloc() and free().
+ *
+ * This should be called before any other libfq function, as memory must
+ * be freed with the allocator it was allocated with; new connections
+ * also use it for their results.
+ */
+void
+FQsetAllocator(const FQallocator *allocator)
+{
+	if (allocator == NULL
+	 || allocator->malloc_func == NULL
+	 || allocator->realloc_func == NULL
+	 || allocator->free_func == NULL)
+	{
+		_FQallocator.malloc_func = _FQdefaultMalloc;
+		_FQallocator.realloc_func = _FQdefaultRealloc;
+		_FQallocator.free_func = _FQdefaultFree;
+		_FQallocator.arg = NULL;
+		return;
+	}
+
+	_FQallocator = *allocator;
+}
+
+
+/**
+ * FQsetConnAllocator()
+ *
+ * Set the functions used to allocate the results of queries subsequently
+ * executed on the connection, e.g. so they can be placed in a memory
+ * context of the host application. NULL reverts to the allocator set with
+ * FQsetAllocator().
+ *
+ * Each result keeps a copy of the allocator it was created with, which
+ * FQclear() uses to free it.
+ */
+void
+FQsetConnAllocator(FBconn *conn, const FQallocator *allocator)
+{
+	if (conn == NULL)
+		return;
+
+	if (allocator == NULL
+	 || allocator->malloc_func == NULL
+	 || allocator->realloc_func == NULL
+	 || allocator->free_func == NULL)
+	{
+		conn->allocator = _FQallocator;
+		return;
+	}
+
+	conn->allocator = *allocator;
+}
+
+
+/**
+ * FQfreemem()
+ *
+ * Free memory returned by libfq to the caller, such as the string
+ * returned by FQexplainStatement(), with the allocator set by
+ * FQsetAllocator().
+ */
+void
+FQfreemem(void *ptr)
+{
+	_FQfree(ptr);
+}
+
+
+/**
+ * _FQmalloc()
+ *
+ * Allocate memory with the allocator set by FQsetAllocator().
+ */
+void *
+_FQmalloc(size_t size)
+{
+	return _FQallocator.malloc_func(size, _FQallocator.arg);
+}
+
+
+/**
+ * _FQrealloc()
+ *
+ * Reallocate memory allocated with _FQmalloc().
+ */
+void *
+_FQrealloc(void *ptr, size_t size)
+{
+	return _FQallocator.realloc_func(ptr, size, _FQallocator.arg);
+}
+
+
+/**
+ * _FQfree()
+ *
+ * Free memory allocated with _FQmalloc(); NULL is ignored.
+ */
+void
+_FQfree(void *ptr)
+{
+	if (ptr != NULL)
+		_FQallocator.free_func(ptr, _FQallocator.arg);
+}
+
+
+/**
+ * _FQstrdup()
+ *
+ * Copy a string into memory allocated with _FQmalloc().
+ */
+char *
+_FQstrdup(const char *str)
+{
+	size_t len = strlen(str);
+	char *copy = (char *)_FQmalloc(len + 1);
+
+	memcpy(copy, str, len + 1);
+
+	return copy;
+}
+
+
+/**
+ * _FQdefaultMalloc(), _FQdefaultRealloc(), _FQdefaultFree()
+ *
+ * The default allocator, using the C library's functions.
+ */
+static void *
+_FQdefaultMalloc(size_t size, void *arg)
+{
+	return malloc(size);
+}
+
+
+static void *
+_FQdefaultRealloc(void *ptr, size_t size, void *arg)
+{
+	return realloc(ptr, size);
+}
+
+
+static void
+_FQdefaultFree(void *ptr, void *arg)
+{
+	free(ptr);
+}
+
+
+/**
+ * _FQinitResult()
+ *
+ * Initialise an FBresult object with sensible defaults and
+ * preallocate in/out SQLDAs. If "conn" is provided, the result's
+ * memory is included in the connection's (see FQconnMemorySize()) and
+ * allocated with the connection's allocator (see FQsetConnAllocator()).
+ */
+FBresult *
+_FQinitResult(const FBconn *conn, bool init_sqlda_in)
+{
+	const FQallocator *allocator = &_FQallocator;
+	FBresult *result;
+
+	if (conn != NULL && conn->allocator.malloc_func != NULL)
+		allocator = &conn->allocator;
+
+	result = allocator->malloc_func(sizeof(FBresult), allocator->arg);
+	result->allocator = *allocator;
+
+	result->mem_size = sizeof(FBresult);
+	result->mem_account = NULL;
+
+	if (conn != NULL && conn->mem_account != NULL)
+	{
+		result->mem_account = conn->mem_account;
+		result->mem_account->size += result->mem_size;
+		result->mem_account->refcount++;
+	}
+
+	result->sqlda_in = NULL;
+	result->sqlda_out = NULL;
+
+	if (init_sqlda_in == true)
+		_FQresultAllocSQLDA(result, &result->sqlda_in, FB_XSQLDA_INITLEN);
+
+	_FQresultAllocSQLDA(result, &result->sqlda_out, FB_XSQLDA_INITLEN);
+
+	result->sqlda_out_buffer = NULL;
+	result->header = NULL;
+	result->tuples = NULL;
+	result->tuple_first = NULL;
+	result->tuple_last = NULL;
+	result->value_blocks = NULL;
+	result->stats = NULL;
+	result->exec_stmt = NULL;
+	result->exec_nparams = 0;
+	result->exec_param_values = NULL;
+	result->exec_param_formats = NULL;
+	result->stmt_handle = 0L;
+	result->ntups = -1;
+	result->ncols = -1;
+	result->resultStatus = FBRES_NO_ACTION;
+	result->errMsg = NULL;
+	result->errFields = NULL;
+	result->fbSQLCODE = -1L;
+	result->errLine = -1;
+	result->errCol = -1;
+	result->next = NULL;
+
+	return result;
+}
+
+
+/**
+ * _FQexecClearResult()
+ *
+ * Free a result object's temporary memory allocations assigned
+ * during query execution, and release its statement handle
+ */
+static void
+_FQexecClearResult(FBconn *conn, FBresult *result)
+{
+	if (result->stats != NULL)
+	{
+		result->stats->total_usecs = _FQstatsClock(result) - result->stats_start;
+		_FQslowQueryRecord(conn, result);
+		_FQmetricsRecord(conn, result);
+	}
+
+	result->exec_stmt = NULL;
+	result->exec_param_values = NULL;
+	result->exec_param_formats = NULL;
+
+	_FQreleaseStatement(conn, &result->stmt_handle);
+
+	if (result->sqlda_in != NULL)
+	{
+		_FQexecClearSQLDA(result, result->sqlda_in);
+		_FQresultFree(result, result->sqlda_in, XSQLDA_LENGTH(result->sqlda_in->sqln));
+		result->sqlda_in = NULL;
+	}
+
+	if (result->sqlda_out != NULL)
+	{
+		_FQexecClearSQLDA(result, result->sqlda_out);
+
+		_FQresultFree(result, result->sqlda_out, XSQLDA_LENGTH(result->sqlda_out->sqln));
+		result->sqlda_out = NULL;
+	}
+}
+
+
+/**
+ * _FQexecClearSQLDA()
+ *
+ * Free the data and NULL indicator storage of the provided SQLDA.
+ */
+static
+void _FQexecClearSQLDA(FBresult *result, XSQLDA *sqlda)
+{
+	XSQLVAR *var;
+	short	 i;
+
+	/* output SQLDA storage is a single buffer; see _FQexecInitOutputSQLDA() */
+	if (sqlda == result->sqlda_out)
+	{
+		if (result->sqlda_out_buffer != NULL)
+		{
+			_FQresultFree(result, result->sqlda_out_buffer, _FQexecRowBufferSize(sqlda));
+			result->sqlda_out_buffer = NULL;
+		}
+
+		for (i = 0, var = sqlda->sqlvar; i < result->ncols; var++, i++)
+		{
+			var->sqldata = NULL;
+			var->sqlind = NULL;
+		}
+
+		return;
+	}
+
+	for (i = 0, var = sqlda->sqlvar; i < sqlda->sqld && i < sqlda->sqln; var++, i++)
+	{
+		if (var->sqldata != NULL)
+		{
+			_FQfree(var->sqldata);
+			var->sqldata = NULL;
+		}
+
+		if (var->sqlind != NULL)
+		{
+			/* deallocate NULL status indicator if necessary */
+			_FQfree(var->sqlind);
+			var->sqlind = NULL;
+		}
+	}
+}
+
+
+/**
+ * _FQallocStatement()
+ *
+ * Provide a statement handle, reusing one from the connection's pool of
+ * released handles if available, which saves a server round trip.
+ *
+ * Returns non-zero on error, like the isc_* functions.
+ */
+static ISC_STATUS
+_FQallocStatement(FBconn *conn, isc_stmt_handle *stmt_handle)
+{
+	if (conn->stmt_pool_count > 0)
+	{
+		conn->stmt_pool_count--;
+		*stmt_handle = conn->stmt_pool[conn->stmt_pool_count];
+		conn->stmt_pool[conn->stmt_pool_count] = 0L;
+
+		return 0;
+	}
+
+	return FB_TRACE(conn, "isc_dsql_alloc_statement2", isc_dsql_alloc_statement2(conn->status, &conn->db, stmt_handle));
+}
+
+
+/**
+ * _FQreleaseStatement()
+ *
+ * Return a statement handle to the connection's pool, unpreparing it (which
+ * also closes any open cursor) so it can be prepared again; if the pool is
+ * full, the handle is dropped.
+ *
+ * A separate status vector is used so any error information for the
+ * statement which has just been executed is not overwritten.
+ */
+static void
+_FQreleaseStatement(FBconn *conn, isc_stmt_handle *stmt_handle)
+{
+	ISC_STATUS status[ISC_STATUS_LENGTH];
+
+	if (*stmt_handle == 0L)
+		return;
+
+	if (conn->stmt_pool_count < FB_STMT_POOL_SIZE)
+	{
+#if defined DSQL_unprepare
+		/* Firebird 2.5 and later */
+		FB_TRACE(conn, "isc_dsql_free_statement", isc_dsql_free_statement(status, stmt_handle, DSQL_unprepare));
+#else
+		/* an error here just means no cursor was open */
+		FB_TRACE(conn, "isc_dsql_free_statement", isc_dsql_free_statement(status, stmt_handle, DSQL_close));
+#endif
+		conn->stmt_pool[conn->stmt_pool_count++] = *stmt_handle;
+	}
+	else
+	{
+		FB_TRACE(conn, "isc_dsql_free_statement", isc_dsql_free_statement(status, stmt_handle, DSQL_drop));
+	}
+
+	*stmt_handle = 0L;
+}
+
+
+/**
+ * _FQexecInitOutputSQLDA()
+ *
+ * Initialise an output SQLDA to hold a retrieved row
+ *
+ * This allocates a single buffer holding storage for each column and the
+ * NULL status indicators, laid out by _FQexecBindRowBuffer(), and points
+ * each SQLVAR at its location in that buffer.
+ */
+static void
+_FQexecInitOutputSQLDA(FBconn *conn, FBresult *result)
+{
+	XSQLVAR *var;
+	short	 sqltype, i;
+	char	 error_message[1024];
+
+	for (i = 0, var = result->sqlda_out->sqlvar; i < result->ncols; var++, i++)
+	{
+		sqltype = (var->sqltype & ~1); /* drop flag bit for now */
+		switch(sqltype)
+		{
+			case SQL_VARYING:
+			case SQL_TEXT:
+			case SQL_SHORT:
+			case SQL_LONG:
+			case SQL_INT64:
+			case SQL_FLOAT:
+			case SQL_DOUBLE:
+			case SQL_TIMESTAMP:
+			case SQL_TYPE_DATE:
+			case SQL_TYPE_TIME:
+			case SQL_BLOB:
+#if defined SQL_BOOLEAN
+			/* Firebird 3.0 and later */
+			case SQL_BOOLEAN:
+#endif
+				break;
+
+			default:
+				sprintf(error_message, "Unhandled sqlda_out type: %i", sqltype);
+
+				_FQsetResultError(conn, result);
+				_FQsaveMessageField(&result, FB_DIAG_DEBUG, error_message);
+
+				result->resultStatus = FBRES_FATAL_ERROR;
+
+				_FQexecClearResult(conn, result);
+
+				return;
+		}
+	}
+
+	result->sqlda_out_buffer = (char *)_FQresultMalloc(result, _FQexecRowBufferSize(result->sqlda_out));
+	_FQexecBindRowBuffer(result->sqlda_out, result->sqlda_out_buffer);
+}
+
+
+/**
+ * _FQexecParseStatementType()
+ *
+ * info_buffer contains a isc_info_sql_stmt_type in the first byte,
+ * two bytes of length, and a statement_type token.
+ */
+static ISC_LONG
+_FQexecParseStatementType(char *info_buffer)
+{
+	short l = (short) isc_vax_integer((char *) info_buffer + 1, 2);
+	return isc_vax_integer((char *) info_buffer + 3, l);
+}
+
+
+/**
+ * _FQexecGuessStatementType()
+ *
+ * Classify a statement from its leading keyword without a server
+ * round trip. Only statements which are certain not to return rows
+ * are recognised: DDL, and INSERT/UPDATE/DELETE without a RETURNING
+ * clause.
+ *
+ * Returns the corresponding isc_info_sql_stmt_* value, or -1 if the
+ * statement must be prepared to determine its type.
+ */
+static int
+_FQexecGuessStatementType(const char *stmt)
+{
+	static const char *ddl_keywords[] = {
+		"ALTER", "COMMENT", "CREATE", "DECLARE", "DROP", "GRANT", "RECREATE", "REVOKE", NULL
+	};
+	const char *ptr = stmt;
+	const char *keyword;
+	int keyword_len;
+	int statement_type;
+	int i;
+
+	if (stmt == NULL)
+		return -1;
+
+	/* skip leading whitespace and comments */
+	for (;;)
+	{
+		while (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')
+			ptr++;
+
+		if (ptr[0] == '-' && ptr[1] == '-')
+		{
+			while (*ptr && *ptr != '\n')
+				ptr++;
+		}
+		else if (ptr[0] == '/' && ptr[1] == '*')
+		{
+			ptr = strstr(ptr + 2, "*/");
+			if (ptr == NULL)
+				return -1;
+			ptr += 2;
+		}
+		else
+			break;
+	}
+
+	keyword = ptr;
+	while ((*ptr >= 'A' && *ptr <= 'Z') || (*ptr >= 'a' && *ptr <= 'z'))
+		ptr++;
+	keyword_len = ptr - keyword;
+
+	for (i = 0; ddl_keywords[i] != NULL; i++)
+	{
+		if (keyword_len == strlen(ddl_keywords[i])
+		 && strncasecmp(keyword, ddl_keywords[i], keyword_len) == 0)
+			return isc_info_sql_stmt_ddl;
+	}
+
+	if (keyword_len == 6 && strncasecmp(keyword, "INSERT", 6) == 0)
+		statement_type = isc_info_sql_stmt_insert;
+	else if (keyword_len == 6 && strncasecmp(keyword, "UPDATE", 6) == 0)
+		statement_type = isc_info_sql_stmt_update;
+	else if (keyword_len == 6 && strncasecmp(keyword, "DELETE", 6) == 0)
+		statement_type = isc_info_sql_stmt_delete;
+	else
+		return -1;
+
+	/*
+	 * DML returns rows only with a RETURNING clause; look for the keyword
+	 * outside of literals, quoted identifiers and comments.
+	 */
+	while (*ptr)
+	{
+		if (*ptr == '\'' || *ptr == '"')
+		{
+			char quote = *ptr++;
+
+			/* doubled quotes are handled by leaving and re-entering the literal */
+			while (*ptr && *ptr != quote)
+				ptr++;
+			if (*ptr)
+				ptr++;
+		}
+		else if (ptr[0] == '-' && ptr[1] == '-')
+		{
+			while (*ptr && *ptr != '\n')
+				ptr++;
+		}
+		else if (ptr[0] == '/' && ptr[1] == '*')
+		{
+			ptr = strstr(ptr + 2, "*/");
+			if (ptr == NULL)
+				return -1;
+			ptr += 2;
+		}
+		else if ((*ptr >= 'A' && *ptr <= 'Z') || (*ptr >= 'a' && *ptr <= 'z') || *ptr == '_')
+		{
+			keyword = ptr;
+			while ((*ptr >= 'A' && *ptr <= 'Z') || (*ptr >= 'a' && *ptr <= 'z')
+				|| (*ptr >= '0' && *ptr <= '9') || *ptr == '_' || *ptr == '$')
+				ptr++;
+
+			if (ptr - keyword == 9 && strncasecmp(keyword, "RETURNING", 9) == 0)
+				return -1;
+		}
+		else
+			ptr++;
+	}
+
+	return statement_type;
+}
+
+
+/**
+ * _FQexecFillTuplesArray()
+ *
+ * Create an array of tuple pointers to provide fast offset-based
+ * access to individual tuples.
+ */
+static void
+_FQexecFillTuplesArray(FBresult *result)
+{
+	FQresTuple	  *tuple_ptr;
+	int i;
+
+	result->tuples = _FQresultMalloc(result, sizeof(FQresTuple *) * result->ntups);
+	tuple_ptr = result->tuple_first;
+	for (i = 0; i < result->ntups; i++)
+	{
+		result->tuples[i] = tuple_ptr;
+		tuple_ptr = tuple_ptr->next;
+	}
+}
+
+
+/**
+ * _FQexecDiscardTuples()
+ *
+ * Free the header, tuples and values stored while fetching rows into
+ * a result, when fetching cannot be completed.
+ */
+static void
+_FQexecDiscardTuples(FBresult *result)
+{
+	FQresTuple *tuple_ptr = result->tuple_first;
+	int i;
+
+	while (tuple_ptr != NULL)
+	{
+		FQresTuple *tuple_next = tuple_ptr->next;
+
+		for (i = 0; i < result->ncols; i++)
+			_FQresultFree(result, tuple_ptr->values[i], sizeof(FQresTupleAtt));
+
+		_FQresultFree(result, tuple_ptr->values, sizeof(FQresTupleAtt *) * result->ncols);
+		_FQresultFree(result, tuple_ptr, sizeof(FQresTuple));
+
+		tuple_ptr = tuple_next;
+	}
+
+	result->tuple_first = NULL;
+	result->tuple_last = NULL;
+
+	if (result->header != NULL)
+	{
+		for (i = 0; i < result->ncols; i++)
+		{
+			FQresTupleAttDesc *desc = result->header[i];
+
+			_FQresultFree(result, desc->desc, desc->desc_len + 1);
+
+			if (desc->alias != NULL)
+				_FQresultFree(result, desc->alias, desc->alias_len + 1);
+
+			if (desc->relname != NULL)
+				_FQresultFree(result, desc->relname, desc->relname_len + 1);
+
+			_FQresultFree(result, desc, sizeof(FQresTupleAttDesc));
+		}
+
+		_FQresultFree(result, result->header, sizeof(FQresTupleAttDesc *) * result->ncols);
+		result->header = NULL;
+	}
+
+	while (result->value_blocks != NULL)
+	{
+		FQresultBlock *block_next = result->value_blocks->next;
+
+		_FQresultFree(result, result->value_blocks, offsetof(FQresultBlock, data) + result->value_blocks->size);
+		result->value_blocks = block_next;
+	}
+}
+
+
+/**
+ * FQexec()
+ *
+ * Execute the query specified in 'stmt'. Note that only one query
+ * can be provided.
+ *
+ * Returns NULL when no server connection available.
+ *
+ * This function is a wrapper around _FQexec(), and calls it with the
+ * connection's default transaction handle.
+ *
+ * To execute parameterized queries, use FQexecParams().
+ */
+FBresult *
+FQexec(FBconn *conn, const char *stmt)
+{
+	if (!conn)
+	{
+		return NULL;
+	}
+
+	return(_FQexec(conn, &conn->trans, stmt));
+}
+
+
+/**
+ * _FQexec()
+ *
+ * Execute the query specified in 'stmt' using the transaction handle
+ * pointed to by 'trans'
+ */
+static FBresult *
+_FQexec(FBconn *conn, isc_tr_handle *trans, const char *stmt)
+{
+	FBresult	  *result;
+
+	static char	  stmt_info[] = { isc_info_sql_stmt_type };
+	char		  info_buffer[20];
+	int			  statement_type;
+
+	int			  num_rows = 0;
+	long		  fetch_stat;
+	int64_t		  phase_start;
+
+	bool		  temp_trans = false;
+
+	/*
+	 * Statements which are known not to return rows are executed in a
+	 * single round trip, skipping statement allocation, preparation
+	 * and the statement type lookup. While the slow query log is
+	 * enabled, DML is prepared as usual so its plan can be reported.
+	 */
+	statement_type = _FQexecGuessStatementType(stmt);
+
+	if (statement_type == isc_info_sql_stmt_ddl
+	 || (statement_type != -1 && conn->slow_query_callback == NULL))
+		return _FQexecImmediate(conn, trans, stmt, statement_type);
+
+	result = _FQinitResult(conn, false);
+
+	_FQstatsInit(conn, result);
+	_FQtraceStatement(conn, stmt);
+	result->exec_stmt = stmt;
+	phase_start = _FQstatsClock(result);
+
+	/* Allocate a statement. */
+	if (_FQallocStatement(conn, &result->stmt_handle))
+	{
+		result->resultStatus = FBRES_FATAL_ERROR;
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_allocate_statement");
+		_FQsetResultError(conn, result);
+
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+	/* An active transaction is required to prepare the statement -
+	 * if no transaction handle was provided by the caller,
+	 * start a temporary transaction
+	 */
+	if (*trans == 0L)
+	{
+		_FQstartTransaction(conn, trans);
+		temp_trans = true;
+	}
+
+	/* Prepare the statement. */
+	conn->metrics.prepares++;
+
+	if (FB_TRACE(conn, "isc_dsql_prepare", isc_dsql_prepare(conn->status, trans, &result->stmt_handle, 0, stmt, SQL_DIALECT_V6, result->sqlda_out)))
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_prepare");
+
+		_FQsetResultError(conn, result);
+
+		_FQrollbackTransaction(conn, trans);
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		_FQexecClearResult(conn, result);
+
+		return result;
+	}
+
+	/* If a temporary transaction was previously created, roll it back */
+	if (temp_trans == true)
+	{
+		_FQrollbackTransaction(conn, trans);
+		temp_trans = false;
+	}
+
+	/* Determine the statement's type */
+	if (FB_TRACE(conn, "isc_dsql_sql_info", isc_dsql_sql_info(conn->status, &result->stmt_handle, sizeof (stmt_info), stmt_info, sizeof (info_buffer), info_buffer)))
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_sql_info");
+
+		_FQsetResultError(conn, result);
+
+		_FQrollbackTransaction(conn, trans);
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+	statement_type = _FQexecParseStatementType((char *) info_buffer);
+	_FQmetricsCountStatement(conn, result, statement_type);
+
+	FB_STATS_PHASE(result, prepare_usecs, phase_start, 2);
+
+	/* Query will not return rows */
+	if (!result->sqlda_out->sqld)
+	{
+		/* Handle explicit SET TRANSACTION */
+		if (statement_type == isc_info_sql_stmt_start_trans)
+		{
+			if (*trans != 0L)
+			{
+				_FQsetResultNonFatalError(conn, result, WARNING, "Currently in transaction");
+				result->resultStatus = FBRES_EMPTY_QUERY;
+			}
+			else
+			{
+				_FQstartTransaction(conn, trans);
+				conn->in_user_transaction = true;
+				result->resultStatus = FBRES_TRANSACTION_START;
+			}
+
+			_FQexecClearResult(conn, result);
+			return result;
+		}
+
+		/* Handle explicit COMMIT */
+		if (statement_type == isc_info_sql_stmt_commit)
+		{
+			 if (*trans == 0L)
+			{
+				_FQsetResultNonFatalError(conn, result, WARNING, "Not currently in transaction");
+				result->resultStatus = FBRES_EMPTY_QUERY;
+			}
+			else
+			{
+				_FQcommitTransaction(conn, trans);
+				result->resultStatus = FBRES_TRANSACTION_COMMIT;
+			}
+
+			 /* conn->in_user_transaction is only set if an explicit SET TRANSACTION
+			  * command is passed to _FQexec */
+			 if (conn->in_user_transaction == true)
+				 conn->in_user_transaction = false;
+
+			_FQexecClearResult(conn, result);
+			return result;
+		}
+
+		/* Handle explit ROLLBACK */
+		if (statement_type == isc_info_sql_stmt_rollback)
+		{
+			if (*trans == 0L)
+			{
+				_FQsetResultNonFatalError(conn, result, WARNING, "Not currently in transaction");
+				result->resultStatus = FBRES_EMPTY_QUERY;
+			}
+			else
+			{
+				_FQrollbackTransaction(conn, trans);
+				result->resultStatus = FBRES_TRANSACTION_ROLLBACK;
+			}
+
+			/* conn->in_user_transaction is only set if an explicit SET TRANSACTION
+			 * command is passed to _FQexec */
+			if (conn->in_user_transaction == true)
+				conn->in_user_transaction = false;
+			_FQexecClearResult(conn, result);
+			return result;
+		}
+
+		/* Handle DDL statement */
+		if (statement_type == isc_info_sql_stmt_ddl)
+		{
+			FB_LOG(conn, DEBUG1, "statement_type is DDL");
+
+			temp_trans = false;
+			if (*trans == 0L)
+			{
+				_FQstartTransaction(conn, trans);
+				temp_trans = true;
+			}
+
+			phase_start = _FQstatsClock(result);
+
+			if (FB_TRACE(conn, "isc_dsql_execute", isc_dsql_execute(conn->status, trans,  &result->stmt_handle, SQL_DIALECT_V6, NULL)))
+			{
+				_FQrollbackTransaction(conn, trans);
+				_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error executing DDL");
+				_FQsetResultError(conn, result);
+
+				result->resultStatus = FBRES_FATAL_ERROR;
+
+				_FQexecClearResult(conn, result);
+				return result;
+			}
+
+			FB_STATS_PHASE(result, execute_usecs, phase_start, 1);
+
+			if ((conn->autocommit == true && conn->in_user_transaction == false) || temp_trans == true)
+			{
+				_FQcommitTransaction(conn, trans);
+			}
+
+			result->resultStatus = FBRES_COMMAND_OK;
+
+			_FQexecClearResult(conn, result);
+			return result;
+		}
+
+
+		if (*trans == 0L)
+		{
+			_FQstartTransaction(conn, trans);
+
+			if (conn->autocommit == false)
+				conn->in_user_transaction = true;
+		}
+
+		phase_start = _FQstatsClock(result);
+
+		if (FB_TRACE(conn, "isc_dsql_execute", isc_dsql_execute(conn->status, trans,  &result->stmt_handle, SQL_DIALECT_V6, NULL)))
+		{
+			FB_LOG(conn, DEBUG1, "error executing non-SELECT");
+			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error executing non-SELECT");
+			_FQsetResultError(conn, result);
+
+			result->resultStatus = FBRES_FATAL_ERROR;
+			_FQexecClearResult(conn, result);
+			return result;
+		}
+
+		FB_STATS_PHASE(result, execute_usecs, phase_start, 1);
+
+		if (conn->autocommit == true && conn->in_user_transaction == false)
+		{
+			_FQcommitTransaction(conn, trans);
+		}
+
+		result->resultStatus = FBRES_COMMAND_OK;
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+	/* begin transaction, if none set */
+
+	if (*trans == 0L)
+	{
+		_FQstartTransaction(conn, trans);
+
+		if (conn->autocommit == false)
+			conn->in_user_transaction = true;
+	}
+
+	phase_start = _FQstatsClock(result);
+
+	if (FB_TRACE(conn, "isc_dsql_describe", isc_dsql_describe(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out)))
+	{
+		_FQsetResultError(conn, result);
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_describe");
+
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+
+
+	/* Expand sqlda to required number of columns */
+	result->ncols = result->sqlda_out->sqld;
+
+	if (result->sqlda_out->sqln < result->ncols) {
+
+		_FQresultAllocSQLDA(result, &result->sqlda_out, result->ncols);
+
+		FB_STATS_ADD(result, round_trips, 1);
+
+		if (FB_TRACE(conn, "isc_dsql_describe", isc_dsql_describe(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out)))
+		{
+			_FQsetResultError(conn, result);
+			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_describe");
+
+			result->resultStatus = FBRES_FATAL_ERROR;
+
+			_FQexecClearResult(conn, result);
+			return result;
+		}
+
+		result->ncols = result->sqlda_out->sqld;
+	}
+
+	_FQexecInitOutputSQLDA(conn, result);
+
+	FB_STATS_PHASE(result, describe_usecs, phase_start, 1);
+	phase_start = _FQstatsClock(result);
+
+	if (FB_TRACE(conn, "isc_dsql_execute", isc_dsql_execute(conn->status, trans, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out)))
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_execute error");
+
+		result->resultStatus = FBRES_FATAL_ERROR;
+		_FQsetResultError(conn, result);
+
+		/* if autocommit, and no explicit transaction set, rollback */
+		if (conn->autocommit == true && conn->in_user_transaction == false)
+		{
+			_FQrollbackTransaction(conn, trans);
+		}
+
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+	FB_STATS_PHASE(result, execute_usecs, phase_start, 1);
+
+	/* set up tuple holder */
+
+	result->tuple_first = NULL;
+	result->tuple_last = NULL;
+
+	_FQexecInitHeader(conn, result);
+
+	num_rows = _FQexecFetch(conn, result, &fetch_stat);
+
+	if (num_rows < 0)
+	{
+		_FQexecDiscardTuples(result);
+
+		_FQsetResultLibraryError(conn, result, "result memory limit of %zu bytes exceeded", result->mem_account->limit);
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		/* if autocommit, and no explicit transaction set, rollback */
+		if (conn->autocommit == true && conn->in_user_transaction == false)
+		{
+			_FQrollbackTransaction(conn, trans);
+		}
+
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+	result->resultStatus = FBRES_TUPLES_OK;
+	result->ntups = num_rows;
+
+	/* add an array of tuple pointers for offset-based access */
+	phase_start = _FQstatsClock(result);
+	_FQexecFillTuplesArray(result);
+	FB_STATS_PHASE(result, fill_usecs, phase_start, 0);
+
+	/* if autocommit, and no explicit transaction set, commit */
+	if (conn->autocommit == true && conn->in_user_transaction == false)
+	{
+		_FQcommitTransaction(conn, trans);
+	}
+
+	/* clear up internal storage */
+	_FQexecClearResult(conn, result);
+	return result;
+}
+
+
+/**
+ * FQexecImmediate()
+ *
+ * Execute a statement which does not return rows (DDL, or DML
+ * without a RETURNING clause) in a single server round trip,
+ * using isc_dsql_execute_immediate().
+ *
+ * Returns NULL when no server connection available.
+ *
+ * The statement cannot be parameterized and must not be a transaction
+ * control statement (SET TRANSACTION, COMMIT, ROLLBACK); use FQexec()
+ * for those.
+ */
+FBresult *
+FQexecImmediate(FBconn *conn, const char *stmt)
+{
+	if (!conn)
+	{
+		return NULL;
+	}
+
+	return _FQexecImmediate(conn, &conn->trans, stmt, _FQexecGuessStatementType(stmt));
+}
+
+
+/**
+ * _FQexecImmediate()
+ *
+ * Execute the statement specified in 'stmt' using the transaction handle
+ * pointed to by 'trans', without preparing it first.
+ *
+ * 'statement_type' is the isc_info_sql_stmt_* value, if known; DDL
+ * statements are committed immediately, as in _FQexec(), otherwise
+ * the connection's autocommit setting is honoured.
+ */
+static FBresult *
+_FQexecImmediate(FBconn *conn, isc_tr_handle *trans, const char *stmt, int statement_type)
+{
+	FBresult	  *result;
+	bool		  temp_trans = false;
+	int64_t		  phase_start;
+
+	result = _FQinitResult(conn, false);
+
+	_FQstatsInit(conn, result);
+	_FQtraceStatement(conn, stmt);
+	result->exec_stmt = stmt;
+	_FQmetricsCountStatement(conn, result, statement_type);
+
+	if (*trans == 0L)
+	{
+		_FQstartTransaction(conn, trans);
+
+		if (statement_type == isc_info_sql_stmt_ddl)
+			temp_trans = true;
+		else if (conn->autocommit == false)
+			conn->in_user_transaction = true;
+	}
+
+	phase_start = _FQstatsClock(result);
+
+	if (FB_TRACE(conn, "isc_dsql_execute_immediate", isc_dsql_execute_immediate(conn->status, &conn->db, trans, 0, stmt, SQL_DIALECT_V6, NULL)))
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_execute_immediate");
+		_FQsetResultError(conn, result);
+
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		/* if autocommit, and no explicit transaction set, rollback */
+		if (temp_trans == true || (conn->autocommit == true && conn->in_user_transaction == false))
+		{
+			_FQrollbackTransaction(conn, trans);
+		}
+
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+	FB_STATS_PHASE(result, execute_usecs, phase_start, 1);
+
+	if ((conn->autocommit == true && conn->in_user_transaction == false) || temp_trans == true)
+	{
+		_FQcommitTransaction(conn, trans);
+	}
+
+	result->resultStatus = FBRES_COMMAND_OK;
+
+	_FQexecClearResult(conn, result);
+	return result;
+}
+
+
+/**
+ * FQexecParams()
+ *
+ * Execute a parameterized query.
+ *
+ * conn
+ *   - a valid connection
+ * stmt
+ *   - a string containing the SQL to be executed
+ * nParams
+ *   - number of parameters supplied and should be the same as
+ *     the length of the various arrays supplied (note: currently
+ *     this argument is advisory and primarily for compatiblity
+ *     with the libpq method PQexecParams(), however it may
+ *     be used in the future)
+ * paramTypes[]
+ *   - (currently unused)
+ * paramValues[]
+ *   - actual query parameter values
+ * paramLengths[]
+ *   - (currently unused)
+ * paramFormats[]
+ *   - optional array to specify whether parameters are passed as
+ *     strings (array entry is 0) or a text string to be converted
+ *     to an RDB$DB_KEY value (array entry is -1). Binary formats
+ *     may be supported in the future.
+ * resultFormat
+ *   - (currently unused)
+ */
+FBresult *
+FQexecParams(FBconn *conn,
+			 const char *stmt,
+			 int nParams,
+			 const int *paramTypes,
+			 const char * const *paramValues,
+			 const int *paramLengths,
+			 const int *paramFormats,
+			 int resultFormat)
+{
+	if (!conn)
+		return NULL;
+
+	return _FQexecParams(conn,
+						 &conn->trans,
+						 stmt,
+						 nParams,
+						 paramTypes,
+						 paramValues,
+						 paramLengths,
+						 paramFormats,
+						 resultFormat);
+}
+
+
+/**
+ * _FQexecParams()
+ *
+ * Actually execute the parameterized query. See above for parameter
+ * details.
+ *
+ * Be warned, this was a pain to kludge together (oh Firebird C API, how
+ * I love your cryptic minimalism) and is in dire need of refactoring.
+ * But it works. Mostly.
+ */
+FBresult *
+_FQexecParams(FBconn *conn,
+			  isc_tr_handle *trans,
+			  const char *stmt,
+			  int nParams,
+			  const int *paramTypes,
+			  const char * const *paramValues,
+			  const int *paramLengths,
+			  const int *paramFormats,
+			  int resultFormat
+	)
+{
+	FBresult	 *result;
+	XSQLVAR		 *var;
+	bool		  temp_trans = false;
+	int			  i;
+
+	long		  fetch_stat;
+	char		  info_buffer[20];
+	static char	  stmt_info[] = { isc_info_sql_stmt_type };
+	int			  statement_type;
+	int			  exec_result;
+	char		  error_message[1024];
+	int64_t		  phase_start;
+
+	result = _FQinitResult(conn, true);
+
+	_FQstatsInit(conn, result);
+	_FQtraceStatement(conn, stmt);
+	result->exec_stmt = stmt;
+	result->exec_nparams = nParams;
+	result->exec_param_values = paramValues;
+	result->exec_param_formats = paramFormats;
+	phase_start = _FQstatsClock(result);
+
+	/* Allocate a statement. */
+	if (_FQallocStatement(conn, &result->stmt_handle))
+	{
+		result->resultStatus = FBRES_FATAL_ERROR;
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_allocate_statement");
+		_FQsetResultError(conn, result);
+
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+
+	/* An active transaction is required to prepare the statement -
+	 * if no transaction handle was provided by the caller,
 	 * start a temporary transaction
 	 */
-	if (*trans == 0L)
+	if (*trans == 0L)
+	{
+		_FQstartTransaction(conn, trans);
+		temp_trans = true;
+	}
+
+	/* Prepare the statement. */
+	conn->metrics.prepares++;
+
+	if (FB_TRACE(conn, "isc_dsql_prepare", isc_dsql_prepare(conn->status, trans, &result->stmt_handle, 0, stmt, SQL_DIALECT_V6, NULL)))
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_prepare");
+
+		_FQsetResultError(conn, result);
+
+		_FQrollbackTransaction(conn, trans);
+
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+	if (temp_trans == true)
+	{
+		_FQrollbackTransaction(conn, trans);
+		temp_trans = false;
+	}
+
+	/* Determine the statement's type */
+	if (FB_TRACE(conn, "isc_dsql_sql_info", isc_dsql_sql_info(conn->status, &result->stmt_handle, sizeof (stmt_info), stmt_info, sizeof (info_buffer), info_buffer)))
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_sql_info");
+
+		_FQsetResultError(conn, result);
+
+		_FQrollbackTransaction(conn, trans);
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+	statement_type = _FQexecParseStatementType((char *) info_buffer);
+	_FQmetricsCountStatement(conn, result, statement_type);
+
+	FB_STATS_PHASE(result, prepare_usecs, phase_start, 2);
+
+	FB_LOG(conn, DEBUG1, "statement_type: %i", statement_type);
+
+	switch(statement_type)
+	{
+		case isc_info_sql_stmt_insert:
+		case isc_info_sql_stmt_update:
+		case isc_info_sql_stmt_delete:
+		case isc_info_sql_stmt_select:
+		case isc_info_sql_stmt_exec_procedure:
+			/* INSERT ... RETURNING ... */
+			break;
+
+		default:
+			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - stmt type is not DML");
+
+			_FQsetResultError(conn, result);
+
+			_FQrollbackTransaction(conn, trans);
+			result->resultStatus = FBRES_FATAL_ERROR;
+
+			_FQexecClearResult(conn, result);
+			return result;
+	}
+
+	phase_start = _FQstatsClock(result);
+
+	if (FB_TRACE(conn, "isc_dsql_describe_bind", isc_dsql_describe_bind(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in)))
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_describe_bind");
+		_FQsetResultError(conn, result);
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		_FQrollbackTransaction(conn, trans);
+
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+	if (*trans == 0L)
+	{
+		FB_LOG(conn, DEBUG1, "_FQexecParams: starting transaction...");
+		_FQstartTransaction(conn, trans);
+
+		if (conn->autocommit == false)
+			conn->in_user_transaction = true;
+	}
+
+	if (result->sqlda_in->sqld > result->sqlda_in->sqln)
+	{
+		int sqln = result->sqlda_in->sqld;
+
+		_FQresultAllocSQLDA(result, &result->sqlda_in, sqln);
+		FB_TRACE(conn, "isc_dsql_describe_bind", isc_dsql_describe_bind(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in));
+		FB_STATS_ADD(result, round_trips, 1);
+
+		FB_LOG(conn, DEBUG1, "%lu; sqln now %i %i", XSQLDA_LENGTH(sqln), sqln, result->sqlda_in->sqld );
+	}
+
+	/* from dbdimp.c - not sure what it's about, but note here
+	 * in case we encounter a similiar issue */
+	/* workaround for date problem (bug #429820)
+	if (dtype == SQL_TEXT)
+	{
+		if (ivar->sqlsubtype == 0x77)
+			dtype = SQL_TIMESTAMP;
+	}
+	*/
+
+	for (i = 0, var = result->sqlda_in->sqlvar; i < result->sqlda_in->sqld; i++, var++)
+	{
+		if (paramFormats != NULL)
+			FB_LOG(conn, DEBUG1, "%i: %s", i, paramValues[i]);
+
+		if (_FQexecBindParam(conn, var, paramValues[i], paramFormats != NULL ? paramFormats[i] : 0, error_message) == false)
+		{
+			_FQsetResultError(conn, result);
+			_FQsaveMessageField(&result, FB_DIAG_DEBUG, error_message);
+
+			result->resultStatus = FBRES_FATAL_ERROR;
+
+			_FQexecClearResult(conn, result);
+			return result;
+		}
+	}
+
+	if (FB_TRACE(conn, "isc_dsql_describe", isc_dsql_describe(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out)))
+	{
+		_FQsetResultError(conn, result);
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_describe");
+
+		result->resultStatus = FBRES_FATAL_ERROR;
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+	FB_STATS_PHASE(result, describe_usecs, phase_start, 2);
+
+	/* Expand output sqlda to required number of columns */
+	result->ncols = result->sqlda_out->sqld;
+
+	FB_LOG(conn, DEBUG2, "_FQexecParams(): ncols is %i", result->ncols);
+
+	/* No output expected */
+	if (!result->ncols)
+	{
+		phase_start = _FQstatsClock(result);
+
+		if (FB_TRACE(conn, "isc_dsql_execute", isc_dsql_execute(conn->status, trans, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in)))
+		{
+			FB_LOG(conn, DEBUG1, "isc_dsql_execute(): error");
+
+			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_execute() error");
+
+			_FQsetResultError(conn, result);
+			result->resultStatus = FBRES_FATAL_ERROR;
+
+			/* if autocommit, and no explicit transaction set, rollback */
+			if (conn->autocommit == true && conn->in_user_transaction == false)
+			{
+				_FQrollbackTransaction(conn, trans);
+			}
+
+			_FQexecClearResult(conn, result);
+
+			return result;
+		}
+
+		FB_STATS_PHASE(result, execute_usecs, phase_start, 1);
+
+		FB_LOG(conn, DEBUG1, "_FQexecParams(): finished non-SELECT with no rows to return");
+		result->resultStatus = FBRES_COMMAND_OK;
+		if (conn->autocommit == true && conn->in_user_transaction == false)
+		{
+			FB_LOG(conn, DEBUG1, "committing...");
+			_FQcommitTransaction(conn, trans);
+		}
+
+		_FQexecClearResult(conn, result);
+
+		return result;
+	}
+
+	if (result->sqlda_out->sqln < result->ncols) {
+		_FQresultAllocSQLDA(result, &result->sqlda_out, result->ncols);
+
+		FB_TRACE(conn, "isc_dsql_describe", isc_dsql_describe(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out));
+		FB_STATS_ADD(result, round_trips, 1);
+
+		result->ncols = result->sqlda_out->sqld;
+	}
+
+	_FQexecInitOutputSQLDA(conn, result);
+
+	phase_start = _FQstatsClock(result);
+
+	/* "isc_info_sql_stmt_exec_procedure" also covers "RETURNING ..." statements */
+	if (statement_type == isc_info_sql_stmt_exec_procedure)
+		exec_result = FB_TRACE(conn, "isc_dsql_execute2", isc_dsql_execute2(conn->status, trans, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in, result->sqlda_out));
+	else
+		exec_result = FB_TRACE(conn, "isc_dsql_execute", isc_dsql_execute(conn->status, trans, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in));
+
+	if (exec_result)
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_execute2() error");
+
+		result->resultStatus = FBRES_FATAL_ERROR;
+		_FQsetResultError(conn, result);
+
+		/* if autocommit, and no explicit transaction set, rollback */
+		if (conn->autocommit == true && conn->in_user_transaction == false)
+		{
+			_FQrollbackTransaction(conn, trans);
+		}
+
+		_FQexecClearResult(conn, result);
+
+		return result;
+	}
+
+	FB_STATS_PHASE(result, execute_usecs, phase_start, 1);
+
+	/* set up tuple holder */
+	result->tuple_first = NULL;
+	result->tuple_last = NULL;
+
+	_FQexecInitHeader(conn, result);
+
+	/* XXX TODO: only needed for "SELECT ... FOR UPDATE " */
+	if (0 && isc_dsql_set_cursor_name(conn->status, &result->stmt_handle, "dyn_cursor", 0))
+	{
+		_FQsetResultError(conn, result);
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, error_message);
+
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		_FQexecClearResult(conn, result);
+
+		return result;
+	}
+
+	if (statement_type == isc_info_sql_stmt_exec_procedure)
+	{
+		_FQstoreResult(result, conn, 0);
+		result->ntups = 1;
+	}
+	else
+	{
+		result->ntups = _FQexecFetch(conn, result, &fetch_stat);
+	}
+
+	if (result->ntups < 0)
+	{
+		_FQexecDiscardTuples(result);
+
+		_FQsetResultLibraryError(conn, result, "result memory limit of %zu bytes exceeded", result->mem_account->limit);
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		/* if autocommit, and no explicit transaction set, rollback */
+		if (conn->autocommit == true && conn->in_user_transaction == false)
+		{
+			_FQrollbackTransaction(conn, trans);
+		}
+
+		_FQexecClearResult(conn, result);
+		return result;
+	}
+
+	/*
+	 * HACK: INSERT/UPDATE/DELETE ... RETURNING ... sometimes results in a
+	 * "request synchronization error" - ignoring this doesn't seem to
+	 * cause any problems. Potentially this is related to issues with cursor
+	 * usage.
+	 *
+	 * See maybe: http://support.codegear.com/article/35153
+	 */
+	if (0 && fetch_stat != 100L && fetch_stat != isc_req_sync)
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_fetch reported %lu", fetch_stat);
+
+		_FQsetResultError(conn, result);
+
+		_FQrollbackTransaction(conn, trans);
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		_FQexecClearResult(conn, result);
+
+		return result;
+	}
+
+	/* add an array for offset-based access */
+	phase_start = _FQstatsClock(result);
+	_FQexecFillTuplesArray(result);
+	FB_STATS_PHASE(result, fill_usecs, phase_start, 0);
+
+	result->resultStatus = FBRES_TUPLES_OK;
+
+	/* if autocommit, and no explicit transaction set, commit */
+	if (conn->autocommit == true && conn->in_user_transaction == false)
+	{
+		_FQcommitTransaction(conn, trans);
+	}
+
+	/* clear up internal storage */
+	_FQexecClearResult(conn, result);
+
+	return result;
+}
+
+/* State shared between the caller and the fetch thread in pipelined mode */
+typedef struct FQfetchPipeline
+{
+	isc_stmt_handle *stmt_handle;
+	XSQLDA		   *sqlda;			/* fetch thread's own copy of the output SQLDA */
+	char		   *rows;			/* ring of raw row buffers */
+	size_t			row_size;
+	int				nrows;
+	int				head;			/* next row to be consumed */
+	int				tail;			/* next row to be fetched into */
+	int				count;			/* number of fetched rows not yet consumed */
+	bool			done;
+	bool			cancelled;		/* set if the caller stops consuming rows */
+	ISC_STATUS		fetch_stat;
+	ISC_STATUS		status[ISC_STATUS_LENGTH];
+	pthread_mutex_t mutex;
+	pthread_cond_t	row_fetched;
+	pthread_cond_t	row_consumed;
+} FQfetchPipeline;
+
+
+/**
+ * _FQexecBindParam()
+ *
+ * Convert the text representation of a parameter value to the type
+ * expected by the SQLVAR "var" and store it there, allocating the
+ * storage and NULL indicator; NULL values are represented by a NULL
+ * "value". A "param_format" of -1 indicates an RDB$DB_KEY value in hexadecimal
+ * notation.
+ *
+ * Note that VARCHAR and date/time parameters are coerced to CHAR, so
+ * the caller must restore the SQLVAR's original type before binding
+ * another value to it.
+ *
+ * Returns false, with a description in "error_message", if the
+ * parameter type is not supported.
+ */
+bool
+_FQexecBindParam(FBconn *conn, XSQLVAR *var, const char *value, int param_format, char *error_message)
+{
+	int dtype = (var->sqltype & ~1); /* drop flag bit for now */
+
+	int len = 0;
+
+	var->sqldata = NULL;
+	var->sqllen = 0;
+
+	/* For NULL values, initialise empty sqldata/sqllen */
+	if (value == NULL)
+	{
+		int size = -1;
+
+		switch(dtype)
+		{
+			case SQL_SHORT:
+				size = sizeof(ISC_SHORT);
+				break;
+
+			case SQL_LONG:
+				size = sizeof(ISC_LONG);
+				break;
+
+			case SQL_INT64:
+				size = sizeof(ISC_INT64);
+				break;
+
+			case SQL_FLOAT:
+				size = sizeof(float);
+				break;
+
+			case SQL_DOUBLE:
+				size = sizeof(double);
+				break;
+
+			case SQL_VARYING:
+				size = 0;
+				break;
+
+			case SQL_TEXT:
+				size = 0;
+				break;
+
+			case SQL_TIMESTAMP:
+				size = sizeof(ISC_TIMESTAMP);
+				break;
+
+			case SQL_TYPE_DATE:
+				size = sizeof(ISC_DATE);
+				break;
+
+			case SQL_TYPE_TIME:
+				size = sizeof(ISC_TIME);
+				break;
+
+			case SQL_BLOB:
+				size = sizeof(ISC_QUAD);
+				break;
+
+#if defined SQL_BOOLEAN
+			/* Firebird 3.0 and later */
+			case SQL_BOOLEAN:
+				size = sizeof(FB_BOOLEAN);
+				break;
+#endif
+
+			default:
+				sprintf(error_message, "Unhandled sqlda_in type: %i", dtype);
+				return false;
+		}
+
+		if (size >= 0)
+		{
+			var->sqldata = (char *)_FQmalloc(size);
+			var->sqllen = size;
+		}
+	}
+	else
+	{
+		switch(dtype)
+		{
+			case SQL_SHORT:
+			case SQL_LONG:
+			{
+				char format[64];
+				long p, q, r, result;
+				const char *svalue;
+
+				p = q = r = (long) 0;
+				svalue = value;
+				len = strlen(svalue);
+
+				/* with decimals? */
+				if (var->sqlscale < 0)
+				{
+					/* NUMERIC(?,?) */
+					int	 scale = (int) (pow(10.0, (double) -var->sqlscale));
+					int	 dscale;
+					char *tmp;
+					char *neg;
+
+					FB_LOG(conn, DEBUG1, "sqlscale < 0; scale is %i", scale);
+
+					sprintf(format, "%%ld.%%%dld%%1ld", -var->sqlscale);
+
+					/* negative -0.x hack */
+					neg = strchr(svalue, '-');
+					if (neg)
+					{
+						svalue = neg + 1;
+						len = strlen(svalue);
+					}
+
+					if (!sscanf(svalue, format, &p, &q, &r))
+					{
+						/* here we handle values such as .78 passed as string */
+						sprintf(format, ".%%%dld%%1ld", -var->sqlscale);
+						if (!sscanf(svalue, format, &q, &r) )
+							FB_LOG(conn, DEBUG1, "problem parsing SQL_SHORT/SQL_LONG type");
+					}
+
+					/* Round up if r is 5 or greater */
+					if (r >= 5)
+					{
+						q++;			/* round q up by one */
+						p += q / scale; /* round p up by one if q overflows */
+						q %= scale;		/* modulus if q overflows */
+					}
+
+					/* decimal scaling */
+					tmp	   = strchr(svalue, '.');
+					dscale = (tmp)
+						? -var->sqlscale - (len - (int) (tmp - svalue)) + 1
+						: 0;
+
+					if (dscale < 0) dscale = 0;
+
+					/* final result */
+					result = (long) (p * scale + q * (int) (pow(10.0, (double) dscale))) * (neg ? -1 : 1);
+					FB_LOG(conn, DEBUG1, "SQL_SHORT/LONG: decimal result is %li", result);
+				}
+				else
+				{
+					/* numeric(?,0): scan for one decimal and do rounding*/
+
+					sprintf(format, "%%ld.%%1ld");
+
+					if (!sscanf(svalue, format, &p, &r))
+					{
+						sprintf(format, ".%%1ld");
+						if (!sscanf(svalue, format, &r))
+							FB_LOG(conn, DEBUG1, "problem parsing SQL_SHORT/SQL_LONG type");
+					}
+
+					/* rounding */
+					if (r >= 5)
+					{
+						if (p < 0) p--; else p++;
+					}
+
+					result = (long) p;
+				}
+
+				if (dtype == SQL_SHORT)
+				{
+					var->sqldata = (char *)_FQmalloc(sizeof(ISC_SHORT));
+					var->sqllen = sizeof(ISC_SHORT);
+					*(ISC_SHORT *) (var->sqldata) = (ISC_SHORT) result;
+				}
+				else
+				{
+					var->sqldata = (char *)_FQmalloc(sizeof(ISC_LONG));
+					var->sqllen = sizeof(ISC_LONG);
+					*(ISC_LONG *) (var->sqldata) = (ISC_LONG) result;
+				}
+
+				break;
+			}
+
+			case SQL_INT64:
+			{
+				const char	   *svalue;
+				char	 format[64];
+				ISC_INT64 p, q, r;
+
+				FB_LOG(conn, DEBUG1, "INT64");
+				var->sqldata = (char *)_FQmalloc(sizeof(ISC_INT64));
+				memset(var->sqldata, '\0', sizeof(ISC_INT64));
+
+				p = q = r = (ISC_INT64) 0;
+				svalue = value;
+				len = strlen(svalue);
+
+				/* with decimals? */
+				if (var->sqlscale < 0)
+				{
+					/* numeric(?,?) */
+					int	 scale = (int) (pow(10.0, (double) -var->sqlscale));
+					int	 dscale;
+					char *tmp;
+					char *neg;
+
+					sprintf(format, S_INT64_FULL, -var->sqlscale);
+
+					/* negative -0.x hack */
+					neg = strchr(svalue, '-');
+					if (neg)
+					{
+						svalue = neg + 1;
+						len = strlen(svalue);
+					}
+
+					if (!sscanf(svalue, format, &p, &q, &r))
+					{
+						/* here we handle values such as .78 passed as string */
+						sprintf(format, S_INT64_DEC_FULL, -var->sqlscale);
+						if (!sscanf(svalue, format, &q, &r))
+							FB_LOG(conn, DEBUG1, "problem parsing SQL_INT64 type");
+					}
+
+					/* Round up if r is 5 or greater */
+					if (r >= 5)
+					{
+						q++;			/* round q up by one */
+						p += q / scale; /* round p up by one if q overflows */
+						q %= scale;		/* modulus if q overflows */
+					}
+
+					/* decimal scaling */
+					tmp	   = strchr(svalue, '.');
+					dscale = (tmp)
+						? -var->sqlscale - (len - (int) (tmp - svalue)) + 1
+						: 0;
+
+					if (dscale < 0)
+						dscale = 0;
+
+					*(ISC_INT64 *) (var->sqldata) = (ISC_INT64) (p * scale + q * (int) (pow(10.0, (double) dscale))) * (neg? -1: 1);
+					var->sqllen = sizeof(ISC_INT64);
+				}
+				else
+				{
+					/* NUMERIC(?,0): scan for one decimal and do rounding */
+
+					sprintf(format, S_INT64_NOSCALE);
+
+					if (!sscanf(svalue, format, &p, &r))
+					{
+						sprintf(format, S_INT64_DEC_NOSCALE);
+						if (!sscanf(svalue, format, &r))
+							FB_LOG(conn, DEBUG1, "problem parsing SQL_INT64 type");
+					}
+
+					/* rounding */
+					if (r >= 5)
+					{
+						if (p < 0) p--; else p++;
+					}
+
+					*(ISC_INT64 *) (var->sqldata) = (ISC_INT64) p;
+					var->sqllen = sizeof(ISC_INT64);
+				}
+
+				break;
+			}
+
+			case SQL_FLOAT:
+				var->sqldata = (char *)_FQmalloc(sizeof(float));
+				var->sqllen = sizeof(float);
+				*(float *)(var->sqldata) = (float)atof(value);
+				break;
+
+			case SQL_DOUBLE:
+				var->sqldata = (char *)_FQmalloc(sizeof(double));
+				var->sqllen = sizeof(double);
+				*(double *) (var->sqldata) = atof(value);
+				break;
+
+			case SQL_VARYING:
+				var->sqltype = SQL_TEXT; /* need this */
+				len = strlen(value);
+
+				var->sqllen = len; /* need this */
+				var->sqldata = (char *)_FQmalloc(sizeof(char)*var->sqllen);
+				memcpy(var->sqldata, value, len);
+				break;
+
+			case SQL_TEXT:
+
+				/* convert RDB$DB_KEY hex value to raw bytes if requested */
+				if (param_format == -1)
+				{
+					unsigned char *sqlptr;
+					unsigned char *srcptr;
+					unsigned char *srcptr_ix;
+					unsigned char *srcptr_parsed;
+					int ix = 0;
+
+					srcptr = (unsigned char *)_FQdeparseDbKey(value);
+
+					srcptr_parsed = _FQparseDbKey((char *)srcptr);
+					FB_LOG(conn, DEBUG1, "srcptr %s", srcptr_parsed);
+					_FQfree(srcptr_parsed);
+
+					len = 8;
+					var->sqllen = len;
+					var->sqldata = (char *)_FQmalloc(len);
+
+					sqlptr = (unsigned char *)var->sqldata ;
+					srcptr_ix = srcptr;
+
+					for (ix = 0; ix < len; ix++)
+					{
+						*sqlptr++ = *srcptr_ix++;
+					}
+
+					_FQfree(srcptr);
+				}
+				else
+				{
+					len = strlen(value);
+					var->sqldata = (char *)_FQmalloc(sizeof(char) * len);
+					var->sqllen = len;
+					memcpy(var->sqldata, value, len);
+				}
+
+				break;
+
+			case SQL_TIMESTAMP:
+			case SQL_TYPE_DATE:
+			case SQL_TYPE_TIME:
+				/* Here we coerce the time-related column types to CHAR,
+				 * causing Firebird to use its internal parsing mechanisms
+				 * to interpret the supplied literal
+				 */
+				len = strlen(value);
+				/* From dbimp.c: "workaround for date problem (bug #429820)" */
+				var->sqltype = SQL_TEXT;
+				var->sqlsubtype = 0x77;
+				var->sqllen = len;
+				var->sqldata = (char *)_FQmalloc(sizeof(char)*len);
+				memcpy(var->sqldata, value, len);
+
+				break;
+
+			case SQL_BLOB:
+			{
+				/* must be initialised to NULL */
+				isc_blob_handle blob_handle = NULL;
+				char *ptr = (char *)value;
+
+				len = strlen(value);
+				var->sqldata = (char *)_FQmalloc(sizeof(ISC_QUAD));
+				var->sqllen = sizeof(ISC_QUAD);
+
+				FB_TRACE(conn, "isc_create_blob2", isc_create_blob2(
+					conn->status,
+					&conn->db,
+					&conn->trans,
+					&blob_handle,
+					(ISC_QUAD *)var->sqldata,
+					0,		 /* Blob Parameter Buffer length = 0; no filter will be used */
+					NULL	 /* NULL Blob Parameter Buffer, since no filter will be used */
+					));
+				while (ptr < value + len)
+				{
+					int seg_len = BLOB_SEGMENT_LEN;
+
+					if (ptr + seg_len > (value + len))
+					{
+						seg_len = (value + len) - ptr;
+					}
+
+					FB_TRACE(conn, "isc_put_segment", isc_put_segment(
+						conn->status,
+						&blob_handle,
+						seg_len,
+						ptr));
+
+					ptr += BLOB_SEGMENT_LEN;
+				}
+				FB_TRACE(conn, "isc_close_blob", isc_close_blob(conn->status, &blob_handle));
+				break;
+			}
+
+#if defined SQL_BOOLEAN
+			/* Firebird 3.0 and later */
+			case SQL_BOOLEAN:
+				var->sqldata = (char *)_FQmalloc(sizeof(FB_BOOLEAN));
+				var->sqllen = sizeof(FB_BOOLEAN);
+
+				if (strncasecmp(value, "0", 1) == 0)
+					*var->sqldata = FB_FALSE;
+				else if (strncasecmp(value, "1", 1) == 0)
+					*var->sqldata = FB_TRUE;
+				else if (strncasecmp(value, "false", 5) == 0)
+					*var->sqldata = FB_FALSE;
+				else if (strncasecmp(value, "f", 1) == 0)
+					*var->sqldata = FB_FALSE;
+				else if (strncasecmp(value, "true", 4) == 0)
+					*var->sqldata = FB_TRUE;
+				else if (strncasecmp(value, "t", 1) == 0)
+					*var->sqldata = FB_TRUE;
+				else
+					*var->sqldata = FB_FALSE;
+
+				break;
+#endif
+
+			default:
+				sprintf(error_message, "Unhandled sqlda_in type: %i", dtype);
+				return false;
+		}
+	}
+
+	if (var->sqltype & 1)
+	{
+		/* allocate variable to hold NULL status */
+
+		var->sqlind = (short *)_FQmalloc(sizeof(short));
+		*(short *)var->sqlind = (value == NULL) ? -1 : 0;
+	}
+
+	return true;
+}
+
+
+/**
+ * _FQexecFetch()
+ *
+ * Fetch all rows from the executed statement into the result, returning
+ * the number of rows fetched; the status of the final isc_dsql_fetch()
+ * call is stored in 'fetch_stat'.
+ *
+ * Fetching stops, and -1 is returned, if the connection's results exceed
+ * the memory limit set with FQsetMemoryLimit().
+ */
+static int
+_FQexecFetch(FBconn *conn, FBresult *result, long *fetch_stat)
+{
+	int		num_rows = 0;
+	int64_t	fetch_start = _FQstatsClock(result);
+	int64_t	format_usecs = result->stats != NULL ? result->stats->format_usecs : 0;
+
+	if (conn->fetch_pipeline_rows > 0)
+	{
+		num_rows = _FQexecFetchPipelined(conn, result, fetch_stat);
+	}
+	else
+	{
+		while ((*fetch_stat = FB_TRACE(conn, "isc_dsql_fetch", isc_dsql_fetch(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out))) == 0)
+		{
+			_FQstoreResult(result, conn, num_rows);
+			num_rows++;
+
+			if (_FQresultMemoryExceeded(result))
+				break;
+		}
+	}
+
+	/* time spent storing rows is recorded by _FQstoreResult() */
+	FB_STATS_PHASE(result, fetch_usecs, fetch_start + (result->stats->format_usecs - format_usecs), num_rows + 1);
+
+	conn->metrics.rows_fetched += num_rows;
+	conn->metrics.bytes_stored += _FQresultValueSize(result);
+
+	if (_FQresultMemoryExceeded(result))
+		return -1;
+
+	return num_rows;
+}
+
+
+/**
+ * _FQexecFetchPipelined()
+ *
+ * Fetch all rows from the executed statement, with a background thread
+ * fetching raw rows into a ring of buffers while this thread formats and
+ * stores them, so network latency overlaps with formatting.
+ *
+ * Falls back to a plain fetch loop if the thread cannot be started.
+ */
+static int
+_FQexecFetchPipelined(FBconn *conn, FBresult *result, long *fetch_stat)
+{
+	FQfetchPipeline pipeline;
+	pthread_t		fetch_thread;
+	char		  **orig_sqldata;
+	short		  **orig_sqlind;
+	int				num_rows = 0;
+	int				i;
+
+	memset(&pipeline, 0, sizeof(FQfetchPipeline));
+	pipeline.stmt_handle = &result->stmt_handle;
+	pipeline.row_size = _FQexecRowBufferSize(result->sqlda_out);
+	pipeline.nrows = conn->fetch_pipeline_rows;
+	pipeline.rows = (char *)_FQmalloc(pipeline.row_size * pipeline.nrows);
+	pipeline.sqlda = (XSQLDA *)_FQmalloc(XSQLDA_LENGTH(result->ncols));
+	memcpy(pipeline.sqlda, result->sqlda_out, XSQLDA_LENGTH(result->ncols));
+
+	pthread_mutex_init(&pipeline.mutex, NULL);
+	pthread_cond_init(&pipeline.row_fetched, NULL);
+	pthread_cond_init(&pipeline.row_consumed, NULL);
+
+	if (pthread_create(&fetch_thread, NULL, _FQexecFetchThread, &pipeline) != 0)
+	{
+		FB_LOG(conn, DEBUG1, "_FQexecFetchPipelined(): unable to start fetch thread");
+
+		while ((*fetch_stat = FB_TRACE(conn, "isc_dsql_fetch", isc_dsql_fetch(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out))) == 0)
+		{
+			_FQstoreResult(result, conn, num_rows);
+			num_rows++;
+
+			if (_FQresultMemoryExceeded(result))
+				break;
+		}
+	}
+	else
+	{
+		/* the output SQLDA is pointed at each fetched row in turn */
+		orig_sqldata = (char **)_FQmalloc(sizeof(char *) * result->ncols);
+		orig_sqlind = (short **)_FQmalloc(sizeof(short *) * result->ncols);
+
+		for (i = 0; i < result->ncols; i++)
+		{
+			orig_sqldata[i] = result->sqlda_out->sqlvar[i].sqldata;
+			orig_sqlind[i] = result->sqlda_out->sqlvar[i].sqlind;
+		}
+
+		for (;;)
+		{
+			int row;
+
+			pthread_mutex_lock(&pipeline.mutex);
+			while (pipeline.count == 0 && pipeline.done == false)
+				pthread_cond_wait(&pipeline.row_fetched, &pipeline.mutex);
+
+			if (pipeline.count == 0)
+			{
+				pthread_mutex_unlock(&pipeline.mutex);
+				break;
+			}
+
+			row = pipeline.head;
+			pthread_mutex_unlock(&pipeline.mutex);
+
+			_FQexecBindRowBuffer(result->sqlda_out, pipeline.rows + row * pipeline.row_size);
+			_FQstoreResult(result, conn, num_rows);
+			num_rows++;
+
+			pthread_mutex_lock(&pipeline.mutex);
+			pipeline.head = (pipeline.head + 1) % pipeline.nrows;
+			pipeline.count--;
+
+			/* the fetch thread exits once its current fetch completes */
+			if (_FQresultMemoryExceeded(result))
+				pipeline.cancelled = true;
+
+			pthread_cond_signal(&pipeline.row_consumed);
+			pthread_mutex_unlock(&pipeline.mutex);
+
+			if (pipeline.cancelled == true)
+				break;
+		}
+
+		pthread_join(fetch_thread, NULL);
+
+		for (i = 0; i < result->ncols; i++)
+		{
+			result->sqlda_out->sqlvar[i].sqldata = orig_sqldata[i];
+			result->sqlda_out->sqlvar[i].sqlind = orig_sqlind[i];
+		}
+
+		_FQfree(orig_sqldata);
+		_FQfree(orig_sqlind);
+
+		*fetch_stat = pipeline.fetch_stat;
+
+		/*
+		 * Make any fetch error available to the caller; the fetch thread
+		 * only sets its status if it stopped of its own accord.
+		 */
+		if (pipeline.done == true && pipeline.fetch_stat != 100L)
+			memcpy(conn->status, pipeline.status, sizeof(pipeline.status));
+	}
+
+	pthread_cond_destroy(&pipeline.row_consumed);
+	pthread_cond_destroy(&pipeline.row_fetched);
+	pthread_mutex_destroy(&pipeline.mutex);
+
+	_FQfree(pipeline.sqlda);
+	_FQfree(pipeline.rows);
+
+	return num_rows;
+}
+
+
+/**
+ * _FQexecFetchThread()
+ *
+ * Fetch thread for _FQexecFetchPipelined(); fetches rows directly into
+ * free row buffers until the cursor is exhausted or an error occurs.
+ *
+ * A separate status vector is used, as the caller's thread may be
+ * retrieving BLOBs at the same time.
+ */
+static void *
+_FQexecFetchThread(void *arg)
+{
+	FQfetchPipeline *pipeline = (FQfetchPipeline *)arg;
+
+	for (;;)
+	{
+		ISC_STATUS	fetch_stat;
+		int			row;
+
+		pthread_mutex_lock(&pipeline->mutex);
+		while (pipeline->count == pipeline->nrows && pipeline->cancelled == false)
+			pthread_cond_wait(&pipeline->row_consumed, &pipeline->mutex);
+
+		if (pipeline->cancelled == true)
+		{
+			pthread_mutex_unlock(&pipeline->mutex);
+			break;
+		}
+
+		row = pipeline->tail;
+		pthread_mutex_unlock(&pipeline->mutex);
+
+		_FQexecBindRowBuffer(pipeline->sqlda, pipeline->rows + row * pipeline->row_size);
+
+		fetch_stat = isc_dsql_fetch(pipeline->status, pipeline->stmt_handle, SQL_DIALECT_V6, pipeline->sqlda);
+
+		pthread_mutex_lock(&pipeline->mutex);
+
+		if (fetch_stat != 0)
+		{
+			pipeline->fetch_stat = fetch_stat;
+			pipeline->done = true;
+		}
+		else
+		{
+			pipeline->tail = (pipeline->tail + 1) % pipeline->nrows;
+			pipeline->count++;
+		}
+
+		pthread_cond_signal(&pipeline->row_fetched);
+		pthread_mutex_unlock(&pipeline->mutex);
+
+		if (fetch_stat != 0)
+			break;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * _FQexecRowBufferSize()
+ *
+ * Calculate the size of a buffer able to hold one row described by the
+ * provided SQLDA, as laid out by _FQexecBindRowBuffer().
+ */
+static size_t
+_FQexecRowBufferSize(const XSQLDA *sqlda)
+{
+	const XSQLVAR *var;
+	size_t		   size = 0;
+	short		   i;
+
+	for (i = 0, var = sqlda->sqlvar; i < sqlda->sqld; var++, i++)
+	{
+		size_t datum_size = var->sqllen;
+
+		/* length prefix, plus space for a terminating NUL */
+		if ((var->sqltype & ~1) == SQL_VARYING)
+			datum_size += sizeof(short) + 1;
+
+		size += FB_BUFFER_ALIGN(datum_size);
+	}
+
+	/* NULL indicators */
+	size += FB_BUFFER_ALIGN(sizeof(short) * sqlda->sqld);
+
+	return size;
+}
+
+
+/**
+ * _FQexecBindRowBuffer()
+ *
+ * Point each XSQLVAR's data and NULL indicator at its location in 'buffer',
+ * which must be at least _FQexecRowBufferSize() bytes long.
+ */
+static void
+_FQexecBindRowBuffer(XSQLDA *sqlda, char *buffer)
+{
+	XSQLVAR *var;
+	short	*sqlind;
+	short	 i;
+
+	for (i = 0, var = sqlda->sqlvar; i < sqlda->sqld; var++, i++)
+	{
+		size_t datum_size = var->sqllen;
+
+		if ((var->sqltype & ~1) == SQL_VARYING)
+			datum_size += sizeof(short) + 1;
+
+		var->sqldata = buffer;
+		buffer += FB_BUFFER_ALIGN(datum_size);
+	}
+
+	sqlind = (short *)buffer;
+
+	for (i = 0, var = sqlda->sqlvar; i < sqlda->sqld; var++, i++)
+		var->sqlind = (var->sqltype & 1) ? &sqlind[i] : NULL;
+}
+
+
+/**
+ * _FQexecInitHeader()
+ *
+ * Store the description of each column of a described statement's
+ * output, so it is available even if the statement returns no rows.
+ */
+static void
+_FQexecInitHeader(FBconn *conn, FBresult *result)
+{
+	int i;
+
+	result->header = _FQresultMalloc(result, sizeof(FQresTupleAttDesc *) * result->ncols);
+
+	for (i = 0; i < result->ncols; i++)
+	{
+		FQresTupleAttDesc *desc = (FQresTupleAttDesc *)_FQresultMalloc(result, sizeof(FQresTupleAttDesc));
+		XSQLVAR *var1 = &result->sqlda_out->sqlvar[i];
+
+		desc->desc_len = var1->sqlname_length;
+		desc->desc = (char *)_FQresultMalloc(result, desc->desc_len + 1);
+		memcpy(desc->desc, var1->sqlname, desc->desc_len + 1);
+		desc->desc_dsplen = FQdspstrlen(desc->desc, FQclientEncodingId(conn));
+
+		if (var1->aliasname_length == var1->sqlname_length
+			&& strncmp(var1->aliasname, var1->sqlname, var1->aliasname_length ) == 0)
+		{
+			desc->alias_len = 0;
+			desc->alias = NULL;
+		}
+		else
+		{
+			desc->alias_len = var1->aliasname_length;
+			desc->alias = (char *)_FQresultMalloc(result, desc->alias_len + 1);
+			memcpy(desc->alias, var1->aliasname, desc->alias_len + 1);
+			desc->alias_dsplen = FQdspstrlen(desc->alias, FQclientEncodingId(conn));
+		}
+
+		/* store table name, if set */
+		if (var1->relname_length)
+		{
+			desc->relname_len = var1->relname_length;
+			desc->relname = (char *)_FQresultMalloc(result, desc->relname_len + 1);
+			memset(desc->relname, '\0', desc->relname_len + 1);
+			strncpy(desc->relname, var1->relname, desc->relname_len);
+		}
+		else
+		{
+			desc->relname_len = 0;
+			desc->relname = NULL;
+		}
+
+		desc->att_max_len = 0;
+		desc->att_max_line_len = 0;
+
+		/* Firebird returns RDB$DB_KEY as "DB_KEY" - set the pseudo-datatype */
+		if (strncmp(desc->desc, "DB_KEY", 6) == 0 && strlen(desc->desc) == 6)
+			desc->type = SQL_DB_KEY;
+		else
+			desc->type = var1->sqltype & ~1;
+
+		desc->has_null = false;
+		result->header[i] = desc;
+	}
+}
+
+
+static void
+_FQstoreResult(FBresult *result, FBconn *conn, int num_rows)
+{
+	int64_t store_start = _FQstatsClock(result);
+	FQresTuple *tuple_next = (FQresTuple *)_FQresultMalloc(result, sizeof(FQresTuple));
+	int i;
+
+	tuple_next->position = num_rows;
+	tuple_next->max_lines = 1;
+	tuple_next->next = NULL;
+	tuple_next->values = _FQresultMalloc(result, sizeof(FQresTupleAtt *) * result->ncols);
+
+	/* Store tuple data */
+	for (i = 0; i < result->ncols; i++)
+	{
+		XSQLVAR *var = (XSQLVAR *)&result->sqlda_out->sqlvar[i];
+		FQresTupleAtt *tuple_att = _FQformatDatum(conn, result, result->header[i], var);
+
+		if (tuple_att->lines > tuple_next->max_lines)
+		{
+			tuple_next->max_lines = tuple_att->lines;
+		}
+
+		if (tuple_att->value == NULL)
+		{
+			result->header[i]->has_null = true;
+		}
+		else
+		{
+			if (tuple_att->dsplen > result->header[i]->att_max_len)
+			{
+				result->header[i]->att_max_len = tuple_att->dsplen;
+			}
+
+			if (tuple_att->dsplen_line > result->header[i]->att_max_line_len)
+			{
+				result->header[i]->att_max_line_len = tuple_att->dsplen_line;
+			}
+		}
+
+		tuple_next->values[i] = tuple_att;
+	}
+
+	if (result->tuple_first == NULL)
+	{
+		result->tuple_first = tuple_next;
+		result->tuple_last = result->tuple_first;
+	}
+	else
+	{
+		result->tuple_last->next = tuple_next;
+		result->tuple_last = tuple_next;
+	}
+
+	if (result->stats != NULL)
+	{
+		result->stats->rows_fetched++;
+		result->stats->allocations += 2 + result->ncols;
+		result->stats->format_usecs += _FQstatsClock(result) - store_start;
+	}
+}
+
+
+/**
+ * FQexecTransaction()
+ *
+ * Convenience function to execute a query using the internal
+ * transaction handle.
+ */
+FBresult *
+FQexecTransaction(FBconn *conn, const char *stmt)
+{
+	FBresult	  *result = NULL;
+
+	if (!conn)
+	{
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - invalid connection object");
+		_FQsetResultError(conn, result);
+
+		return result;
+	}
+
+	if (_FQstartTransaction(conn, &conn->trans_internal) == TRANS_ERROR)
+	{
+		result->resultStatus = FBRES_FATAL_ERROR;
+
+		/* XXX todo: set error */
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "transaction error");
+		isc_print_status(conn->status);
+
+		return result;
+	}
+
+	result = _FQexec(conn, &conn->trans_internal, stmt);
+
+	if (FQresultStatus(result) == FBRES_FATAL_ERROR)
+	{
+		/* XXX todo: set error */
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "query execution error");
+		isc_print_status(conn->status);
+		_FQrollbackTransaction(conn, &conn->trans_internal);
+	}
+	/* Non-select query */
+	else if (FQresultStatus(result) == FBRES_COMMAND_OK)
+	{
+		// TODO: show some meaningful output?
+		if (_FQcommitTransaction(conn, &conn->trans_internal) == TRANS_ERROR)
+		{
+			/* XXX todo: set error */
+			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "transaction commit error");
+			isc_print_status(conn->status);
+			_FQrollbackTransaction(conn, &conn->trans_internal);
+		}
+	}
+	/* Query returning rows */
+	else if (FQresultStatus(result) == FBRES_TUPLES_OK)
+	{
+		_FQcommitTransaction(conn, &conn->trans_internal);
+	}
+
+	return result;
+}
+
+
+/**
+ * FQexecScript()
+ *
+ * Execute a script containing any number of statements, as accepted
+ * by isql/fbsql. Statements are separated by the current terminator
+ * (";" by default), which can be changed with "SET TERM"; PSQL
+ * blocks (EXECUTE BLOCK, and CREATE/ALTER/RECREATE of procedures,
+ * triggers, functions and packages) may also be provided without
+ * changing the terminator.
+ *
+ * All statements are executed back to back in the connection's current
+ * transaction, which is started if necessary. If autocommit is set and
+ * no user transaction is active, the transaction is committed when the
+ * script completes. As with isql's AUTODDL, DDL statements are committed
+ * (retaining the transaction context) as soon as they are executed, so
+ * subsequent statements can use the objects they create.
+ *
+ * Execution stops at the first failing statement; in autocommit mode
+ * the transaction is then rolled back.
+ *
+ * Returns a chain of results, one per executed statement, which can be
+ * traversed with FQnextResult(); FQclear() on the returned result frees
+ * the entire chain. Returns NULL when no server connection available.
+ */
+FBresult *
+FQexecScript(FBconn *conn, const char *script)
+{
+	FBresult	  *result_first = NULL;
+	FBresult	  *result_last = NULL;
+	char		  *stmt;
+	char		   term[32] = ";";
+	bool		   autocommit;
+	bool		   in_user_transaction;
+	bool		   failed = false;
+
+	if (!conn)
+		return NULL;
+
+	autocommit = conn->autocommit;
+	in_user_transaction = conn->in_user_transaction;
+
+	if (conn->trans == 0L && _FQstartTransaction(conn, &conn->trans) == TRANS_ERROR)
+	{
+		_FQsaveMessageField(&result_first, FB_DIAG_DEBUG, "error - unable to start transaction");
+		_FQsetResultError(conn, result_first);
+		result_first->resultStatus = FBRES_FATAL_ERROR;
+
+		return result_first;
+	}
+
+	/* prevent _FQexec() and friends from committing after each statement */
+	conn->autocommit = false;
+	conn->in_user_transaction = true;
+
+	while (failed == false && (stmt = _FQexecScriptNextStatement(&script, term)) != NULL)
+	{
+		FBresult *result;
+
+		if (_FQexecScriptIsSetTerm(stmt, term, sizeof(term)) == true)
+		{
+			_FQfree(stmt);
+			continue;
+		}
+
+		result = _FQexec(conn, &conn->trans, stmt);
+
+		if (FQresultStatus(result) == FBRES_FATAL_ERROR)
+		{
+			failed = true;
+		}
+		else if (_FQexecGuessStatementType(stmt) == isc_info_sql_stmt_ddl && conn->trans != 0L)
+		{
+			conn->metrics.commits++;
+
+			if (FB_TRACE(conn, "isc_commit_retaining", isc_commit_retaining(conn->status, &conn->trans)))
+			{
+				_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_commit_retaining");
+				_FQsetResultError(conn, result);
+				result->resultStatus = FBRES_FATAL_ERROR;
+				failed = true;
+			}
+		}
+
+		_FQfree(stmt);
+
+		if (result_first == NULL)
+			result_first = result;
+		else
+			result_last->next = result;
+
+		result_last = result;
+	}
+
+	conn->autocommit = autocommit;
+
+	if (autocommit == true && in_user_transaction == false)
+	{
+		if (conn->trans != 0L)
+		{
+			if (failed == true)
+				_FQrollbackTransaction(conn, &conn->trans);
+			else
+				_FQcommitTransaction(conn, &conn->trans);
+		}
+
+		conn->in_user_transaction = false;
+	}
+	else
+	{
+		conn->in_user_transaction = (conn->trans != 0L);
+	}
+
+	if (result_first == NULL)
+	{
+		result_first = _FQinitResult(conn, false);
+		result_first->resultStatus = FBRES_EMPTY_QUERY;
+		_FQexecClearResult(conn, result_first);
+	}
+
+	return result_first;
+}
+
+
+/**
+ * _FQexecScriptNextStatement()
+ *
+ * Extract the next statement from the script pointed to by 'script',
+ * which is advanced past the statement's terminator.
+ *
+ * Returns a newly allocated string containing the statement without its
+ * terminator, or NULL if the script contains no further statements.
+ */
+static char *
+_FQexecScriptNextStatement(const char **script, const char *term)
+{
+	const char *ptr = *script;
+	const char *start;
+	const char *end;
+	size_t		term_len = strlen(term);
+	char	   *stmt;
+
+	/* PSQL block handling is only needed while the terminator is ";" */
+	bool		check_psql = (strcmp(term, ";") == 0);
+	bool		is_psql = false;
+	bool		seen_as = false;
+	bool		in_body = false;
+	int			depth = 0;
+	int			word_count = 0;
+	bool		first_word_ddl = false;
+
+	/* skip leading whitespace and comments */
+	for (;;)
+	{
+		while (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')
+			ptr++;
+
+		if (ptr[0] == '-' && ptr[1] == '-')
+		{
+			while (*ptr && *ptr != '\n')
+				ptr++;
+		}
+		else if (ptr[0] == '/' && ptr[1] == '*')
+		{
+			const char *comment_end = strstr(ptr + 2, "*/");
+
+			ptr = comment_end ? comment_end + 2 : ptr + strlen(ptr);
+		}
+		else if (strncmp(ptr, term, term_len) == 0)
+		{
+			/* empty statement */
+			ptr += term_len;
+		}
+		else
+			break;
+	}
+
+	if (*ptr == '\0')
+	{
+		*script = ptr;
+		return NULL;
+	}
+
+	start = ptr;
+
+	while (*ptr)
+	{
+		/*
+		 * Inside a PSQL definition, terminators between "AS" and the
+		 * end of the body are part of the statement.
+		 */
+		if (depth == 0
+		 && (is_psql == false || seen_as == false || in_body == true)
+		 && strncmp(ptr, term, term_len) == 0)
+			break;
+
+		if (*ptr == '\'' || *ptr == '"')
+		{
+			char quote = *ptr++;
+
+			while (*ptr && *ptr != quote)
+				ptr++;
+			if (*ptr)
+				ptr++;
+		}
+		else if (ptr[0] == '-' && ptr[1] == '-')
+		{
+			while (*ptr && *ptr != '\n')
+				ptr++;
+		}
+		else if (ptr[0] == '/' && ptr[1] == '*')
+		{
+			const char *comment_end = strstr(ptr + 2, "*/");
+
+			ptr = comment_end ? comment_end + 2 : ptr + strlen(ptr);
+		}
+		else if ((*ptr >= 'A' && *ptr <= 'Z') || (*ptr >= 'a' && *ptr <= 'z') || *ptr == '_')
+		{
+			const char *word = ptr;
+			int			word_len;
+
+			while ((*ptr >= 'A' && *ptr <= 'Z') || (*ptr >= 'a' && *ptr <= 'z')
+				|| (*ptr >= '0' && *ptr <= '9') || *ptr == '_' || *ptr == '$')
+				ptr++;
+
+			word_len = ptr - word;
+
+			if (check_psql == false)
+				continue;
+
+			/* identify PSQL from the leading keywords */
+			if (word_count < 4)
+			{
+				if (word_count == 0)
+				{
+					first_word_ddl = (word_len == 6 && strncasecmp(word, "CREATE", 6) == 0)
+						|| (word_len == 5 && strncasecmp(word, "ALTER", 5) == 0)
+						|| (word_len == 8 && strncasecmp(word, "RECREATE", 8) == 0);
+				}
+				else if (word_count == 1 && word_len == 5 && strncasecmp(word, "BLOCK", 5) == 0
+					  && strncasecmp(start, "EXECUTE", 7) == 0)
+				{
+					is_psql = true;
+				}
+				else if (first_word_ddl == true
+					  && ((word_len == 9 && strncasecmp(word, "PROCEDURE", 9) == 0)
+					   || (word_len == 7 && strncasecmp(word, "TRIGGER", 7) == 0)
+					   || (word_len == 8 && strncasecmp(word, "FUNCTION", 8) == 0)
+					   || (word_len == 7 && strncasecmp(word, "PACKAGE", 7) == 0)))
+				{
+					is_psql = true;
+				}
+
+				word_count++;
+			}
+
+			if (is_psql == false)
+				continue;
+
+			if (depth == 0 && word_len == 2 && strncasecmp(word, "AS", 2) == 0)
+			{
+				seen_as = true;
+			}
+			else if (word_len == 5 && strncasecmp(word, "BEGIN", 5) == 0)
+			{
+				depth++;
+				in_body = true;
+			}
+			else if (word_len == 4 && strncasecmp(word, "CASE", 4) == 0)
+			{
+				depth++;
+			}
+			else if (word_len == 3 && strncasecmp(word, "END", 3) == 0)
+			{
+				if (depth > 0)
+					depth--;
+			}
+		}
+		else
+			ptr++;
+	}
+
+	end = ptr;
+	*script = *ptr ? ptr + term_len : ptr;
+
+	while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r'))
+		end--;
+
+	stmt = (char *)_FQmalloc(end - start + 1);
+	memcpy(stmt, start, end - start);
+	stmt[end - start] = '\0';
+
+	return stmt;
+}
+
+
+/**
+ * _FQexecScriptIsSetTerm()
+ *
+ * Determine whether the statement is an isql "SET TERM" command; if so,
+ * store the new terminator in 'term'.
+ */
+static bool
+_FQexecScriptIsSetTerm(const char *stmt, char *term, size_t term_size)
+{
+	const char *ptr = stmt;
+	size_t		term_len;
+
+	if (strncasecmp(ptr, "SET", 3) != 0 || (ptr[3] != ' ' && ptr[3] != '\t' && ptr[3] != '\n' && ptr[3] != '\r'))
+		return false;
+
+	ptr += 3;
+	while (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')
+		ptr++;
+
+	if (strncasecmp(ptr, "TERM", 4) != 0 || (ptr[4] != ' ' && ptr[4] != '\t' && ptr[4] != '\n' && ptr[4] != '\r'))
+		return false;
+
+	ptr += 4;
+	while (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')
+		ptr++;
+
+	term_len = strcspn(ptr, " \t\n\r");
+
+	if (term_len == 0 || term_len >= term_size)
+		return false;
+
+	memcpy(term, ptr, term_len);
+	term[term_len] = '\0';
+
+	return true;
+}
+
+
+/**
+ * FQcopyOut()
+ *
+ * Execute a query and write the rows it returns to the file descriptor
+ * "fd" in CSV or tab-separated text format, analogous to PostgreSQL's
+ * COPY ... TO. Rows are formatted as they are fetched and written in
+ * blocks, so the result set is never held in memory.
+ *
+ * "options" may be NULL, in which case CSV format without a header line
+ * is used; see FQcopyOptions for details.
+ *
+ * Returns NULL when no server connection available, otherwise an
+ * FBresult with status FBRES_COMMAND_OK on success, or FBRES_FATAL_ERROR
+ * if the query could not be executed or the output could not be written.
+ * The result never contains any tuples.
+ */
+FBresult *
+FQcopyOut(FBconn *conn, const char *stmt, int fd, const FQcopyOptions *options)
+{
+	FBresult	  *result;
+	FQcopyOptions  opts;
+	FQExpBufferData buf;
+	short		  *types;
+	int			   i;
+	long		   fetch_stat;
+	bool		   write_ok = true;
+
+	if (!conn)
+		return NULL;
+
+	_FQcopyInitOptions(options, &opts);
+
+	result = _FQinitResult(conn, false);
+
+	if (_FQexecOpenCursor(conn, result, stmt) == false)
+		return result;
+
+	/* Determine each column's type, as in _FQstoreResult() */
+	types = (short *)_FQmalloc(sizeof(short) * result->ncols);
+
+	initFQExpBuffer(&buf);
+
+	for (i = 0; i < result->ncols; i++)
 	{
-		_FQstartTransaction(conn, trans);
-		temp_trans = true;
+		XSQLVAR *var = &result->sqlda_out->sqlvar[i];
+
+		if (var->sqlname_length == 6 && strncmp(var->sqlname, "DB_KEY", 6) == 0)
+			types[i] = SQL_DB_KEY;
+		else
+			types[i] = var->sqltype & ~1;
+
+		if (opts.header == true)
+		{
+			if (i > 0)
+				appendFQExpBufferChar(&buf, opts.delimiter);
+
+			_FQcopyAppendValue(&buf, var->aliasname, var->aliasname_length, &opts);
+		}
 	}
 
-	/* Prepare the statement. */
-	if (isc_dsql_prepare(conn->status, trans, &result->stmt_handle, 0, stmt, SQL_DIALECT_V6, result->sqlda_out))
+	if (opts.header == true)
+		appendFQExpBufferChar(&buf, '\n');
+
+	while ((fetch_stat = FB_TRACE(conn, "isc_dsql_fetch", isc_dsql_fetch(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out))) == 0)
 	{
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_prepare");
+		for (i = 0; i < result->ncols; i++)
+		{
+			XSQLVAR *var = &result->sqlda_out->sqlvar[i];
+			char *value;
+			int len;
 
-		_FQsetResultError(conn, result);
+			if (i > 0)
+				appendFQExpBufferChar(&buf, opts.delimiter);
 
-		_FQrollbackTransaction(conn, trans);
+			if ((var->sqltype & 1) && (*var->sqlind < 0))
+			{
+				appendFQExpBufferStr(&buf, opts.null_string);
+				continue;
+			}
+
+			if (types[i] == SQL_DB_KEY)
+			{
+				value = _FQparseDbKey(var->sqldata);
+				appendFQExpBufferStr(&buf, value);
+				_FQfree(value);
+				continue;
+			}
+
+			value = _FQformatValue(conn, result, types[i], var, &len);
+
+			if (len < 0)
+				len = strlen(value);
+
+			_FQcopyAppendValue(&buf, value, len, &opts);
+		}
+
+		appendFQExpBufferChar(&buf, '\n');
+
+		/* formatted values are only needed until they have been copied to the buffer */
+		_FQresultResetValues(result);
+
+		if (buf.len >= FB_COPY_BUFFER_SIZE)
+		{
+			write_ok = _FQcopyWrite(fd, &buf);
+
+			if (write_ok == false)
+				break;
+		}
+	}
+
+	_FQfree(types);
+
+	if (write_ok == true && fetch_stat != 100L)
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_fetch error");
+		_FQsetResultError(conn, result);
+		result->resultStatus = FBRES_FATAL_ERROR;
+	}
+	else if (write_ok == false || _FQcopyWrite(fd, &buf) == false)
+	{
+		_FQsetResultLibraryError(conn, result, "could not write output: %s", strerror(errno));
 		result->resultStatus = FBRES_FATAL_ERROR;
+	}
+	else
+	{
+		result->resultStatus = FBRES_COMMAND_OK;
+	}
 
-		_FQexecClearResult(result);
+	termFQExpBuffer(&buf);
 
-		return result;
+	if (conn->autocommit == true && conn->in_user_transaction == false)
+	{
+		if (result->resultStatus == FBRES_COMMAND_OK)
+			_FQcommitTransaction(conn, &conn->trans);
+		else
+			_FQrollbackTransaction(conn, &conn->trans);
 	}
 
-	/* If a temporary transaction was previously created, roll it back */
-	if (temp_trans == true)
+	_FQexecClearResult(conn, result);
+	return result;
+}
+
+
+/**
+ * _FQexecOpenCursor()
+ *
+ * Prepare and execute a query whose rows are to be processed as they are
+ * fetched, rather than stored in the result, starting a transaction if
+ * none is active.
+ *
+ * On success, the statement's output SQLDA is ready for isc_dsql_fetch().
+ * Otherwise, the error is stored in "result" and the transaction rolled
+ * back in autocommit mode, and false is returned.
+ */
+static bool
+_FQexecOpenCursor(FBconn *conn, FBresult *result, const char *stmt)
+{
+	_FQtraceStatement(conn, stmt);
+
+	if (_FQallocStatement(conn, &result->stmt_handle))
 	{
-		_FQrollbackTransaction(conn, trans);
-		temp_trans = false;
+		result->resultStatus = FBRES_FATAL_ERROR;
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_allocate_statement");
+		_FQsetResultError(conn, result);
+
+		_FQexecClearResult(conn, result);
+		return false;
 	}
 
-	/* Determine the statement's type */
-	if (isc_dsql_sql_info(conn->status, &result->stmt_handle, sizeof (stmt_info), stmt_info, sizeof (info_buffer), info_buffer))
+	/* begin transaction, if none set */
+	if (conn->trans == 0L)
 	{
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_sql_info");
+		_FQstartTransaction(conn, &conn->trans);
+
+		if (conn->autocommit == false)
+			conn->in_user_transaction = true;
+	}
 
+	conn->metrics.prepares++;
+
+	if (FB_TRACE(conn, "isc_dsql_prepare", isc_dsql_prepare(conn->status, &conn->trans, &result->stmt_handle, 0, stmt, SQL_DIALECT_V6, result->sqlda_out)))
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_prepare");
 		_FQsetResultError(conn, result);
 
-		_FQrollbackTransaction(conn, trans);
+		if (conn->autocommit == true && conn->in_user_transaction == false)
+			_FQrollbackTransaction(conn, &conn->trans);
+
 		result->resultStatus = FBRES_FATAL_ERROR;
+		_FQexecClearResult(conn, result);
+		return false;
+	}
 
-		_FQexecClearResult(result);
-		return result;
+	result->ncols = result->sqlda_out->sqld;
+
+	if (result->ncols == 0)
+	{
+		_FQsetResultLibraryError(conn, result, "statement does not return rows");
+
+		if (conn->autocommit == true && conn->in_user_transaction == false)
+			_FQrollbackTransaction(conn, &conn->trans);
+
+		result->resultStatus = FBRES_FATAL_ERROR;
+		_FQexecClearResult(conn, result);
+		return false;
 	}
 
-	statement_type = _FQexecParseStatementType((char *) info_buffer);
+	/* Expand sqlda to required number of columns */
+	if (result->sqlda_out->sqln < result->ncols)
+	{
+		_FQresultAllocSQLDA(result, &result->sqlda_out, result->ncols);
 
-	/* Query will not return rows */
-	if (!result->sqlda_out->sqld)
+		if (FB_TRACE(conn, "isc_dsql_describe", isc_dsql_describe(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out)))
+		{
+			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_describe");
+			_FQsetResultError(conn, result);
+
+			if (conn->autocommit == true && conn->in_user_transaction == false)
+				_FQrollbackTransaction(conn, &conn->trans);
+
+			result->resultStatus = FBRES_FATAL_ERROR;
+			_FQexecClearResult(conn, result);
+			return false;
+		}
+	}
+
+	_FQexecInitOutputSQLDA(conn, result);
+
+	if (result->resultStatus == FBRES_FATAL_ERROR)
 	{
-		/* Handle explicit SET TRANSACTION */
-		if (statement_type == isc_info_sql_stmt_start_trans)
+		if (conn->autocommit == true && conn->in_user_transaction == false)
+			_FQrollbackTransaction(conn, &conn->trans);
+
+		return false;
+	}
+
+	if (FB_TRACE(conn, "isc_dsql_execute", isc_dsql_execute(conn->status, &conn->trans, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out)))
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_execute error");
+		_FQsetResultError(conn, result);
+
+		if (conn->autocommit == true && conn->in_user_transaction == false)
+			_FQrollbackTransaction(conn, &conn->trans);
+
+		result->resultStatus = FBRES_FATAL_ERROR;
+		_FQexecClearResult(conn, result);
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * _FQcopyInitOptions()
+ *
+ * Copy the caller's FQcopyOptions (which may be NULL) to "opts",
+ * filling in the defaults for the chosen format.
+ */
+static void
+_FQcopyInitOptions(const FQcopyOptions *options, FQcopyOptions *opts)
+{
+	if (options != NULL)
+		*opts = *options;
+	else
+		memset(opts, 0, sizeof(FQcopyOptions));
+
+	if (opts->delimiter == '\0')
+		opts->delimiter = opts->format == FQCOPY_FORMAT_CSV ? ',' : '\t';
+
+	if (opts->quote == '\0')
+		opts->quote = '"';
+
+	if (opts->null_string == NULL)
+		opts->null_string = opts->format == FQCOPY_FORMAT_CSV ? "" : "\\N";
+}
+
+
+/**
+ * _FQcopyAppendValue()
+ *
+ * Append a value to the output buffer, quoting it (CSV format) or
+ * escaping special characters with backslashes (text format) as required.
+ */
+static void
+_FQcopyAppendValue(FQExpBuffer buf, const char *value, int len, const FQcopyOptions *opts)
+{
+	const char *ptr;
+	const char *end = value + len;
+
+	if (opts->format == FQCOPY_FORMAT_CSV)
+	{
+		bool needs_quote = false;
+
+		/*
+		 * Quote values which would otherwise be read back as NULL, or
+		 * which contain characters with special meaning
+		 */
+		if (len == (int)strlen(opts->null_string) && strncmp(value, opts->null_string, len) == 0)
+			needs_quote = true;
+
+		for (ptr = value; ptr < end && needs_quote == false; ptr++)
 		{
-			if (*trans != 0L)
-			{
-				_FQsetResultNonFatalError(conn, result, WARNING, "Currently in transaction");
-				result->resultStatus = FBRES_EMPTY_QUERY;
-			}
-			else
-			{
-				_FQstartTransaction(conn, trans);
-				conn->in_user_transaction = true;
-				result->resultStatus = FBRES_TRANSACTION_START;
-			}
+			if (*ptr == opts->delimiter || *ptr == opts->quote || *ptr == '\n' || *ptr == '\r')
+				needs_quote = true;
+		}
 
-			_FQexecClearResult(result);
-			return result;
+		if (needs_quote == false)
+		{
+			appendBinaryFQExpBuffer(buf, value, len);
+			return;
 		}
 
-		/* Handle explicit COMMIT */
-		if (statement_type == isc_info_sql_stmt_commit)
+		appendFQExpBufferChar(buf, opts->quote);
+
+		for (ptr = value; ptr < end; ptr++)
 		{
-			 if (*trans == 0L)
-			{
-				_FQsetResultNonFatalError(conn, result, WARNING, "Not currently in transaction");
-				result->resultStatus = FBRES_EMPTY_QUERY;
-			}
-			else
-			{
-				_FQcommitTransaction(conn, trans);
-				result->resultStatus = FBRES_TRANSACTION_COMMIT;
-			}
+			if (*ptr == opts->quote)
+				appendFQExpBufferChar(buf, opts->quote);
+
+			appendFQExpBufferChar(buf, *ptr);
+		}
+
+		appendFQExpBufferChar(buf, opts->quote);
+		return;
+	}
+
+	for (ptr = value; ptr < end; ptr++)
+	{
+		switch (*ptr)
+		{
+			case '\\':
+				appendFQExpBufferStr(buf, "\\\\");
+				break;
+			case '\n':
+				appendFQExpBufferStr(buf, "\\n");
+				break;
+			case '\r':
+				appendFQExpBufferStr(buf, "\\r");
+				break;
+			case '\t':
+				appendFQExpBufferStr(buf, "\\t");
+				break;
+			default:
+				if (*ptr == opts->delimiter)
+					appendFQExpBufferChar(buf, '\\');
+
+				appendFQExpBufferChar(buf, *ptr);
+		}
+	}
+}
+
+
+/**
+ * _FQcopyAppendIdentifier()
+ *
+ * Append a column name read from the input to the INSERT statement.
+ * A name which is a valid regular identifier is appended as-is, so it
+ * is matched case-insensitively as if written in SQL; any other name
+ * is appended as a delimited identifier with embedded double quotes
+ * doubled, so that the input can never alter the statement text.
+ */
+static void
+_FQcopyAppendIdentifier(FQExpBuffer buf, const char *name)
+{
+	const char *ptr;
+	bool regular = (*name >= 'A' && *name <= 'Z') || (*name >= 'a' && *name <= 'z');
+
+	for (ptr = name; *ptr != '\0' && regular == true; ptr++)
+	{
+		if (!((*ptr >= 'A' && *ptr <= 'Z') || (*ptr >= 'a' && *ptr <= 'z') ||
+			  (*ptr >= '0' && *ptr <= '9') || *ptr == '_' || *ptr == '$'))
+			regular = false;
+	}
+
+	if (regular == true)
+	{
+		appendFQExpBufferStr(buf, name);
+		return;
+	}
+
+	appendFQExpBufferChar(buf, '"');
+
+	for (ptr = name; *ptr != '\0'; ptr++)
+	{
+		if (*ptr == '"')
+			appendFQExpBufferChar(buf, '"');
+
+		appendFQExpBufferChar(buf, *ptr);
+	}
+
+	appendFQExpBufferChar(buf, '"');
+}
+
+
+/**
+ * _FQcopyWrite()
+ *
+ * Write the contents of the output buffer to "fd" and empty the buffer.
+ * Returns false if the data could not be written, with errno set.
+ */
+static bool
+_FQcopyWrite(int fd, FQExpBuffer buf)
+{
+	size_t written = 0;
+
+	while (written < buf->len)
+	{
+		ssize_t rc = write(fd, buf->data + written, buf->len - written);
+
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		written += rc;
+	}
+
+	resetFQExpBuffer(buf);
+
+	return true;
+}
+
+
+/*
+ * State for reading and parsing the input of FQcopyIn()
+ */
+struct FQcopyInState
+{
+	int				fd;
+	FQcopyOptions	opts;
+	FQExpBufferData input;			/* data read from "fd" */
+	size_t			input_pos;		/* start of the first unparsed record in "input" */
+	bool			eof;
+	FQExpBufferData fields;			/* values of the current record, each NUL-terminated */
+	int			   *offsets;		/* offset of each value in "fields", or -1 for NULL */
+	int				offsets_size;
+	int				nfields;
+	int				line;			/* line number of the start of the current record */
+	int				next_line;
+};
+
+
+/**
+ * FQcopyIn()
+ *
+ * Read CSV or tab-separated text data from the file descriptor "fd" and
+ * insert it into "table", analogous to PostgreSQL's COPY ... FROM.
+ *
+ * "columns" is a NULL-terminated array of the names of the columns
+ * corresponding to the input fields. If NULL, the names in the header
+ * line are used if the "header" option is set, otherwise values are
+ * inserted into the table's columns in order. Header names which are
+ * not regular identifiers are quoted as delimited identifiers.
+ *
+ * The INSERT statement is prepared once, and each row is bound directly
+ * to its input SQLDA using the same conversions as FQexecParams().
+ *
+ * In autocommit mode the rows are committed every "batch_size" rows (if
+ * set) and when the input has been processed; if an error occurs, rows
+ * since the last commit are rolled back. Within a user transaction no
+ * commits are made.
+ *
+ * "options" may be NULL, in which case CSV format without a header line
+ * is expected; see FQcopyOptions for details.
+ *
+ * Returns NULL when no server connection available, otherwise an
+ * FBresult with status FBRES_COMMAND_OK on success, or FBRES_FATAL_ERROR.
+ */
+FBresult *
+FQcopyIn(FBconn *conn, const char *table, const char * const *columns, int fd, const FQcopyOptions *options)
+{
+	FBresult	  *result;
+	FQcopyInState  state;
+	FQExpBufferData sql;
+	XSQLVAR		  *var;
+	short		  *sqltypes = NULL;
+	short		  *sqlsubtypes = NULL;
+	short		  *sqllens = NULL;
+	char		   error_message[1024];
+	long		   rows = 0;
+	int			   nparams = 0;
+	int			   rc;
+	int			   i;
+	bool		   batch_commit;
 
-			 /* conn->in_user_transaction is only set if an explicit SET TRANSACTION
-			  * command is passed to _FQexec */
-			 if (conn->in_user_transaction == true)
-				 conn->in_user_transaction = false;
+	if (!conn)
+		return NULL;
 
-			_FQexecClearResult(result);
-			return result;
-		}
+	result = _FQinitResult(conn, true);
 
-		/* Handle explit ROLLBACK */
-		if (statement_type == isc_info_sql_stmt_rollback)
-		{
-			if (*trans == 0L)
-			{
-				_FQsetResultNonFatalError(conn, result, WARNING, "Not currently in transaction");
-				result->resultStatus = FBRES_EMPTY_QUERY;
-			}
-			else
-			{
-				_FQrollbackTransaction(conn, trans);
-				result->resultStatus = FBRES_TRANSACTION_ROLLBACK;
-			}
+	memset(&state, 0, sizeof(FQcopyInState));
+	state.fd = fd;
+	state.next_line = 1;
+	_FQcopyInitOptions(options, &state.opts);
+	initFQExpBuffer(&state.input);
+	initFQExpBuffer(&state.fields);
 
-			/* conn->in_user_transaction is only set if an explicit SET TRANSACTION
-			 * command is passed to _FQexec */
-			if (conn->in_user_transaction == true)
-				conn->in_user_transaction = false;
-			_FQexecClearResult(result);
-			return result;
-		}
+	/* batches are only committed if the caller has not started a transaction */
+	batch_commit = (conn->autocommit == true && conn->in_user_transaction == false);
 
-		/* Handle DDL statement */
-		if (statement_type == isc_info_sql_stmt_ddl)
-		{
-			FQlog(conn, DEBUG1, "statement_type is DDL");
+	/* The first record determines the column list, if not provided */
+	rc = _FQcopyReadRecord(&state);
 
-			temp_trans = false;
-			if (*trans == 0L)
-			{
-				_FQstartTransaction(conn, trans);
-				temp_trans = true;
-			}
+	if (rc == 1 && state.opts.header == true && columns != NULL)
+		rc = _FQcopyReadRecord(&state);
 
-			if (isc_dsql_execute(conn->status, trans,  &result->stmt_handle, SQL_DIALECT_V6, NULL))
-			{
-				_FQrollbackTransaction(conn, trans);
-				_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error executing DDL");
-				_FQsetResultError(conn, result);
+	initFQExpBuffer(&sql);
+	appendFQExpBuffer(&sql, "INSERT INTO %s", table);
 
-				result->resultStatus = FBRES_FATAL_ERROR;
+	if (columns != NULL)
+	{
+		for (nparams = 0; columns[nparams] != NULL; nparams++)
+			appendFQExpBuffer(&sql, "%s%s", nparams == 0 ? " (" : ", ", columns[nparams]);
 
-				_FQexecClearResult(result);
-				return result;
-			}
+		appendFQExpBufferChar(&sql, ')');
+	}
+	else if (rc == 1)
+	{
+		nparams = state.nfields;
 
-			if ((conn->autocommit == true && conn->in_user_transaction == false) || temp_trans == true)
+		if (state.opts.header == true)
+		{
+			for (i = 0; i < nparams; i++)
 			{
-				_FQcommitTransaction(conn, trans);
+				appendFQExpBufferStr(&sql, i == 0 ? " (" : ", ");
+				_FQcopyAppendIdentifier(&sql, state.offsets[i] < 0 ? "" : state.fields.data + state.offsets[i]);
 			}
 
-			result->resultStatus = FBRES_COMMAND_OK;
-
-			_FQexecClearResult(result);
-			return result;
+			appendFQExpBufferChar(&sql, ')');
 		}
+	}
 
+	appendFQExpBufferStr(&sql, " VALUES (");
 
-		if (*trans == 0L)
-		{
-			_FQstartTransaction(conn, trans);
-
-			if (conn->autocommit == false)
-				conn->in_user_transaction = true;
-		}
+	for (i = 0; i < nparams; i++)
+		appendFQExpBufferStr(&sql, i == 0 ? "?" : ", ?");
 
-		if (isc_dsql_execute(conn->status, trans,  &result->stmt_handle, SQL_DIALECT_V6, NULL))
-		{
-			FQlog(conn, DEBUG1, "error executing non-SELECT");
-			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error executing non-SELECT");
-			_FQsetResultError(conn, result);
+	appendFQExpBufferChar(&sql, ')');
 
-			result->resultStatus = FBRES_FATAL_ERROR;
-			_FQexecClearResult(result);
-			return result;
-		}
+	_FQtraceStatement(conn, sql.data);
 
-		if (conn->autocommit == true && conn->in_user_transaction == false)
-		{
-			_FQcommitTransaction(conn, trans);
-		}
+	if (rc == 1 && state.opts.header == true && columns == NULL)
+		rc = _FQcopyReadRecord(&state);
 
+	/* Nothing to do if the input is empty */
+	if (rc == 0)
+	{
 		result->resultStatus = FBRES_COMMAND_OK;
-		_FQexecClearResult(result);
-		return result;
+		goto copy_in_done;
 	}
 
-	/* begin transaction, if none set */
+	if (rc < 0)
+		goto copy_in_input_error;
 
-	if (*trans == 0L)
+	if (_FQallocStatement(conn, &result->stmt_handle))
 	{
-		_FQstartTransaction(conn, trans);
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_allocate_statement");
+		_FQsetResultError(conn, result);
+		result->resultStatus = FBRES_FATAL_ERROR;
+		goto copy_in_end_transaction;
+	}
+
+	if (conn->trans == 0L)
+	{
+		_FQstartTransaction(conn, &conn->trans);
 
 		if (conn->autocommit == false)
 			conn->in_user_transaction = true;
 	}
 
-	if (isc_dsql_describe(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out))
+	conn->metrics.prepares++;
+
+	if (FB_TRACE(conn, "isc_dsql_prepare", isc_dsql_prepare(conn->status, &conn->trans, &result->stmt_handle, 0, sql.data, SQL_DIALECT_V6, NULL)))
 	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_prepare");
 		_FQsetResultError(conn, result);
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_describe");
-
 		result->resultStatus = FBRES_FATAL_ERROR;
-
-		_FQexecClearResult(result);
-		return result;
+		goto copy_in_end_transaction;
 	}
 
+	if (FB_TRACE(conn, "isc_dsql_describe_bind", isc_dsql_describe_bind(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in)))
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_describe_bind");
+		_FQsetResultError(conn, result);
+		result->resultStatus = FBRES_FATAL_ERROR;
+		goto copy_in_end_transaction;
+	}
 
+	if (result->sqlda_in->sqld > result->sqlda_in->sqln)
+	{
+		int sqln = result->sqlda_in->sqld;
 
-	/* Expand sqlda to required number of columns */
-	result->ncols = result->sqlda_out->sqld;
-
-	if (result->sqlda_out->sqln < result->ncols) {
-
-		free(result->sqlda_out);
-		result->sqlda_out = (XSQLDA *) malloc(XSQLDA_LENGTH (result->ncols));
-		memset(result->sqlda_out, '\0', XSQLDA_LENGTH (result->ncols));
-
-		result->sqlda_out->version = SQLDA_VERSION1;
-		result->sqlda_out->sqln = result->ncols;
+		_FQresultAllocSQLDA(result, &result->sqlda_in, sqln);
 
-		if (isc_dsql_describe(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out))
+		if (FB_TRACE(conn, "isc_dsql_describe_bind", isc_dsql_describe_bind(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in)))
 		{
+			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_describe_bind");
 			_FQsetResultError(conn, result);
-			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_describe");
-
 			result->resultStatus = FBRES_FATAL_ERROR;
-
-			_FQexecClearResult(result);
-			return result;
+			goto copy_in_end_transaction;
 		}
-
-		result->ncols = result->sqlda_out->sqld;
 	}
 
-	_FQexecInitOutputSQLDA(conn, result);
+	/*
+	 * _FQexecBindParam() may change the type of a parameter, so note the
+	 * described types to restore them for each row
+	 */
+	sqltypes = (short *)_FQmalloc(sizeof(short) * nparams);
+	sqlsubtypes = (short *)_FQmalloc(sizeof(short) * nparams);
+	sqllens = (short *)_FQmalloc(sizeof(short) * nparams);
 
-	if (isc_dsql_execute(conn->status, trans, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out))
+	for (i = 0, var = result->sqlda_in->sqlvar; i < nparams; i++, var++)
 	{
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_execute error");
+		sqltypes[i] = var->sqltype;
+		sqlsubtypes[i] = var->sqlsubtype;
+		sqllens[i] = var->sqllen;
+		var->sqldata = NULL;
+		var->sqlind = NULL;
+	}
 
-		result->resultStatus = FBRES_FATAL_ERROR;
-		_FQsetResultError(conn, result);
+	for (; rc == 1; rc = _FQcopyReadRecord(&state))
+	{
+		if (state.nfields != nparams)
+		{
+			_FQsetResultLibraryError(conn, result, "line %i: expected %i fields, found %i",
+									 state.line, nparams, state.nfields);
+			result->resultStatus = FBRES_FATAL_ERROR;
+			break;
+		}
 
-		/* if autocommit, and no explicit transaction set, rollback */
-		if (conn->autocommit == true && conn->in_user_transaction == false)
+		for (i = 0, var = result->sqlda_in->sqlvar; i < nparams; i++, var++)
 		{
-			_FQrollbackTransaction(conn, trans);
+			var->sqltype = sqltypes[i];
+			var->sqlsubtype = sqlsubtypes[i];
+			var->sqllen = sqllens[i];
+
+			if (_FQexecBindParam(conn, var,
+								 state.offsets[i] < 0 ? NULL : state.fields.data + state.offsets[i],
+								 0, error_message) == false)
+			{
+				_FQsetResultLibraryError(conn, result, "line %i: %s", state.line, error_message);
+				result->resultStatus = FBRES_FATAL_ERROR;
+				break;
+			}
 		}
 
-		_FQexecClearResult(result);
-		return result;
-	}
+		if (result->resultStatus == FBRES_FATAL_ERROR)
+			break;
 
-	/* set up tuple holder */
+		if (FB_TRACE(conn, "isc_dsql_execute", isc_dsql_execute(conn->status, &conn->trans, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in)))
+		{
+			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_execute at line %i", state.line);
+			_FQsetResultError(conn, result);
+			result->resultStatus = FBRES_FATAL_ERROR;
+			break;
+		}
 
-	result->tuple_first = NULL;
-	result->tuple_last = NULL;
+		_FQexecClearSQLDA(result, result->sqlda_in);
+		rows++;
 
-	result->header = malloc(sizeof(FQresTupleAttDesc *) * result->ncols);
+		if (batch_commit == true && state.opts.batch_size > 0 && rows % state.opts.batch_size == 0)
+		{
+			conn->metrics.commits++;
 
-	while ((fetch_stat = isc_dsql_fetch(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out)) == 0)
-	{
-		_FQstoreResult(result, conn, num_rows);
-		num_rows++;
+			if (FB_TRACE(conn, "isc_commit_retaining", isc_commit_retaining(conn->status, &conn->trans)))
+			{
+				_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_commit_retaining");
+				_FQsetResultError(conn, result);
+				result->resultStatus = FBRES_FATAL_ERROR;
+				break;
+			}
+		}
 	}
 
-	result->resultStatus = FBRES_TUPLES_OK;
-	result->ntups = num_rows;
+	if (result->resultStatus != FBRES_FATAL_ERROR)
+		result->resultStatus = FBRES_COMMAND_OK;
 
-	/* add an array of tuple pointers for offset-based access */
-	_FQexecFillTuplesArray(result);
+	/* restore the described types so the SQLDA storage is freed correctly */
+	for (i = 0, var = result->sqlda_in->sqlvar; i < nparams; i++, var++)
+		var->sqltype = sqltypes[i];
 
-	/* if autocommit, and no explicit transaction set, commit */
-	if (conn->autocommit == true && conn->in_user_transaction == false)
+copy_in_end_transaction:
+	if (batch_commit == true && conn->trans != 0L)
 	{
-		_FQcommitTransaction(conn, trans);
+		if (result->resultStatus == FBRES_COMMAND_OK && rc == 0)
+			_FQcommitTransaction(conn, &conn->trans);
+		else
+			_FQrollbackTransaction(conn, &conn->trans);
 	}
 
-	/* clear up internal storage */
-	_FQexecClearResult(result);
-	return result;
-}
+copy_in_input_error:
+	if (rc == -1)
+	{
+		_FQsetResultLibraryError(conn, result, "could not read input: %s", strerror(errno));
+		result->resultStatus = FBRES_FATAL_ERROR;
+	}
+	else if (rc == -2)
+	{
+		_FQsetResultLibraryError(conn, result, "line %i: unterminated quoted field", state.line);
+		result->resultStatus = FBRES_FATAL_ERROR;
+	}
 
+copy_in_done:
+	if (sqltypes != NULL)
+	{
+		_FQfree(sqltypes);
+		_FQfree(sqlsubtypes);
+		_FQfree(sqllens);
+	}
 
-/**
- * FQexecParams()
- *
- * Execute a parameterized query.
- *
- * conn
- *   - a valid connection
- * stmt
- *   - a string containing the SQL to be executed
- * nParams
- *   - number of parameters supplied and should be the same as
- *     the length of the various arrays supplied (note: currently
- *     this argument is advisory and primarily for compatiblity
- *     with the libpq method PQexecParams(), however it may
- *     be used in the future)
- * paramTypes[]
- *   - (currently unused)
- * paramValues[]
- *   - actual query parameter values
- * paramLengths[]
- *   - (currently unused)
- * paramFormats[]
- *   - optional array to specify whether parameters are passed as
- *     strings (array entry is 0) or a text string to be converted
- *     to an RDB$DB_KEY value (array entry is -1). Binary formats
- *     may be supported in the future.
- * resultFormat
- *   - (currently unused)
- */
-FBresult *
-FQexecParams(FBconn *conn,
-			 const char *stmt,
-			 int nParams,
-			 const int *paramTypes,
-			 const char * const *paramValues,
-			 const int *paramLengths,
-			 const int *paramFormats,
-			 int resultFormat)
-{
-	if (!conn)
-		return NULL;
+	if (state.offsets != NULL)
+		_FQfree(state.offsets);
 
-	return _FQexecParams(conn,
-						 &conn->trans,
-						 stmt,
-						 nParams,
-						 paramTypes,
-						 paramValues,
-						 paramLengths,
-						 paramFormats,
-						 resultFormat);
+	termFQExpBuffer(&state.input);
+	termFQExpBuffer(&state.fields);
+	termFQExpBuffer(&sql);
+
+	_FQexecClearResult(conn, result);
+	return result;
 }
 
 
 /**
- * _FQexecParams()
+ * _FQcopyReadRecord()
  *
- * Actually execute the parameterized query. See above for parameter
- * details.
+ * Read the next record from the input of FQcopyIn(), storing its values
+ * in state->fields and their offsets in state->offsets.
  *
- * Be warned, this was a pain to kludge together (oh Firebird C API, how
- * I love your cryptic minimalism) and is in dire need of refactoring.
- * But it works. Mostly.
+ * Returns 1 if a record was read, 0 at the end of the input, -1 if the
+ * input could not be read (with errno set), or -2 if the input ended
+ * within a quoted CSV field.
  */
-FBresult *
-_FQexecParams(FBconn *conn,
-			  isc_tr_handle *trans,
-			  const char *stmt,
-			  int nParams,
-			  const int *paramTypes,
-			  const char * const *paramValues,
-			  const int *paramLengths,
-			  const int *paramFormats,
-			  int resultFormat
-	)
+static int
+_FQcopyReadRecord(FQcopyInState *state)
 {
-	FBresult	 *result;
-	XSQLVAR		 *var;
-	bool		  temp_trans = false;
-	int			  i;
-
-	long		  fetch_stat;
-	char		  info_buffer[20];
-	static char	  stmt_info[] = { isc_info_sql_stmt_type };
-	int			  statement_type;
-	int			  exec_result;
-	char		  error_message[1024];
-
-	result = _FQinitResult(true);
+	state->line = state->next_line;
 
-	/* Allocate a statement. */
-	if (isc_dsql_alloc_statement2(conn->status, &conn->db, &result->stmt_handle))
+	for (;;)
 	{
-		result->resultStatus = FBRES_FATAL_ERROR;
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_allocate_statement");
-		_FQsetResultError(conn, result);
+		size_t remaining = state->input.len - state->input_pos;
+		ssize_t nread;
+
+		if (remaining > 0)
+		{
+			int consumed = _FQcopyParseRecord(state);
 
-		_FQexecClearResult(result);
-		return result;
-	}
+			if (consumed > 0)
+			{
+				const char *data = state->input.data + state->input_pos;
+				const char *end = data + consumed;
+				const char *newline;
 
+				/* quoted values may span lines */
+				while ((newline = memchr(data, '\n', end - data)) != NULL)
+				{
+					state->next_line++;
+					data = newline + 1;
+				}
 
-	/* An active transaction is required to prepare the statement -
-	 * if no transaction handle was provided by the caller,
-	 * start a temporary transaction
-	 */
-	if (*trans == 0L)
-	{
-		_FQstartTransaction(conn, trans);
-		temp_trans = true;
-	}
+				state->input_pos += consumed;
+				return 1;
+			}
 
-	/* Prepare the statement. */
-	if (isc_dsql_prepare(conn->status, trans, &result->stmt_handle, 0, stmt, SQL_DIALECT_V6, NULL))
-	{
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_prepare");
+			if (state->eof == true)
+				return -2;
+		}
+		else if (state->eof == true)
+		{
+			return 0;
+		}
 
-		_FQsetResultError(conn, result);
+		/* discard the parsed data and read some more */
+		if (state->input_pos > 0)
+		{
+			memmove(state->input.data, state->input.data + state->input_pos, remaining);
+			state->input.len = remaining;
+			state->input.data[remaining] = '\0';
+			state->input_pos = 0;
+		}
 
-		_FQrollbackTransaction(conn, trans);
+		if (enlargeFQExpBuffer(&state->input, FB_COPY_BUFFER_SIZE) == 0)
+		{
+			errno = ENOMEM;
+			return -1;
+		}
 
-		result->resultStatus = FBRES_FATAL_ERROR;
+		do
+		{
+			nread = read(state->fd,
+						 state->input.data + state->input.len,
+						 state->input.maxlen - state->input.len - 1);
+		} while (nread < 0 && errno == EINTR);
 
-		_FQexecClearResult(result);
-		return result;
-	}
+		if (nread < 0)
+			return -1;
 
-	if (temp_trans == true)
-	{
-		_FQrollbackTransaction(conn, trans);
-		temp_trans = false;
+		if (nread == 0)
+			state->eof = true;
+
+		state->input.len += nread;
+		state->input.data[state->input.len] = '\0';
 	}
+}
 
-	/* Determine the statement's type */
-	if (isc_dsql_sql_info(conn->status, &result->stmt_handle, sizeof (stmt_info), stmt_info, sizeof (info_buffer), info_buffer))
+
+/**
+ * _FQcopyParseRecord()
+ *
+ * Parse the record at the start of the unparsed input. Returns the
+ * number of bytes it occupies, including the line ending, or 0 if the
+ * record is incomplete and more input is required.
+ *
+ * In CSV format, an unquoted value matching the NULL string represents
+ * NULL, and quotes within quoted values are doubled. In text format,
+ * any value matching the NULL string represents NULL, and special
+ * characters are escaped with backslashes.
+ */
+static int
+_FQcopyParseRecord(FQcopyInState *state)
+{
+	const char *data = state->input.data + state->input_pos;
+	size_t		len = state->input.len - state->input_pos;
+	size_t		pos = 0;
+	size_t		null_len = strlen(state->opts.null_string);
+	bool		csv = (state->opts.format == FQCOPY_FORMAT_CSV);
+	char		delimiter = state->opts.delimiter;
+	char		quote = state->opts.quote;
+
+	resetFQExpBuffer(&state->fields);
+	state->nfields = 0;
+
+	for (;;)
 	{
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_sql_info");
+		size_t	field_start = pos;
+		int		offset = state->fields.len;
+		bool	quoted = false;
 
-		_FQsetResultError(conn, result);
+		if (csv == true && pos < len && data[pos] == quote)
+		{
+			quoted = true;
+			pos++;
 
-		_FQrollbackTransaction(conn, trans);
-		result->resultStatus = FBRES_FATAL_ERROR;
+			for (;;)
+			{
+				const char *next_quote = memchr(data + pos, quote, len - pos);
 
-		_FQexecClearResult(result);
-		return result;
-	}
+				if (next_quote == NULL)
+					return 0;
 
-	statement_type = _FQexecParseStatementType((char *) info_buffer);
+				appendBinaryFQExpBuffer(&state->fields, data + pos, next_quote - (data + pos));
+				pos = next_quote - data + 1;
 
-	FQlog(conn, DEBUG1, "statement_type: %i", statement_type);
+				/* need to see the following character to know if the quote is doubled */
+				if (pos == len && state->eof == false)
+					return 0;
 
-	switch(statement_type)
-	{
-		case isc_info_sql_stmt_insert:
-		case isc_info_sql_stmt_update:
-		case isc_info_sql_stmt_delete:
-		case isc_info_sql_stmt_select:
-		case isc_info_sql_stmt_exec_procedure:
-			/* INSERT ... RETURNING ... */
-			break;
+				if (pos < len && data[pos] == quote)
+				{
+					appendFQExpBufferChar(&state->fields, quote);
+					pos++;
+					continue;
+				}
 
-		default:
-			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - stmt type is not DML");
+				break;
+			}
+		}
 
-			_FQsetResultError(conn, result);
+		/* unquoted value, or any text following a quoted value */
+		while (pos < len)
+		{
+			size_t	span = pos;
 
-			_FQrollbackTransaction(conn, trans);
-			result->resultStatus = FBRES_FATAL_ERROR;
+			while (span < len
+				   && data[span] != delimiter
+				   && data[span] != '\n'
+				   && data[span] != '\r'
+				   && (csv == true || data[span] != '\\'))
+				span++;
 
-			_FQexecClearResult(result);
-			return result;
-	}
+			appendBinaryFQExpBuffer(&state->fields, data + pos, span - pos);
+			pos = span;
 
-	if (isc_dsql_describe_bind(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in))
-	{
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_describe_bind");
-		_FQsetResultError(conn, result);
-		result->resultStatus = FBRES_FATAL_ERROR;
+			if (pos == len || data[pos] != '\\')
+				break;
 
-		_FQrollbackTransaction(conn, trans);
+			/* backslash escape in text format */
+			if (pos + 1 == len)
+			{
+				if (state->eof == false)
+					return 0;
 
-		_FQexecClearResult(result);
-		return result;
-	}
+				pos++;
+				break;
+			}
 
-	if (*trans == 0L)
-	{
-		FQlog(conn, DEBUG1, "_FQexecParams: starting transaction...");
-		_FQstartTransaction(conn, trans);
+			switch (data[pos + 1])
+			{
+				case 'n':
+					appendFQExpBufferChar(&state->fields, '\n');
+					break;
+				case 'r':
+					appendFQExpBufferChar(&state->fields, '\r');
+					break;
+				case 't':
+					appendFQExpBufferChar(&state->fields, '\t');
+					break;
+				default:
+					appendFQExpBufferChar(&state->fields, data[pos + 1]);
+			}
 
-		if (conn->autocommit == false)
-			conn->in_user_transaction = true;
-	}
+			pos += 2;
+		}
 
-	if (result->sqlda_in->sqld > result->sqlda_in->sqln)
-	{
-		int sqln = result->sqlda_in->sqld;
+		if (pos == len && state->eof == false)
+			return 0;
 
-		free(result->sqlda_in);
-		result->sqlda_in = (XSQLDA *)malloc(XSQLDA_LENGTH(sqln));
-		memset(result->sqlda_in, '\0', XSQLDA_LENGTH(sqln));
-		result->sqlda_in->sqln = sqln;
-		result->sqlda_in->version = SQLDA_VERSION1;
-		isc_dsql_describe_bind(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in);
+		if (state->nfields == state->offsets_size)
+		{
+			state->offsets_size = state->offsets_size ? state->offsets_size * 2 : 16;
+			state->offsets = (int *)_FQrealloc(state->offsets, sizeof(int) * state->offsets_size);
+		}
 
-		FQlog(conn, DEBUG1, "%lu; sqln now %i %i", XSQLDA_LENGTH(sqln), sqln, result->sqlda_in->sqld );
-	}
+		if (quoted == false
+			&& pos - field_start == null_len
+			&& strncmp(data + field_start, state->opts.null_string, null_len) == 0)
+		{
+			state->offsets[state->nfields++] = -1;
+		}
+		else
+		{
+			state->offsets[state->nfields++] = offset;
+		}
 
-	/* from dbdimp.c - not sure what it's about, but note here
-	 * in case we encounter a similiar issue */
-	/* workaround for date problem (bug #429820)
-	if (dtype == SQL_TEXT)
-	{
-		if (ivar->sqlsubtype == 0x77)
-			dtype = SQL_TIMESTAMP;
-	}
-	*/
+		appendFQExpBufferChar(&state->fields, '\0');
 
-	for (i = 0, var = result->sqlda_in->sqlvar; i < result->sqlda_in->sqld; i++, var++)
-	{
-		int dtype = (var->sqltype & ~1); /* drop flag bit for now */
+		if (pos == len)
+			return pos;
 
-		int len = 0;
+		if (data[pos] == delimiter)
+		{
+			pos++;
+			continue;
+		}
 
-		var->sqldata = NULL;
-		var->sqllen = 0;
+		/* end of line */
+		if (data[pos] == '\r')
+		{
+			if (pos + 1 == len && state->eof == false)
+				return 0;
 
-		if (paramFormats != NULL)
-			FQlog(conn, DEBUG1, "%i: %s", i, paramValues[i]);
+			pos++;
 
-		/* For NULL values, initialise empty sqldata/sqllen */
-		if (paramValues[i] == NULL)
+			if (pos < len && data[pos] == '\n')
+				pos++;
+		}
+		else
 		{
-			int size = -1;
+			pos++;
+		}
 
-			switch(dtype)
-			{
-				case SQL_SHORT:
-					size = sizeof(ISC_SHORT);
-					break;
+		return pos;
+	}
+}
 
-				case SQL_LONG:
-					size = sizeof(ISC_LONG);
-					break;
 
-				case SQL_INT64:
-					size = sizeof(ISC_INT64);
-					break;
+/**
+ * FQexecJSON()
+ *
+ * Execute a query and pass the rows it returns, serialised as a JSON
+ * array of objects, to the callback "writer" in chunks of around
+ * FB_COPY_BUFFER_SIZE bytes. The output is the same as that of
+ * FQresultToJSON(), but rows are serialised as they are fetched rather
+ * than stored in the result.
+ *
+ * Returns NULL when no server connection available, otherwise an
+ * FBresult with status FBRES_COMMAND_OK on success, or FBRES_FATAL_ERROR
+ * if the query failed or the writer returned false. The result never
+ * contains any rows.
+ */
+FBresult *
+FQexecJSON(FBconn *conn, const char *stmt, FQjsonWriter writer, void *arg)
+{
+	FBresult	  *result;
+	FQExpBufferData buf;
+	FQExpBufferData keys;
+	int			  *key_offsets;
+	short		  *types;
+	int			   i;
+	long		   fetch_stat;
+	long		   rows = 0;
+	bool		   write_ok = true;
 
-				case SQL_FLOAT:
-					size = sizeof(float);
-					break;
+	if (!conn)
+		return NULL;
 
-				case SQL_DOUBLE:
-					size = sizeof(double);
-					break;
+	result = _FQinitResult(conn, false);
 
-				case SQL_VARYING:
-					size = 0;
-					break;
+	if (_FQexecOpenCursor(conn, result, stmt) == false)
+		return result;
 
-				case SQL_TEXT:
-					size = 0;
-					break;
+	/* Determine each column's type, as in _FQstoreResult(), and its key */
+	types = (short *)_FQmalloc(sizeof(short) * result->ncols);
+	key_offsets = (int *)_FQmalloc(sizeof(int) * (result->ncols + 1));
 
-				case SQL_TIMESTAMP:
-					size = sizeof(ISC_TIMESTAMP);
-					break;
+	initFQExpBuffer(&buf);
+	initFQExpBuffer(&keys);
 
-				case SQL_TYPE_DATE:
-					size = sizeof(ISC_DATE);
-					break;
+	for (i = 0; i < result->ncols; i++)
+	{
+		XSQLVAR *var = &result->sqlda_out->sqlvar[i];
 
-				case SQL_TYPE_TIME:
-					size = sizeof(ISC_TIME);
-					break;
+		if (var->sqlname_length == 6 && strncmp(var->sqlname, "DB_KEY", 6) == 0)
+			types[i] = SQL_DB_KEY;
+		else
+			types[i] = var->sqltype & ~1;
 
-				case SQL_BLOB:
-					size = sizeof(ISC_QUAD);
-					break;
+		key_offsets[i] = keys.len;
+		_FQjsonAppendKey(&keys, i, var->aliasname, var->aliasname_length);
+	}
 
-#if defined SQL_BOOLEAN
-				/* Firebird 3.0 and later */
-				case SQL_BOOLEAN:
-					size = sizeof(FB_BOOLEAN);
-					break;
-#endif
+	key_offsets[i] = keys.len;
 
-				default:
-					sprintf(error_message, "Unhandled sqlda_in type: %i", dtype);
+	appendFQExpBufferChar(&buf, '[');
+
+	while ((fetch_stat = FB_TRACE(conn, "isc_dsql_fetch", isc_dsql_fetch(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out))) == 0)
+	{
+		if (rows++ > 0)
+			appendFQExpBufferStr(&buf, ",\n");
+
+		appendFQExpBufferChar(&buf, '{');
 
-					_FQsetResultError(conn, result);
-					_FQsaveMessageField(&result, FB_DIAG_DEBUG, error_message);
+		for (i = 0; i < result->ncols; i++)
+		{
+			XSQLVAR *var = &result->sqlda_out->sqlvar[i];
+			char *value;
+			int len;
 
-					result->resultStatus = FBRES_FATAL_ERROR;
+			appendBinaryFQExpBuffer(&buf, keys.data + key_offsets[i], key_offsets[i + 1] - key_offsets[i]);
 
-					_FQexecClearResult(result);
+			if ((var->sqltype & 1) && (*var->sqlind < 0))
+			{
+				appendFQExpBufferStr(&buf, "null");
+				continue;
 			}
 
-			if (size >= 0)
+			if (types[i] == SQL_DB_KEY)
 			{
-				var->sqldata = (char *)malloc(size);
-				var->sqllen = size;
+				value = _FQparseDbKey(var->sqldata);
+				_FQjsonAppendString(&buf, value, strlen(value));
+				_FQfree(value);
+				continue;
 			}
+
+			value = _FQformatValue(conn, result, types[i], var, &len);
+
+			if (len < 0)
+				len = strlen(value);
+
+			_FQjsonAppendValue(&buf, types[i], value, len);
 		}
-		else
-		{
-			switch(dtype)
-			{
-				case SQL_SHORT:
-				case SQL_LONG:
-				{
-					char format[64];
-					long p, q, r, result;
-					const char *svalue;
 
-					p = q = r = (long) 0;
-					svalue = paramValues[i];
-					len = strlen(svalue);
+		appendFQExpBufferChar(&buf, '}');
 
-					/* with decimals? */
-					if (var->sqlscale < 0)
-					{
-						/* NUMERIC(?,?) */
-						int	 scale = (int) (pow(10.0, (double) -var->sqlscale));
-						int	 dscale;
-						char *tmp;
-						char *neg;
-
-						FQlog(conn, DEBUG1, "sqlscale < 0; scale is %i", scale);
-
-						sprintf(format, "%%ld.%%%dld%%1ld", -var->sqlscale);
-
-						/* negative -0.x hack */
-						neg = strchr(svalue, '-');
-						if (neg)
-						{
-							svalue = neg + 1;
-							len = strlen(svalue);
-						}
-
-						if (!sscanf(svalue, format, &p, &q, &r))
-						{
-							/* here we handle values such as .78 passed as string */
-							sprintf(format, ".%%%dld%%1ld", -var->sqlscale);
-							if (!sscanf(svalue, format, &q, &r) )
-								FQlog(conn, DEBUG1, "problem parsing SQL_SHORT/SQL_LONG type");
-						}
-
-						/* Round up if r is 5 or greater */
-						if (r >= 5)
-						{
-							q++;			/* round q up by one */
-							p += q / scale; /* round p up by one if q overflows */
-							q %= scale;		/* modulus if q overflows */
-						}
-
-						/* decimal scaling */
-						tmp	   = strchr(svalue, '.');
-						dscale = (tmp)
-							? -var->sqlscale - (len - (int) (tmp - svalue)) + 1
-							: 0;
-
-						if (dscale < 0) dscale = 0;
-
-						/* final result */
-						result = (long) (p * scale + q * (int) (pow(10.0, (double) dscale))) * (neg ? -1 : 1);
-						FQlog(conn, DEBUG1, "SQL_SHORT/LONG: decimal result is %li", result);
-					}
-					else
-					{
-						/* numeric(?,0): scan for one decimal and do rounding*/
+		/* formatted values are only needed until they have been copied to the buffer */
+		_FQresultResetValues(result);
 
-						sprintf(format, "%%ld.%%1ld");
+		if (buf.len >= FB_COPY_BUFFER_SIZE)
+		{
+			write_ok = _FQjsonWrite(&buf, writer, arg);
 
-						if (!sscanf(svalue, format, &p, &r))
-						{
-							sprintf(format, ".%%1ld");
-							if (!sscanf(svalue, format, &r))
-								FQlog(conn, DEBUG1, "problem parsing SQL_SHORT/SQL_LONG type");
-						}
+			if (write_ok == false)
+				break;
+		}
+	}
 
-						/* rounding */
-						if (r >= 5)
-						{
-							if (p < 0) p--; else p++;
-						}
+	_FQfree(types);
+	_FQfree(key_offsets);
+	termFQExpBuffer(&keys);
 
-						result = (long) p;
-					}
+	if (write_ok == true && fetch_stat != 100L)
+	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_fetch error");
+		_FQsetResultError(conn, result);
+		result->resultStatus = FBRES_FATAL_ERROR;
+	}
+	else
+	{
+		if (write_ok == true)
+		{
+			appendFQExpBufferStr(&buf, "]\n");
+			write_ok = _FQjsonWrite(&buf, writer, arg);
+		}
 
-					if (dtype == SQL_SHORT)
-					{
-						var->sqldata = (char *)malloc(sizeof(ISC_SHORT));
-						var->sqllen = sizeof(ISC_SHORT);
-						*(ISC_SHORT *) (var->sqldata) = (ISC_SHORT) result;
-					}
-					else
-					{
-						var->sqldata = (char *)malloc(sizeof(ISC_LONG));
-						var->sqllen = sizeof(ISC_LONG);
-						*(ISC_LONG *) (var->sqldata) = (ISC_LONG) result;
-					}
+		if (write_ok == false)
+		{
+			_FQsetResultLibraryError(conn, result, "JSON output aborted by writer");
+			result->resultStatus = FBRES_FATAL_ERROR;
+		}
+		else
+		{
+			result->resultStatus = FBRES_COMMAND_OK;
+		}
+	}
 
-					break;
-				}
+	termFQExpBuffer(&buf);
 
-				case SQL_INT64:
-				{
-					const char	   *svalue;
-					char	 format[64];
-					ISC_INT64 p, q, r;
+	if (conn->autocommit == true && conn->in_user_transaction == false)
+	{
+		if (result->resultStatus == FBRES_COMMAND_OK)
+			_FQcommitTransaction(conn, &conn->trans);
+		else
+			_FQrollbackTransaction(conn, &conn->trans);
+	}
 
-					FQlog(conn, DEBUG1, "INT64");
-					var->sqldata = (char *)malloc(sizeof(ISC_INT64));
-					memset(var->sqldata, '\0', sizeof(ISC_INT64));
+	_FQexecClearResult(conn, result);
+	return result;
+}
 
-					p = q = r = (ISC_INT64) 0;
-					svalue = paramValues[i];
-					len = strlen(svalue);
 
-					/* with decimals? */
-					if (var->sqlscale < 0)
-					{
-						/* numeric(?,?) */
-						int	 scale = (int) (pow(10.0, (double) -var->sqlscale));
-						int	 dscale;
-						char *tmp;
-						char *neg;
-
-						sprintf(format, S_INT64_FULL, -var->sqlscale);
-
-						/* negative -0.x hack */
-						neg = strchr(svalue, '-');
-						if (neg)
-						{
-							svalue = neg + 1;
-							len = strlen(svalue);
-						}
-
-						if (!sscanf(svalue, format, &p, &q, &r))
-						{
-							/* here we handle values such as .78 passed as string */
-							sprintf(format, S_INT64_DEC_FULL, -var->sqlscale);
-							if (!sscanf(svalue, format, &q, &r))
-								FQlog(conn, DEBUG1, "problem parsing SQL_INT64 type");
-						}
-
-						/* Round up if r is 5 or greater */
-						if (r >= 5)
-						{
-							q++;			/* round q up by one */
-							p += q / scale; /* round p up by one if q overflows */
-							q %= scale;		/* modulus if q overflows */
-						}
-
-						/* decimal scaling */
-						tmp	   = strchr(svalue, '.');
-						dscale = (tmp)
-							? -var->sqlscale - (len - (int) (tmp - svalue)) + 1
-							: 0;
-
-						if (dscale < 0)
-							dscale = 0;
-
-						*(ISC_INT64 *) (var->sqldata) = (ISC_INT64) (p * scale + q * (int) (pow(10.0, (double) dscale))) * (neg? -1: 1);
-						var->sqllen = sizeof(ISC_INT64);
-					}
-					else
-					{
-						/* NUMERIC(?,0): scan for one decimal and do rounding */
+/**
+ * _FQjsonAppendString()
+ *
+ * Append "value" to "buf" as a quoted JSON string. Runs of characters
+ * which need no escaping are copied in one go; bytes from 0x80 upwards
+ * are copied unchanged, so the value is expected to be UTF-8 encoded.
+ */
+static void
+_FQjsonAppendString(FQExpBuffer buf, const char *value, int len)
+{
+	const unsigned char *p = (const unsigned char *)value;
+	const unsigned char *end = p + len;
+	const unsigned char *run = p;
 
-						sprintf(format, S_INT64_NOSCALE);
+	appendFQExpBufferChar(buf, '"');
 
-						if (!sscanf(svalue, format, &p, &r))
-						{
-							sprintf(format, S_INT64_DEC_NOSCALE);
-							if (!sscanf(svalue, format, &r))
-								FQlog(conn, DEBUG1, "problem parsing SQL_INT64 type");
-						}
+	for (; p < end; p++)
+	{
+		if (*p >= 0x20 && *p != '"' && *p != '\\')
+			continue;
 
-						/* rounding */
-						if (r >= 5)
-						{
-							if (p < 0) p--; else p++;
-						}
+		if (p > run)
+			appendBinaryFQExpBuffer(buf, (const char *)run, p - run);
 
-						*(ISC_INT64 *) (var->sqldata) = (ISC_INT64) p;
-						var->sqllen = sizeof(ISC_INT64);
-					}
+		switch (*p)
+		{
+			case '"':
+				appendFQExpBufferStr(buf, "\\\"");
+				break;
+			case '\\':
+				appendFQExpBufferStr(buf, "\\\\");
+				break;
+			case '\n':
+				appendFQExpBufferStr(buf, "\\n");
+				break;
+			case '\r':
+				appendFQExpBufferStr(buf, "\\r");
+				break;
+			case '\t':
+				appendFQExpBufferStr(buf, "\\t");
+				break;
+			case '\b':
+				appendFQExpBufferStr(buf, "\\b");
+				break;
+			case '\f':
+				appendFQExpBufferStr(buf, "\\f");
+				break;
+			default:
+				appendFQExpBuffer(buf, "\\u%04x", *p);
+		}
 
-					break;
-				}
+		run = p + 1;
+	}
 
-				case SQL_FLOAT:
-					var->sqldata = (char *)malloc(sizeof(float));
-					var->sqllen = sizeof(float);
-					*(float *)(var->sqldata) = (float)atof(paramValues[i]);
-					break;
+	if (p > run)
+		appendBinaryFQExpBuffer(buf, (const char *)run, p - run);
 
-				case SQL_DOUBLE:
-					var->sqldata = (char *)malloc(sizeof(double));
-					var->sqllen = sizeof(double);
-					*(double *) (var->sqldata) = atof(paramValues[i]);
-					break;
+	appendFQExpBufferChar(buf, '"');
+}
 
-				case SQL_VARYING:
-					var->sqltype = SQL_TEXT; /* need this */
-					len = strlen(paramValues[i]);
 
-					var->sqllen = len; /* need this */
-					var->sqldata = (char *)malloc(sizeof(char)*var->sqllen);
-					memcpy(var->sqldata, paramValues[i], len);
-					break;
+/**
+ * _FQjsonAppendKey()
+ *
+ * Append the key for column "column_number" to "buf", including the
+ * separator from the preceding value.
+ */
+static void
+_FQjsonAppendKey(FQExpBuffer buf, int column_number, const char *name, int len)
+{
+	if (column_number > 0)
+		appendFQExpBufferChar(buf, ',');
+
+	_FQjsonAppendString(buf, name, len);
+	appendFQExpBufferChar(buf, ':');
+}
 
-				case SQL_TEXT:
 
-					/* convert RDB$DB_KEY hex value to raw bytes if requested */
-					if (paramFormats != NULL && paramFormats[i] == -1)
-					{
-						unsigned char *sqlptr;
-						unsigned char *srcptr;
-						unsigned char *srcptr_ix;
-						unsigned char *srcptr_parsed;
-						int ix = 0;
+/**
+ * _FQjsonAppendValue()
+ *
+ * Append a formatted non-NULL value of the given datatype to "buf";
+ * numbers and booleans are emitted unquoted, everything else as a
+ * string.
+ */
+static void
+_FQjsonAppendValue(FQExpBuffer buf, short datatype, const char *value, int len)
+{
+	switch (datatype)
+	{
+		case SQL_SHORT:
+		case SQL_LONG:
+		case SQL_INT64:
+		case SQL_FLOAT:
+		case SQL_DOUBLE:
+			/* infinity and NaN have no JSON representation */
+			if (strspn(value, "0123456789+-.e") == (size_t)len)
+			{
+				appendBinaryFQExpBuffer(buf, value, len);
+				return;
+			}
+			break;
 
-						srcptr = (unsigned char *)_FQdeparseDbKey(paramValues[i]);
+#if defined SQL_BOOLEAN
+		case SQL_BOOLEAN:
+			appendFQExpBufferStr(buf, value[0] == 't' ? "true" : "false");
+			return;
+#endif
+	}
 
-						srcptr_parsed = _FQparseDbKey((char *)srcptr);
-						FQlog(conn, DEBUG1, "srcptr %s", srcptr_parsed);
-						free(srcptr_parsed);
+	_FQjsonAppendString(buf, value, len);
+}
 
-						len = 8;
-						var->sqllen = len;
-						var->sqldata = (char *)malloc(len);
 
-						sqlptr = (unsigned char *)var->sqldata ;
-						srcptr_ix = srcptr;
+/**
+ * _FQjsonWrite()
+ *
+ * Pass the contents of "buf" to the JSON writer callback and reset
+ * the buffer. Returns false if the writer did.
+ */
+static bool
+_FQjsonWrite(FQExpBuffer buf, FQjsonWriter writer, void *arg)
+{
+	bool ok = true;
 
-						for (ix = 0; ix < len; ix++)
-						{
-							*sqlptr++ = *srcptr_ix++;
-						}
+	if (buf->len > 0)
+		ok = writer(buf->data, buf->len, arg);
 
-						free(srcptr);
-					}
-					else
-					{
-						len = strlen(paramValues[i]);
-						var->sqldata = (char *)malloc(sizeof(char) * len);
-						var->sqllen = len;
-						memcpy(var->sqldata, paramValues[i], len);
-					}
+	resetFQExpBuffer(buf);
 
-					break;
+	return ok;
+}
 
-				case SQL_TIMESTAMP:
-				case SQL_TYPE_DATE:
-				case SQL_TYPE_TIME:
-					/* Here we coerce the time-related column types to CHAR,
-					 * causing Firebird to use its internal parsing mechanisms
-					 * to interpret the supplied literal
-					 */
-					len = strlen(paramValues[i]);
-					/* From dbimp.c: "workaround for date problem (bug #429820)" */
-					var->sqltype = SQL_TEXT;
-					var->sqlsubtype = 0x77;
-					var->sqllen = len;
-					var->sqldata = (char *)malloc(sizeof(char)*len);
-					memcpy(var->sqldata, paramValues[i], len);
 
-					break;
+/*
+ * Builds the Arrow arrays of one column of FQexecArrow()'s output
+ */
+struct FQarrowColumn
+{
+	short		datatype;		/* as determined by _FQstoreResult() */
+	char		format[32];		/* Arrow format string */
+	int			width;			/* bytes per value; 0 for variable-length values, -1 for a bitmap */
+	uint8_t	   *validity;
+	char	   *values;
+	int32_t	   *offsets;
+	FQExpBufferData data;		/* variable-length values */
+	int64_t		null_count;
+};
 
-				case SQL_BLOB:
-				{
-					/* must be initialised to NULL */
-					isc_blob_handle blob_handle = NULL;
-					char *ptr = (char *)paramValues[i];
 
-					len = strlen(paramValues[i]);
-					var->sqldata = (char *)malloc(sizeof(ISC_QUAD));
-					var->sqllen = sizeof(ISC_QUAD);
+/**
+ * FQexecArrow()
+ *
+ * Execute a query and pass the rows it returns to "callback" as record
+ * batches of up to "batch_rows" rows (FB_ARROW_BATCH_ROWS if 0) in the
+ * Arrow C data interface format, converted directly from the fetched
+ * values without formatting them as text.
+ *
+ * Each batch is a struct array with one child array per column, and is
+ * accompanied by its schema; the callback takes ownership of both, and
+ * must either move them or release them with their "release" callbacks
+ * before returning. Returning false from the callback aborts the query.
+ * If the query returns no rows, a single batch of length zero is passed,
+ * so the schema is always available.
+ *
+ * Types are mapped as follows:
+ *
+ *  - SMALLINT/INTEGER/BIGINT: int16/int32/int64, or decimal128 if scaled
+ *  - FLOAT/DOUBLE PRECISION: float32/float64
+ *  - DATE: date32; TIME: time64[us]; TIMESTAMP: timestamp[us]
+ *  - BOOLEAN: bool
+ *  - CHAR/VARCHAR: utf8, or binary for the OCTETS character set
+ *  - RDB$DB_KEY and all other types: utf8, formatted as by FQgetvalue()
+ *
+ * Returns NULL when no server connection available, otherwise an
+ * FBresult with status FBRES_COMMAND_OK on success, or FBRES_FATAL_ERROR
+ * if the query failed or the callback returned false. The result never
+ * contains any rows.
+ */
+FBresult *
+FQexecArrow(FBconn *conn, const char *stmt, int batch_rows, FQarrowBatchCallback callback, void *arg)
+{
+	FBresult	  *result;
+	FQarrowColumn *columns;
+	int			   nrows = 0;
+	int			   nbatches = 0;
+	int			   i;
+	long		   fetch_stat;
+	bool		   callback_ok = true;
 
-					isc_create_blob2(
-						conn->status,
-						&conn->db,
-						&conn->trans,
-						&blob_handle,
-						(ISC_QUAD *)var->sqldata,
-						0,		 /* Blob Parameter Buffer length = 0; no filter will be used */
-						NULL	 /* NULL Blob Parameter Buffer, since no filter will be used */
-						);
-					while (ptr < paramValues[i] + len)
-					{
-						int seg_len = BLOB_SEGMENT_LEN;
+	if (!conn)
+		return NULL;
 
-						if (ptr + seg_len > (paramValues[i] + len))
-						{
-							seg_len = (paramValues[i] + len) - ptr;
-						}
+	if (batch_rows <= 0)
+		batch_rows = FB_ARROW_BATCH_ROWS;
 
-						isc_put_segment(
-							conn->status,
-							&blob_handle,
-							seg_len,
-							ptr);
+	result = _FQinitResult(conn, false);
 
-						ptr += BLOB_SEGMENT_LEN;
-					}
-					isc_close_blob(conn->status, &blob_handle);
-					break;
-				}
+	if (_FQexecOpenCursor(conn, result, stmt) == false)
+		return result;
 
-#if defined SQL_BOOLEAN
-				/* Firebird 3.0 and later */
-				case SQL_BOOLEAN:
-					var->sqldata = (char *)malloc(sizeof(FB_BOOLEAN));
-					var->sqllen = sizeof(FB_BOOLEAN);
-
-					if (strncasecmp(paramValues[i], "0", 1) == 0)
-						*var->sqldata = FB_FALSE;
-					else if (strncasecmp(paramValues[i], "1", 1) == 0)
-						*var->sqldata = FB_TRUE;
-					else if (strncasecmp(paramValues[i], "false", 5) == 0)
-						*var->sqldata = FB_FALSE;
-					else if (strncasecmp(paramValues[i], "f", 1) == 0)
-						*var->sqldata = FB_FALSE;
-					else if (strncasecmp(paramValues[i], "true", 4) == 0)
-						*var->sqldata = FB_TRUE;
-					else if (strncasecmp(paramValues[i], "t", 1) == 0)
-						*var->sqldata = FB_TRUE;
-					else
-						*var->sqldata = FB_FALSE;
+	columns = (FQarrowColumn *)_FQmalloc(sizeof(FQarrowColumn) * result->ncols);
 
-					break;
-#endif
+	for (i = 0; i < result->ncols; i++)
+	{
+		_FQarrowInitColumn(conn, &columns[i], &result->sqlda_out->sqlvar[i]);
+		_FQarrowResetColumn(&columns[i], batch_rows);
+	}
 
-				default:
-					sprintf(error_message, "Unhandled sqlda_in type: %i", dtype);
+	while ((fetch_stat = FB_TRACE(conn, "isc_dsql_fetch", isc_dsql_fetch(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out))) == 0)
+	{
+		for (i = 0; i < result->ncols; i++)
+			_FQarrowAppendValue(conn, result, &columns[i], &result->sqlda_out->sqlvar[i], nrows);
 
-					_FQsetResultError(conn, result);
-					_FQsaveMessageField(&result, FB_DIAG_DEBUG, error_message);
+		_FQresultResetValues(result);
 
-					result->resultStatus = FBRES_FATAL_ERROR;
+		if (++nrows == batch_rows)
+		{
+			callback_ok = _FQarrowEmitBatch(result, columns, nrows, callback, arg);
+			nbatches++;
 
-					_FQexecClearResult(result);
-					return result;
-			}
-		}
+			if (callback_ok == false)
+				break;
 
-		if (var->sqltype & 1)
-		{
-			/* allocate variable to hold NULL status */
+			for (i = 0; i < result->ncols; i++)
+				_FQarrowResetColumn(&columns[i], batch_rows);
 
-			var->sqlind = (short *)malloc(sizeof(short));
-			*(short *)var->sqlind = (paramValues[i] == NULL) ? -1 : 0;
+			nrows = 0;
 		}
 	}
 
-	if (isc_dsql_describe(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out))
+	if (callback_ok == true && fetch_stat != 100L)
 	{
+		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_fetch error");
 		_FQsetResultError(conn, result);
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_describe");
-
 		result->resultStatus = FBRES_FATAL_ERROR;
-		_FQexecClearResult(result);
-		return result;
 	}
-
-	/* Expand output sqlda to required number of columns */
-	result->ncols = result->sqlda_out->sqld;
-
-	FQlog(conn, DEBUG2, "_FQexecParams(): ncols is %i", result->ncols);
-
-	/* No output expected */
-	if (!result->ncols)
+	else
 	{
-		if (isc_dsql_execute(conn->status, trans, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in))
-		{
-			FQlog(conn, DEBUG1, "isc_dsql_execute(): error");
-
-			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_execute() error");
+		/* always emit at least one batch, so the caller receives the schema */
+		if (callback_ok == true && (nrows > 0 || nbatches == 0))
+			callback_ok = _FQarrowEmitBatch(result, columns, nrows, callback, arg);
 
-			_FQsetResultError(conn, result);
+		if (callback_ok == false)
+		{
+			_FQsetResultLibraryError(conn, result, "Arrow output aborted by callback");
 			result->resultStatus = FBRES_FATAL_ERROR;
-
-			/* if autocommit, and no explicit transaction set, rollback */
-			if (conn->autocommit == true && conn->in_user_transaction == false)
-			{
-				_FQrollbackTransaction(conn, trans);
-			}
-
-			_FQexecClearResult(result);
-
-			isc_dsql_free_statement(conn->status, &result->stmt_handle, DSQL_drop);
-
-			return result;
 		}
-
-		FQlog(conn, DEBUG1, "_FQexecParams(): finished non-SELECT with no rows to return");
-		result->resultStatus = FBRES_COMMAND_OK;
-		if (conn->autocommit == true && conn->in_user_transaction == false)
+		else
 		{
-			FQlog(conn, DEBUG1, "committing...");
-			_FQcommitTransaction(conn, trans);
+			result->resultStatus = FBRES_COMMAND_OK;
 		}
+	}
 
-		_FQexecClearResult(result);
+	/* free the buffers of any batch not handed to the callback */
+	for (i = 0; i < result->ncols; i++)
+	{
+		_FQfree(columns[i].validity);
+		_FQfree(columns[i].values);
+		_FQfree(columns[i].offsets);
+		_FQfree(columns[i].data.data);
+	}
 
-		isc_dsql_free_statement(conn->status, &result->stmt_handle, DSQL_drop);
+	_FQfree(columns);
 
-		return result;
+	if (conn->autocommit == true && conn->in_user_transaction == false)
+	{
+		if (result->resultStatus == FBRES_COMMAND_OK)
+			_FQcommitTransaction(conn, &conn->trans);
+		else
+			_FQrollbackTransaction(conn, &conn->trans);
 	}
 
-	if (result->sqlda_out->sqln < result->ncols) {
-		free(result->sqlda_out);
-		result->sqlda_out = (XSQLDA *) malloc(XSQLDA_LENGTH (result->ncols));
-		memset(result->sqlda_out, '\0', XSQLDA_LENGTH (result->ncols));
-
-		result->sqlda_out->version = SQLDA_VERSION1;
-		result->sqlda_out->sqln = result->ncols;
+	_FQexecClearResult(conn, result);
+	return result;
+}
 
-		isc_dsql_describe(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out);
 
-		result->ncols = result->sqlda_out->sqld;
-	}
+/**
+ * _FQarrowInitColumn()
+ *
+ * Determine the Arrow type of a column from its XSQLVAR.
+ */
+static void
+_FQarrowInitColumn(FBconn *conn, FQarrowColumn *column, XSQLVAR *var)
+{
+	static const int decimal_precision[] = { 4, 9, 18 };
 
-	_FQexecInitOutputSQLDA(conn, result);
+	memset(column, 0, sizeof(FQarrowColumn));
 
-	/* "isc_info_sql_stmt_exec_procedure" also covers "RETURNING ..." statements */
-	if (statement_type == isc_info_sql_stmt_exec_procedure)
-		exec_result = isc_dsql_execute2(conn->status, trans, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in, result->sqlda_out);
+	if (var->sqlname_length == 6 && strncmp(var->sqlname, "DB_KEY", 6) == 0)
+		column->datatype = SQL_DB_KEY;
 	else
-		exec_result = isc_dsql_execute(conn->status, trans, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_in);
+		column->datatype = var->sqltype & ~1;
 
-	if (exec_result)
+	switch (column->datatype)
 	{
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "isc_dsql_execute2() error");
-
-		result->resultStatus = FBRES_FATAL_ERROR;
-		_FQsetResultError(conn, result);
+		case SQL_SHORT:
+		case SQL_LONG:
+		case SQL_INT64:
+			if (var->sqlscale < 0)
+			{
+				int precision = decimal_precision[column->datatype == SQL_SHORT ? 0 : column->datatype == SQL_LONG ? 1 : 2];
 
-		/* if autocommit, and no explicit transaction set, rollback */
-		if (conn->autocommit == true && conn->in_user_transaction == false)
-		{
-			_FQrollbackTransaction(conn, trans);
-		}
+				sprintf(column->format, "d:%i,%i", precision, -var->sqlscale);
+				column->width = 16;
+			}
+			else
+			{
+				strcpy(column->format, column->datatype == SQL_SHORT ? "s" : column->datatype == SQL_LONG ? "i" : "l");
+				column->width = var->sqllen;
+			}
+			break;
 
-		_FQexecClearResult(result);
-		isc_dsql_free_statement(conn->status, &result->stmt_handle, DSQL_drop);
+		case SQL_FLOAT:
+			strcpy(column->format, "f");
+			column->width = sizeof(float);
+			break;
 
-		return result;
-	}
+		case SQL_DOUBLE:
+			strcpy(column->format, "g");
+			column->width = sizeof(double);
+			break;
 
-	/* set up tuple holder */
-	result->tuple_first = NULL;
-	result->tuple_last = NULL;
+		case SQL_TYPE_DATE:
+			strcpy(column->format, "tdD");
+			column->width = sizeof(int32_t);
+			break;
 
-	result->header = malloc(sizeof(FQresTupleAttDesc *) * result->ncols);
+		case SQL_TYPE_TIME:
+			strcpy(column->format, "ttu");
+			column->width = sizeof(int64_t);
+			break;
 
-	/* XXX TODO: only needed for "SELECT ... FOR UPDATE " */
-	if (0 && isc_dsql_set_cursor_name(conn->status, &result->stmt_handle, "dyn_cursor", 0))
-	{
-		_FQsetResultError(conn, result);
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, error_message);
+		case SQL_TIMESTAMP:
+			strcpy(column->format, "tsu:");
+			column->width = sizeof(int64_t);
+			break;
 
-		result->resultStatus = FBRES_FATAL_ERROR;
+#if defined SQL_BOOLEAN
+		case SQL_BOOLEAN:
+			strcpy(column->format, "b");
+			column->width = -1;
+			break;
+#endif
 
-		_FQexecClearResult(result);
-		isc_dsql_free_statement(conn->status, &result->stmt_handle, DSQL_drop);
+		case SQL_TEXT:
+		case SQL_VARYING:
+			strcpy(column->format, (var->sqlsubtype & 0xff) == FBENC_OCTETS ? "z" : "u");
+			break;
 
-		return result;
+		default:
+			strcpy(column->format, "u");
 	}
+}
 
-	if (statement_type == isc_info_sql_stmt_exec_procedure)
+
+/**
+ * _FQarrowResetColumn()
+ *
+ * Allocate the buffers for a batch of up to "batch_rows" values.
+ */
+static void
+_FQarrowResetColumn(FQarrowColumn *column, int batch_rows)
+{
+	size_t bitmap_len = (batch_rows + 7) / 8;
+
+	column->validity = (uint8_t *)_FQmalloc(bitmap_len);
+	memset(column->validity, 0, bitmap_len);
+	column->null_count = 0;
+
+	if (column->width > 0)
 	{
-		_FQstoreResult(result, conn, 0);
-		result->ntups = 1;
+		column->values = (char *)_FQmalloc((size_t)column->width * batch_rows);
+		column->offsets = NULL;
 	}
-	else
+	else if (column->width < 0)
 	{
-		int num_rows = 0;
-
-		while ((fetch_stat = isc_dsql_fetch(conn->status, &result->stmt_handle, SQL_DIALECT_V6, result->sqlda_out)) == 0)
-		{
-			_FQstoreResult(result, conn, num_rows);
-			num_rows ++;
-		}
-		result->ntups = num_rows;
+		column->values = (char *)_FQmalloc(bitmap_len);
+		memset(column->values, 0, bitmap_len);
+		column->offsets = NULL;
 	}
-
-	/*
-	 * HACK: INSERT/UPDATE/DELETE ... RETURNING ... sometimes results in a
-	 * "request synchronization error" - ignoring this doesn't seem to
-	 * cause any problems. Potentially this is related to issues with cursor
-	 * usage.
-	 *
-	 * See maybe: http://support.codegear.com/article/35153
-	 */
-	if (0 && fetch_stat != 100L && fetch_stat != isc_req_sync)
+	else
 	{
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_fetch reported %lu", fetch_stat);
-
-		_FQsetResultError(conn, result);
-
-		_FQrollbackTransaction(conn, trans);
-		result->resultStatus = FBRES_FATAL_ERROR;
-
-		_FQexecClearResult(result);
-
-		isc_dsql_free_statement(conn->status, &result->stmt_handle, DSQL_drop);
-
-		return result;
+		column->values = NULL;
+		column->offsets = (int32_t *)_FQmalloc(sizeof(int32_t) * (batch_rows + 1));
+		column->offsets[0] = 0;
+		initFQExpBuffer(&column->data);
 	}
+}
 
-	if (isc_dsql_free_statement(conn->status, &result->stmt_handle, DSQL_drop))
-	{
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_free_statement");
 
-		_FQsetResultError(conn, result);
+/**
+ * _FQarrowAppendValue()
+ *
+ * Convert the current value of "var" into row "row" of the column.
+ */
+static void
+_FQarrowAppendValue(FBconn *conn, FBresult *result, FQarrowColumn *column, XSQLVAR *var, int row)
+{
+	char *dst = column->values + (size_t)column->width * row;
 
-		_FQrollbackTransaction(conn, trans);
+	if ((var->sqltype & 1) && (*var->sqlind < 0))
+	{
+		column->null_count++;
 
-		result->resultStatus = FBRES_FATAL_ERROR;
+		if (column->width > 0)
+			memset(dst, 0, column->width);
+		else if (column->width == 0)
+			column->offsets[row + 1] = column->offsets[row];
 
-		return result;
+		return;
 	}
 
-	/* add an array for offset-based access */
-	_FQexecFillTuplesArray(result);
-
-	result->resultStatus = FBRES_TUPLES_OK;
+	column->validity[row / 8] |= (uint8_t)(1 << (row % 8));
 
-	/* if autocommit, and no explicit transaction set, commit */
-	if (conn->autocommit == true && conn->in_user_transaction == false)
+	switch (column->datatype)
 	{
-		_FQcommitTransaction(conn, trans);
-	}
+		case SQL_SHORT:
+		case SQL_LONG:
+		case SQL_INT64:
+			if (column->width == 16)
+			{
+				int64_t value;
+				int64_t high;
+
+				if (column->datatype == SQL_SHORT)
+					value = *(ISC_SHORT *)var->sqldata;
+				else if (column->datatype == SQL_LONG)
+					value = *(ISC_LONG *)var->sqldata;
+				else
+					value = *(ISC_INT64 *)var->sqldata;
+
+				/* decimal128 values are 128-bit integers in native byte order */
+				high = value < 0 ? -1 : 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+				memcpy(dst, &high, sizeof(int64_t));
+				memcpy(dst + sizeof(int64_t), &value, sizeof(int64_t));
+#else
+				memcpy(dst, &value, sizeof(int64_t));
+				memcpy(dst + sizeof(int64_t), &high, sizeof(int64_t));
+#endif
+			}
+			else
+			{
+				memcpy(dst, var->sqldata, column->width);
+			}
+			break;
+
+		case SQL_FLOAT:
+		case SQL_DOUBLE:
+			memcpy(dst, var->sqldata, column->width);
+			break;
 
-	/* clear up internal storage */
-	_FQexecClearResult(result);
+		case SQL_TYPE_DATE:
+		{
+			int32_t days = *(ISC_DATE *)var->sqldata - FB_ARROW_EPOCH_DATE;
 
-	return result;
-}
+			memcpy(dst, &days, sizeof(int32_t));
+			break;
+		}
 
-static void
-_FQstoreResult(FBresult *result, FBconn *conn, int num_rows)
-{
-	FQresTuple *tuple_next = (FQresTuple *)malloc(sizeof(FQresTuple));
-	int i;
+		case SQL_TYPE_TIME:
+		{
+			int64_t usecs = (int64_t)*(ISC_TIME *)var->sqldata * 100;
 
-	tuple_next->position = num_rows;
-	tuple_next->max_lines = 1;
-	tuple_next->next = NULL;
-	tuple_next->values = malloc(sizeof(FQresTupleAtt *) * result->ncols);
+			memcpy(dst, &usecs, sizeof(int64_t));
+			break;
+		}
 
-	/* store header information */
-	if (num_rows == 0)
-	{
-		for (i = 0; i < result->ncols; i++)
+		case SQL_TIMESTAMP:
 		{
-			FQresTupleAttDesc *desc = (FQresTupleAttDesc *)malloc(sizeof(FQresTupleAttDesc));
-			XSQLVAR *var1 = &result->sqlda_out->sqlvar[i];
+			ISC_TIMESTAMP *ts = (ISC_TIMESTAMP *)var->sqldata;
+			int64_t usecs = ((int64_t)ts->timestamp_date - FB_ARROW_EPOCH_DATE) * INT64_C(86400000000)
+				+ (int64_t)ts->timestamp_time * 100;
 
-			desc->desc_len = var1->sqlname_length;
-			desc->desc = (char *)malloc(desc->desc_len + 1);
-			memcpy(desc->desc, var1->sqlname, desc->desc_len + 1);
-			desc->desc_dsplen = FQdspstrlen(desc->desc, FQclientEncodingId(conn));
+			memcpy(dst, &usecs, sizeof(int64_t));
+			break;
+		}
 
-			if (var1->aliasname_length == var1->sqlname_length
-				&& strncmp(var1->aliasname, var1->sqlname, var1->aliasname_length ) == 0)
-			{
-				desc->alias_len = 0;
-				desc->alias = NULL;
-			}
-			else
-			{
-				desc->alias_len = var1->aliasname_length;
-				desc->alias = (char *)malloc(desc->alias_len + 1);
-				memcpy(desc->alias, var1->aliasname, desc->alias_len + 1);
-				desc->alias_dsplen = FQdspstrlen(desc->alias, FQclientEncodingId(conn));
-			}
+#if defined SQL_BOOLEAN
+		case SQL_BOOLEAN:
+			if (*var->sqldata == FB_TRUE)
+				column->values[row / 8] |= (uint8_t)(1 << (row % 8));
+			break;
+#endif
+
+		case SQL_TEXT:
+		case SQL_VARYING:
+		{
+			const char *value;
+			int len;
 
-			/* store table name, if set */
-			if (var1->relname_length)
+			if (column->datatype == SQL_VARYING)
 			{
-				desc->relname_len = var1->relname_length;
-				desc->relname = (char *)malloc(desc->relname_len + 1);
-				memset(desc->relname, '\0', desc->relname_len + 1);
-				strncpy(desc->relname, var1->relname, desc->relname_len);
+				VARY2 *vary2 = (VARY2 *)var->sqldata;
+
+				value = (const char *)vary2->vary_string;
+				len = vary2->vary_length;
 			}
 			else
 			{
-				desc->relname_len = 0;
-				desc->relname = NULL;
+				value = var->sqldata;
+				len = var->sqllen;
+
+				/* as in _FQformatValue() */
+				if (conn->trim_char == true && (var->sqlsubtype & 0xff) != FBENC_OCTETS)
+				{
+					while (len > 0 && value[len - 1] == ' ')
+						len--;
+				}
 			}
 
-			desc->att_max_len = 0;
-			desc->att_max_line_len = 0;
+			appendBinaryFQExpBuffer(&column->data, value, len);
+			column->offsets[row + 1] = column->data.len;
+			break;
+		}
 
-			/* Firebird returns RDB$DB_KEY as "DB_KEY" - set the pseudo-datatype */
-			if (strncmp(desc->desc, "DB_KEY", 6) == 0 && strlen(desc->desc) == 6)
-				desc->type = SQL_DB_KEY;
-			else
-				desc->type = var1->sqltype & ~1;
+		case SQL_DB_KEY:
+		{
+			char *value = _FQparseDbKey(var->sqldata);
+
+			appendFQExpBufferStr(&column->data, value);
+			column->offsets[row + 1] = column->data.len;
+			_FQfree(value);
+			break;
+		}
+
+		default:
+		{
+			int len;
+			char *value = _FQformatValue(conn, result, column->datatype, var, &len);
 
-			desc->has_null = false;
-			result->header[i] = desc;
+			if (len < 0)
+				len = strlen(value);
+
+			appendBinaryFQExpBuffer(&column->data, value, len);
+			column->offsets[row + 1] = column->data.len;
 		}
 	}
+}
+
+
+/**
+ * _FQarrowEmitBatch()
+ *
+ * Export the first "nrows" rows of the column buffers and their schema,
+ * passing ownership of the buffers to the callback, which must move or
+ * release the exported structures.
+ */
+static bool
+_FQarrowEmitBatch(FBresult *result, FQarrowColumn *columns, int nrows, FQarrowBatchCallback callback, void *arg)
+{
+	struct ArrowSchema schema;
+	struct ArrowArray  batch;
+	int i;
+
+	_FQarrowInitSchema(&schema, "+s", "", 0, result->ncols);
+	_FQarrowInitArray(&batch, nrows, 0, 1, result->ncols);
 
-	/* Store tuple data */
 	for (i = 0; i < result->ncols; i++)
 	{
-		XSQLVAR *var = (XSQLVAR *)&result->sqlda_out->sqlvar[i];
-		FQresTupleAtt *tuple_att = _FQformatDatum(conn, result->header[i], var);
+		FQarrowColumn *column = &columns[i];
+		XSQLVAR *var = &result->sqlda_out->sqlvar[i];
+		char name[sizeof(var->aliasname) + 1];
 
-		if (tuple_att->lines > tuple_next->max_lines)
-		{
-			tuple_next->max_lines = tuple_att->lines;
-		}
+		memcpy(name, var->aliasname, var->aliasname_length);
+		name[var->aliasname_length] = '\0';
 
-		if (tuple_att->value == NULL)
+		_FQarrowInitSchema(schema.children[i], column->format, name,
+						   (var->sqltype & 1) ? ARROW_FLAG_NULLABLE : 0, 0);
+
+		_FQarrowInitArray(batch.children[i], nrows, column->null_count, column->width == 0 ? 3 : 2, 0);
+
+		batch.children[i]->buffers[0] = column->validity;
+
+		if (column->width == 0)
 		{
-			result->header[i]->has_null = true;
+			batch.children[i]->buffers[1] = column->offsets;
+			batch.children[i]->buffers[2] = column->data.data;
 		}
 		else
 		{
-			/* TODO: set max lines */
-
-			if (tuple_att->dsplen > result->header[i]->att_max_len)
-			{
-				result->header[i]->att_max_len = tuple_att->dsplen;
-			}
-
-			if (tuple_att->dsplen_line > result->header[i]->att_max_line_len)
-			{
-				result->header[i]->att_max_line_len = tuple_att->dsplen_line;
-			}
+			batch.children[i]->buffers[1] = column->values;
 		}
 
-		tuple_next->values[i] = tuple_att;
+		column->validity = NULL;
+		column->values = NULL;
+		column->offsets = NULL;
+		column->data.data = NULL;
 	}
 
-	if (result->tuple_first == NULL)
-	{
-		result->tuple_first = tuple_next;
-		result->tuple_last = result->tuple_first;
-	}
-	else
-	{
-		result->tuple_last->next = tuple_next;
-		result->tuple_last = tuple_next;
-	}
+	return callback(&schema, &batch, arg);
 }
 
 
 /**
- * FQexecTransaction()
+ * _FQarrowInitSchema()
  *
- * Convenience function to execute a query using the internal
- * transaction handle.
+ * Initialise an exported ArrowSchema, allocating its children.
  */
-FBresult *
-FQexecTransaction(FBconn *conn, const char *stmt)
+static void
+_FQarrowInitSchema(struct ArrowSchema *schema, const char *format, const char *name, int64_t flags, int64_t n_children)
 {
-	FBresult	  *result = NULL;
+	int64_t i;
 
-	if (!conn)
-	{
-		result->resultStatus = FBRES_FATAL_ERROR;
+	memset(schema, 0, sizeof(struct ArrowSchema));
 
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - invalid connection object");
-		_FQsetResultError(conn, result);
+	schema->format = _FQstrdup(format);
+	schema->name = _FQstrdup(name);
+	schema->flags = flags;
+	schema->n_children = n_children;
+	schema->release = _FQarrowReleaseSchema;
 
-		return result;
+	if (n_children > 0)
+	{
+		schema->children = (struct ArrowSchema **)_FQmalloc(sizeof(struct ArrowSchema *) * n_children);
+
+		for (i = 0; i < n_children; i++)
+			schema->children[i] = (struct ArrowSchema *)_FQmalloc(sizeof(struct ArrowSchema));
 	}
+}
 
-	if (_FQstartTransaction(conn, &conn->trans_internal) == TRANS_ERROR)
-	{
-		result->resultStatus = FBRES_FATAL_ERROR;
 
-		/* XXX todo: set error */
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "transaction error");
-		isc_print_status(conn->status);
+/**
+ * _FQarrowInitArray()
+ *
+ * Initialise an exported ArrowArray, allocating its buffer list and
+ * children.
+ */
+static void
+_FQarrowInitArray(struct ArrowArray *array, int64_t length, int64_t null_count, int64_t n_buffers, int64_t n_children)
+{
+	int64_t i;
 
-		return result;
-	}
+	memset(array, 0, sizeof(struct ArrowArray));
 
-	result = _FQexec(conn, &conn->trans_internal, stmt);
+	array->length = length;
+	array->null_count = null_count;
+	array->n_buffers = n_buffers;
+	array->n_children = n_children;
+	array->buffers = (const void **)_FQmalloc(sizeof(void *) * n_buffers);
+	memset(array->buffers, 0, sizeof(void *) * n_buffers);
+	array->release = _FQarrowReleaseArray;
 
-	if (FQresultStatus(result) == FBRES_FATAL_ERROR)
+	if (n_children > 0)
 	{
-		/* XXX todo: set error */
-		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "query execution error");
-		isc_print_status(conn->status);
-		_FQrollbackTransaction(conn, &conn->trans_internal);
+		array->children = (struct ArrowArray **)_FQmalloc(sizeof(struct ArrowArray *) * n_children);
+
+		for (i = 0; i < n_children; i++)
+			array->children[i] = (struct ArrowArray *)_FQmalloc(sizeof(struct ArrowArray));
 	}
-	/* Non-select query */
-	else if (FQresultStatus(result) == FBRES_COMMAND_OK)
+}
+
+
+/**
+ * _FQarrowReleaseSchema()
+ *
+ * Release callback of schemas exported by FQexecArrow().
+ */
+static void
+_FQarrowReleaseSchema(struct ArrowSchema *schema)
+{
+	int64_t i;
+
+	for (i = 0; i < schema->n_children; i++)
 	{
-		// TODO: show some meaningful output?
-		if (_FQcommitTransaction(conn, &conn->trans_internal) == TRANS_ERROR)
-		{
-			/* XXX todo: set error */
-			_FQsaveMessageField(&result, FB_DIAG_DEBUG, "transaction commit error");
-			isc_print_status(conn->status);
-			_FQrollbackTransaction(conn, &conn->trans_internal);
-		}
+		if (schema->children[i]->release != NULL)
+			schema->children[i]->release(schema->children[i]);
+
+		_FQfree(schema->children[i]);
 	}
-	/* Query returning rows */
-	else if (FQresultStatus(result) == FBRES_TUPLES_OK)
+
+	_FQfree(schema->children);
+	_FQfree((char *)schema->format);
+	_FQfree((char *)schema->name);
+
+	schema->release = NULL;
+}
+
+
+/**
+ * _FQarrowReleaseArray()
+ *
+ * Release callback of arrays exported by FQexecArrow().
+ */
+static void
+_FQarrowReleaseArray(struct ArrowArray *array)
+{
+	int64_t i;
+
+	for (i = 0; i < array->n_children; i++)
 	{
-		_FQcommitTransaction(conn, &conn->trans_internal);
+		if (array->children[i]->release != NULL)
+			array->children[i]->release(array->children[i]);
+
+		_FQfree(array->children[i]);
 	}
 
-	return result;
+	for (i = 0; i < array->n_buffers; i++)
+		_FQfree((void *)array->buffers[i]);
+
+	_FQfree(array->children);
+	_FQfree(array->buffers);
+
+	array->release = NULL;
 }
 
 
@@ -2534,7 +6178,9 @@ FQfname(const FBresult *res, int column_number)
 /**
  * FQgetlength()
  *
- * Get length in bytes of a particular tuple column.
+ * Get length in bytes of a particular tuple column. For CHAR and VARCHAR
+ * columns this is the length reported by Firebird, so may include
+ * embedded NUL bytes.
  */
 int
 FQgetlength(const FBresult *res,
@@ -2640,6 +6286,120 @@ FQftype(const FBresult *res, int column_number)
 }
 
 
+/**
+ * FQresultToJSON()
+ *
+ * Serialise the rows of a result as a JSON array with one object per
+ * row, keyed by column name (or alias), and pass the output to the
+ * callback "writer" in chunks of around FB_COPY_BUFFER_SIZE bytes.
+ *
+ * Numeric values are emitted as JSON numbers and SQL_BOOLEAN values as
+ * true/false; NULLs are emitted as null, RDB$DB_KEY values in the format
+ * produced by FQformatDbKey(), and all other values as strings.
+ *
+ * Returns false if the result is not a successful query result (status
+ * FBRES_TUPLES_OK) or the writer returned false. A query which returned
+ * no rows is serialised as an empty array.
+ */
+bool
+FQresultToJSON(const FBresult *res, FQjsonWriter writer, void *arg)
+{
+	FQExpBufferData buf;
+	FQExpBufferData keys;
+	int			   *key_offsets;
+	int				row, col;
+	bool			write_ok = true;
+
+	if (!res || res->resultStatus != FBRES_TUPLES_OK)
+		return false;
+
+	initFQExpBuffer(&buf);
+	initFQExpBuffer(&keys);
+
+	key_offsets = (int *)_FQmalloc(sizeof(int) * (res->ncols + 1));
+
+	for (col = 0; col < res->ncols; col++)
+	{
+		const char *name = FQfname(res, col);
+
+		key_offsets[col] = keys.len;
+		_FQjsonAppendKey(&keys, col, name, strlen(name));
+	}
+
+	key_offsets[col] = keys.len;
+
+	appendFQExpBufferChar(&buf, '[');
+
+	for (row = 0; row < res->ntups && write_ok == true; row++)
+	{
+		if (row > 0)
+			appendFQExpBufferStr(&buf, ",\n");
+
+		appendFQExpBufferChar(&buf, '{');
+
+		for (col = 0; col < res->ncols; col++)
+		{
+			FQresTupleAtt *att = res->tuples[row]->values[col];
+			short type = res->header[col]->type;
+
+			appendBinaryFQExpBuffer(&buf, keys.data + key_offsets[col], key_offsets[col + 1] - key_offsets[col]);
+
+			if (att->has_null == true)
+			{
+				appendFQExpBufferStr(&buf, "null");
+			}
+			else if (type == SQL_DB_KEY)
+			{
+				char *value = _FQparseDbKey(att->value);
+
+				_FQjsonAppendString(&buf, value, strlen(value));
+				_FQfree(value);
+			}
+			else
+			{
+				_FQjsonAppendValue(&buf, type, att->value, att->len);
+			}
+		}
+
+		appendFQExpBufferChar(&buf, '}');
+
+		if (buf.len >= FB_COPY_BUFFER_SIZE)
+			write_ok = _FQjsonWrite(&buf, writer, arg);
+	}
+
+	if (write_ok == true)
+	{
+		appendFQExpBufferStr(&buf, "]\n");
+		write_ok = _FQjsonWrite(&buf, writer, arg);
+	}
+
+	_FQfree(key_offsets);
+	termFQExpBuffer(&keys);
+	termFQExpBuffer(&buf);
+
+	return write_ok;
+}
+
+
+/**
+ * FQresultStats()
+ *
+ * Return the timings and counters recorded while executing the query
+ * which produced the result, or NULL if they were not collected; see
+ * FQsetResultStats().
+ *
+ * Timings of phases which were not reached, or failed, are 0.
+ */
+const FQresStats *
+FQresultStats(const FBresult *res)
+{
+	if (!res)
+		return NULL;
+
+	return res->stats;
+}
+
+
 
 
 /*
@@ -2721,7 +6481,7 @@ FQresultErrorFieldsAsString(const FBresult *res, char *prefix)
 
 	if (!res || res->errFields == NULL)
 	{
-		str = (char *)malloc(1);
+		str = (char *)_FQmalloc(1);
 		str[0] = '\0';
 		return str;
 	}
@@ -2744,7 +6504,7 @@ FQresultErrorFieldsAsString(const FBresult *res, char *prefix)
 		mfield = mfield->prev;
 	} while ( mfield != NULL);
 
-	str = (char *)malloc(strlen(buf.data) + 1);
+	str = (char *)_FQmalloc(strlen(buf.data) + 1);
 	memcpy(str, buf.data, strlen(buf.data) + 1);
 	termFQExpBuffer(&buf);
 
@@ -2809,6 +6569,7 @@ _FQsetResultError(FBconn *conn, FBresult *res)
 	int msg_len = 0;
 
 	res->fbSQLCODE = isc_sqlcode(conn->status);
+	_FQmetricsCountError(conn, res->fbSQLCODE);
 
 	/* fb_interpret() will modify this pointer */
 	pvector = conn->status;
@@ -2872,7 +6633,7 @@ _FQsetResultError(FBconn *conn, FBresult *res)
 				memset(msg, '\0', ERROR_BUFFER_LEN);
 
 				strncpy(msg, message_part, msg_len);
-				free(message_part);
+				_FQfree(message_part);
 			}
 		}
 		else if (line == 1)
@@ -2932,28 +6693,66 @@ _FQsetResultError(FBconn *conn, FBresult *res)
 			appendFQExpBuffer(&buf,
 							  "DETAIL: %s", error_field);
 
-			if (res->errLine > 0)
-			{
-				appendFQExpBuffer(&buf,
-								  " at line %i, column %i", res->errLine, res->errCol);
-			}
-		}
-	}
+			if (res->errLine > 0)
+			{
+				appendFQExpBuffer(&buf,
+								  " at line %i, column %i", res->errLine, res->errCol);
+			}
+		}
+	}
+
+	msg_len = strlen(buf.data);
+
+	res->errMsg = (char *)_FQresultMalloc(res, msg_len + 1);
+	memset(res->errMsg, '\0', msg_len + 1);
+	strncpy(res->errMsg, buf.data, msg_len);
+
+	if (conn->errMsg != NULL)
+		_FQfree(conn->errMsg);
+
+	conn->errMsg = (char *)_FQmalloc(msg_len + 1);
+	memset(conn->errMsg, '\0', msg_len + 1);
+	strncpy(conn->errMsg, buf.data, msg_len);
+
+	termFQExpBuffer(&buf);
+}
+
+
+/**
+ * _FQsetResultLibraryError()
+ *
+ * Store an error detected by libfq itself, rather than reported by
+ * Firebird, as the primary error message, and format it in the same way
+ * as _FQsetResultError().
+ */
+void
+_FQsetResultLibraryError(FBconn *conn, FBresult *res, const char *msg, ...)
+{
+	char buffer[ERROR_BUFFER_LEN];
+	va_list argp;
+	int msg_len;
+
+	va_start(argp, msg);
+	vsnprintf(buffer, ERROR_BUFFER_LEN, msg, argp);
+	va_end(argp);
+
+	conn->metrics.errors++;
 
-	msg_len = strlen(buf.data);
+	_FQsaveMessageField(&res, FB_DIAG_MESSAGE_PRIMARY, "%s", buffer);
 
-	res->errMsg = (char *)malloc(msg_len + 1);
-	memset(res->errMsg, '\0', msg_len + 1);
-	strncpy(res->errMsg, buf.data, msg_len);
+	if (res->errMsg != NULL)
+		_FQresultFree(res, res->errMsg, strlen(res->errMsg) + 1);
 
-	if (conn->errMsg != NULL)
-		free(conn->errMsg);
+	msg_len = strlen("ERROR: \n") + strlen(buffer);
 
-	conn->errMsg = (char *)malloc(msg_len + 1);
-	memset(conn->errMsg, '\0', msg_len + 1);
-	strncpy(conn->errMsg, buf.data, msg_len);
+	res->errMsg = (char *)_FQresultMalloc(res, msg_len + 1);
+	snprintf(res->errMsg, msg_len + 1, "ERROR: %s\n", buffer);
 
-	termFQExpBuffer(&buf);
+	if (conn->errMsg != NULL)
+		_FQfree(conn->errMsg);
+
+	conn->errMsg = (char *)_FQmalloc(msg_len + 1);
+	snprintf(conn->errMsg, msg_len + 1, "ERROR: %s\n", buffer);
 }
 
 
@@ -2963,13 +6762,28 @@ _FQsetResultError(FBconn *conn, FBresult *res)
  * Handle non-fatal error.
  *
  * This function's behaviour mimics libpq, where a non-fatal error
- * is dumped to STDOUT by default. libpq also allows the client to nominate
- * or handled by a client-specified handler; this functionality is not
- * yet implemented.
+ * is passed to the connection's notice processor, which by default
+ * writes it to STDERR; see FQsetNoticeProcessor().
  */
 void _FQsetResultNonFatalError(const FBconn *conn, FBresult *res, short errlevel, char *msg)
 {
-	fprintf(stderr, "%s: %s", _FQlogLevel(errlevel), msg);
+	char message[FB_LOG_MESSAGE_LEN];
+
+	snprintf(message, sizeof(message), "%s: %s\n", _FQlogLevel(errlevel), msg);
+
+	conn->notice_processor(conn->notice_arg, message);
+}
+
+
+/**
+ * _FQdefaultNoticeProcessor()
+ *
+ * Default notice processor; writes the notice to STDERR.
+ */
+static void
+_FQdefaultNoticeProcessor(void *arg, const char *message)
+{
+	fprintf(stderr, "%s", message);
 }
 
 
@@ -2994,7 +6808,7 @@ _FQsaveMessageField(FBresult **res, FQdiagType code, const char *value, ...)
 	 */
 	if (*res == NULL)
 	{
-		*res = _FQinitResult(false);
+		*res = _FQinitResult(NULL, false);
 	}
 
 	va_start(argp, value);
@@ -3003,7 +6817,7 @@ _FQsaveMessageField(FBresult **res, FQdiagType code, const char *value, ...)
 
 	buflen = strlen(buffer);
 
-	mfield = (FBMessageField *)malloc(sizeof(FBMessageField));
+	mfield = (FBMessageField *)_FQresultMalloc(*res, sizeof(FBMessageField));
 
 	if (!mfield)
 		return;
@@ -3012,11 +6826,11 @@ _FQsaveMessageField(FBresult **res, FQdiagType code, const char *value, ...)
 
 	mfield->code = code;
 	mfield->prev = NULL;
-	mfield->value = (char *)malloc(buflen + 1);
+	mfield->value = (char *)_FQresultMalloc(*res, buflen + 1);
 
 	if (mfield->value == NULL)
 	{
-		free(mfield);
+		_FQresultFree(*res, mfield, sizeof(FBMessageField));
 		return;
 	}
 
@@ -3081,6 +6895,8 @@ FQstartTransaction(FBconn *conn)
 	if (!conn)
 		return TRANS_ERROR;
 
+	_FQtraceStatement(conn, NULL);
+
 	return _FQstartTransaction(conn, &conn->trans);
 }
 
@@ -3096,6 +6912,8 @@ FQcommitTransaction(FBconn *conn)
 	if (!conn)
 		return TRANS_ERROR;
 
+	_FQtraceStatement(conn, NULL);
+
 	return _FQcommitTransaction(conn, &conn->trans);
 }
 
@@ -3111,6 +6929,8 @@ FQrollbackTransaction(FBconn *conn)
 	if (!conn)
 		return TRANS_ERROR;
 
+	_FQtraceStatement(conn, NULL);
+
 	return _FQrollbackTransaction(conn, &conn->trans);
 }
 
@@ -3124,9 +6944,11 @@ FQrollbackTransaction(FBconn *conn)
 static FQtransactionStatusType
 _FQcommitTransaction(FBconn *conn, isc_tr_handle *trans)
 {
-	if (isc_commit_transaction(conn->status, trans))
+	if (FB_TRACE(conn, "isc_commit_transaction", isc_commit_transaction(conn->status, trans)))
 		return TRANS_ERROR;
 
+	conn->metrics.commits++;
+
 	*trans = 0L;
 
 	return TRANS_OK;
@@ -3141,9 +6963,11 @@ _FQcommitTransaction(FBconn *conn, isc_tr_handle *trans)
 static FQtransactionStatusType
 _FQrollbackTransaction(FBconn *conn, isc_tr_handle *trans)
 {
-	if (isc_rollback_transaction(conn->status, trans))
+	if (FB_TRACE(conn, "isc_rollback_transaction", isc_rollback_transaction(conn->status, trans)))
 		return TRANS_ERROR;
 
+	conn->metrics.rollbacks++;
+
 	*trans = 0L;
 
 	return TRANS_OK;
@@ -3158,29 +6982,236 @@ _FQrollbackTransaction(FBconn *conn, isc_tr_handle *trans)
 static FQtransactionStatusType
 _FQstartTransaction(FBconn *conn, isc_tr_handle *trans)
 {
-	if (isc_start_transaction(conn->status, trans, 1, &conn->db, 0, NULL))
+	if (FB_TRACE(conn, "isc_start_transaction", isc_start_transaction(conn->status, trans, 1, &conn->db, 0, NULL)))
 		return TRANS_ERROR;
 
 	return TRANS_OK;
 }
 
 
+/**
+ * _FQresultAlloc()
+ *
+ * Allocate space for a tuple value from the result's value storage,
+ * which consists of a chain of FB_RESULT_BLOCK_SIZE blocks. This avoids
+ * a malloc() call per value, and means the values of a result are
+ * stored contiguously. Values larger than a quarter of the block size
+ * are given a block of their own, which is placed behind the current
+ * block so its remaining space can still be used.
+ *
+ * The storage is freed in its entirety by FQclear().
+ */
+static char *
+_FQresultAlloc(FBresult *result, size_t len)
+{
+	FQresultBlock *block = result->value_blocks;
+	char *space;
+
+	FB_STATS_ADD(result, bytes_stored, len);
+
+	if (len > FB_RESULT_BLOCK_SIZE / 4)
+	{
+		FB_STATS_ADD(result, allocations, 1);
+
+		block = (FQresultBlock *)_FQresultMalloc(result, offsetof(FQresultBlock, data) + len);
+		block->size = len;
+		block->used = len;
+
+		if (result->value_blocks != NULL)
+		{
+			block->next = result->value_blocks->next;
+			result->value_blocks->next = block;
+		}
+		else
+		{
+			block->next = NULL;
+			result->value_blocks = block;
+		}
+
+		return block->data;
+	}
+
+	if (block == NULL || block->size - block->used < len)
+	{
+		FB_STATS_ADD(result, allocations, 1);
+
+		block = (FQresultBlock *)_FQresultMalloc(result, offsetof(FQresultBlock, data) + FB_RESULT_BLOCK_SIZE);
+		block->size = FB_RESULT_BLOCK_SIZE;
+		block->used = 0;
+		block->next = result->value_blocks;
+		result->value_blocks = block;
+	}
+
+	space = block->data + block->used;
+	block->used += len;
+
+	return space;
+}
+
+
+/**
+ * _FQresultValueSize()
+ *
+ * Return the number of bytes of value storage used by the result.
+ */
+static size_t
+_FQresultValueSize(const FBresult *result)
+{
+	FQresultBlock *block;
+	size_t size = 0;
+
+	for (block = result->value_blocks; block != NULL; block = block->next)
+		size += block->used;
+
+	return size;
+}
+
+
+/**
+ * _FQresultResetValues()
+ *
+ * Discard all values allocated from the result's value storage, retaining
+ * the most recently allocated block for reuse if it is a standard-sized
+ * one. Used by FQcopyOut(), which only needs each row's values until they
+ * have been written.
+ */
+static void
+_FQresultResetValues(FBresult *result)
+{
+	FQresultBlock *block = result->value_blocks;
+
+	if (block == NULL)
+		return;
+
+	while (block->next != NULL)
+	{
+		FQresultBlock *block_next = block->next->next;
+
+		_FQresultFree(result, block->next, offsetof(FQresultBlock, data) + block->next->size);
+		block->next = block_next;
+	}
+
+	if (block->size == FB_RESULT_BLOCK_SIZE)
+	{
+		block->used = 0;
+	}
+	else
+	{
+		_FQresultFree(result, block, offsetof(FQresultBlock, data) + block->size);
+		result->value_blocks = NULL;
+	}
+}
+
+
+/**
+ * _FQresultMalloc()
+ *
+ * Allocate memory belonging to the result with the result's allocator,
+ * adding it to the sizes reported by FQresultMemorySize() and
+ * FQconnMemorySize(). Memory held until the result is cleared is freed
+ * by _FQclearResult(); anything freed before then must be released with
+ * _FQresultFree().
+ */
+static void *
+_FQresultMalloc(FBresult *result, size_t size)
+{
+	result->mem_size += size;
+
+	if (result->mem_account != NULL)
+		result->mem_account->size += size;
+
+	return result->allocator.malloc_func(size, result->allocator.arg);
+}
+
+
+/**
+ * _FQresultFree()
+ *
+ * Free memory allocated with _FQresultMalloc() before the result is
+ * cleared; "size" must be the size originally requested.
+ */
+static void
+_FQresultFree(FBresult *result, void *ptr, size_t size)
+{
+	if (ptr == NULL)
+		return;
+
+	result->mem_size -= size;
+
+	if (result->mem_account != NULL)
+		result->mem_account->size -= size;
+
+	result->allocator.free_func(ptr, result->allocator.arg);
+}
+
+
+/**
+ * _FQresultAllocSQLDA()
+ *
+ * (Re)allocate one of the result's XSQLDAs with space for "sqln"
+ * variables.
+ */
+static void
+_FQresultAllocSQLDA(FBresult *result, XSQLDA **sqlda, short sqln)
+{
+	if (*sqlda != NULL)
+		_FQresultFree(result, *sqlda, XSQLDA_LENGTH((*sqlda)->sqln));
+
+	*sqlda = (XSQLDA *) _FQresultMalloc(result, XSQLDA_LENGTH(sqln));
+	memset(*sqlda, '\0', XSQLDA_LENGTH(sqln));
+	(*sqlda)->sqln = sqln;
+	(*sqlda)->version = SQLDA_VERSION1;
+}
+
+
+/**
+ * _FQresultMemoryExceeded()
+ *
+ * Determine whether the results of the result's connection hold more
+ * memory than permitted by FQsetMemoryLimit().
+ */
+static bool
+_FQresultMemoryExceeded(const FBresult *result)
+{
+	const FQmemAccount *account = result->mem_account;
+
+	return account != NULL && account->limit > 0 && account->size > account->limit;
+}
+
+
+/**
+ * _FQmemAccountRelease()
+ *
+ * Drop a reference to a connection's memory account, freeing it once
+ * neither the connection nor any of its results refer to it.
+ */
+static void
+_FQmemAccountRelease(FQmemAccount *account)
+{
+	if (account == NULL)
+		return;
+
+	if (--account->refcount == 0)
+		_FQfree(account);
+}
+
+
 /**
  * _FQformatDatum()
  *
- * Format the provided SQLVAR datum as a FQresTupleAtt
+ * Format the provided SQLVAR datum as a FQresTupleAtt. The formatted
+ * value is stored in the result's value storage (see _FQresultAlloc());
+ * CHAR and VARCHAR values are copied there directly from the fetch
+ * buffer, using the length provided by Firebird.
  */
-static FQresTupleAtt *
-_FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
+FQresTupleAtt *
+_FQformatDatum(FBconn *conn, FBresult *result, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 {
 	FQresTupleAtt *tuple_att;
 	short		   datatype;
-	char		  *p;
-	VARY2		  *vary2;
-	struct tm	   times;
-	char		   date_buffer[FB_TIMESTAMP_LEN + 1];
+	int			   len;
 
-	tuple_att = (FQresTupleAtt *)malloc(sizeof(FQresTupleAtt));
+	tuple_att = (FQresTupleAtt *)_FQresultMalloc(result, sizeof(FQresTupleAtt));
 	tuple_att->value = NULL;
 	tuple_att->len = 0;
 	tuple_att->dsplen = 0;
@@ -3197,20 +7228,91 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 	tuple_att->has_null = false;
 	datatype = att_desc->type;
 
+	tuple_att->value = _FQformatValue(conn, result, datatype, var, &len);
+
+    /* Calculate display width */
+	/* Special case for RDB$DB_KEY */
+	if (datatype == SQL_DB_KEY)
+	{
+		tuple_att->len = var->sqllen;
+		tuple_att->dsplen = FB_DB_KEY_LEN;
+	}
+	else
+	{
+		bool get_dsp_len = false;
+
+		if (conn->get_dsp_len == true)
+		{
+			switch(datatype)
+			{
+				case SQL_TEXT:
+				case SQL_VARYING:
+					get_dsp_len = true;
+					break;
+
+				case SQL_BLOB:
+					/* TODO: get blob subtype */
+					get_dsp_len = true;
+					break;
+			}
+		}
+
+		_FQscanDatum(tuple_att, len, FQclientEncodingId(conn), get_dsp_len);
+	}
+
+	return tuple_att;
+}
+
+
+/**
+ * _FQformatValue()
+ *
+ * Format the provided non-NULL SQLVAR datum as a string, allocated
+ * from the result's value storage. If the length of the formatted value
+ * is known without scanning it (CHAR, VARCHAR and BLOB values), it is
+ * stored in "len", otherwise "len" is set to -1.
+ */
+static char *
+_FQformatValue(FBconn *conn, FBresult *result, short datatype, XSQLVAR *var, int *len)
+{
+	char		  *p;
+	VARY2		  *vary2;
+	struct tm	   times;
+	char		   date_buffer[FB_TIMESTAMP_LEN + 1];
+
+	*len = -1;
+
 	switch (datatype)
 	{
 		case SQL_TEXT:
-			p = (char *)malloc(var->sqllen + 1);
+			*len = var->sqllen;
+
+			/*
+			 * CHAR values are padded with spaces, except for those in the
+			 * OCTETS character set, which are padded with NULs. The pad
+			 * space never occurs as the trailing byte of a multibyte
+			 * character in any of the character sets supported by Firebird,
+			 * so trailing spaces can be removed bytewise.
+			 */
+			if (conn->trim_char == true && (var->sqlsubtype & 0xff) != FBENC_OCTETS)
+			{
+				while (*len > 0 && var->sqldata[*len - 1] == ' ')
+					(*len)--;
+			}
+
+			p = _FQresultAlloc(result, *len + 1);
 
-			memcpy(p, var->sqldata, var->sqllen);
-			p[var->sqllen] = '\0';
+			memcpy(p, var->sqldata, *len);
+			p[*len] = '\0';
 			break;
 
 		case SQL_VARYING:
 			vary2 = (VARY2*)var->sqldata;
-			p = (char *)malloc(vary2->vary_length + 1);
-			vary2->vary_string[vary2->vary_length] = '\0';
-			memcpy(p, vary2->vary_string, strlen((const char *)vary2->vary_string) + 1);
+			*len = vary2->vary_length;
+			p = _FQresultAlloc(result, *len + 1);
+
+			memcpy(p, vary2->vary_string, *len);
+			p[*len] = '\0';
 			break;
 
 		case SQL_SHORT:
@@ -3250,7 +7352,7 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 
 				if (value >= 0)
 				{
-					p = (char *)malloc(field_width - 1 + dscale + 1);
+					p = _FQresultAlloc(result, field_width - 1 + dscale + 1);
 					sprintf (p, "%lld.%0*lld",
 							 (ISC_INT64) value / tens,
 							 -dscale,
@@ -3259,7 +7361,7 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 				}
 				else if ((value / tens) != 0)
 				{
-					p = (char *)malloc(field_width - 1 + dscale + 1);
+					p = _FQresultAlloc(result, field_width - 1 + dscale + 1);
 
 					sprintf (p, "%lld.%0*lld",
 							 (ISC_INT64) (value / tens),
@@ -3269,7 +7371,7 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 				}
 				else
 				{
-					p = (char *)malloc(field_width - 1 + dscale + 1);
+					p = _FQresultAlloc(result, field_width - 1 + dscale + 1);
 
 					sprintf (p, "%s.%0*lld",
 							 "-0",
@@ -3280,7 +7382,7 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 			}
 			else if (dscale)
 			{
-				p = (char *)malloc(field_width + 1);
+				p = _FQresultAlloc(result, field_width + 1);
 
 				sprintf (p, "%lld%0*d",
 						 (ISC_INT64) value,
@@ -3288,7 +7390,7 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 			}
 			else
 			{
-				p = (char *)malloc(field_width + 1);
+				p = _FQresultAlloc(result, field_width + 1);
 
 				sprintf (p, "%lld",
 						 (ISC_INT64) value);
@@ -3297,17 +7399,17 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 		break;
 
 		case SQL_FLOAT:
-			p = (char *)malloc(FB_FLOAT_LEN + 1);
+			p = _FQresultAlloc(result, FB_FLOAT_LEN + 1);
 			sprintf(p, "%g", *(float *) (var->sqldata));
 			break;
 
 		case SQL_DOUBLE:
-			p = (char *)malloc(FB_DOUBLE_LEN + 1);
+			p = _FQresultAlloc(result, FB_DOUBLE_LEN + 1);
 			sprintf(p, "%f", *(double *) (var->sqldata));
 			break;
 
 		case SQL_TIMESTAMP:
-			p = (char *)malloc(FB_TIMESTAMP_LEN + 1);
+			p = _FQresultAlloc(result, FB_TIMESTAMP_LEN + 1);
 			isc_decode_timestamp((ISC_TIMESTAMP *)var->sqldata, &times);
 			sprintf(date_buffer, "%04d-%02d-%02d %02d:%02d:%02d.%04d",
 					times.tm_year + 1900,
@@ -3321,7 +7423,7 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 			break;
 
 		case SQL_TYPE_DATE:
-			p = (char *)malloc(FB_DATE_LEN + 1);
+			p = _FQresultAlloc(result, FB_DATE_LEN + 1);
 			isc_decode_sql_date((ISC_DATE *)var->sqldata, &times);
 			sprintf(date_buffer, "%04d-%02d-%02d",
 					times.tm_year + 1900,
@@ -3331,7 +7433,7 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 			break;
 
 		case SQL_TYPE_TIME:
-			p = (char *)malloc(FB_TIME_LEN + 1);
+			p = _FQresultAlloc(result, FB_TIME_LEN + 1);
 			isc_decode_sql_time((ISC_TIME *)var->sqldata, &times);
 			sprintf(date_buffer, "%02d:%02d:%02d.%04d",
 					times.tm_hour,
@@ -3351,12 +7453,13 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
             char blob_segment[BLOB_SEGMENT_LEN];
             unsigned short actual_seg_len;
             ISC_STATUS blob_status;
+            int segments = 0;
 
             FQExpBufferData blob_output;
 
             initFQExpBuffer(&blob_output);
 
-            isc_open_blob2(
+            FB_TRACE(conn, "isc_open_blob2", isc_open_blob2(
                 conn->status,
                 &conn->db,
                 &conn->trans,
@@ -3364,39 +7467,44 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
                 blob_id,      /* Blob ID put into out_sqlda by isc_dsql_fetch() */
                 0,            /* BPB length = 0; no filter will be used */
                 NULL          /* NULL BPB, since no filter will be used */
-                );
+                ));
 
             do {
                 char *seg;
-                blob_status = isc_get_segment(
+                blob_status = FB_TRACE(conn, "isc_get_segment", isc_get_segment(
                     conn->status,
                     &blob_handle,         /* set by isc_open_blob2()*/
                     &actual_seg_len,      /* length of segment read */
                     sizeof(blob_segment), /* length of segment buffer */
                     blob_segment          /* segment buffer */
-                    );
+                    ));
 
-                seg = (char *)malloc(sizeof(char) * (actual_seg_len + 1));
+                segments++;
+                seg = (char *)_FQmalloc(sizeof(char) * (actual_seg_len + 1));
                 memcpy(seg, blob_segment, actual_seg_len);
                 seg[actual_seg_len] = '\0';
                 appendFQExpBufferStr(&blob_output, seg);
-                free(seg);
+                _FQfree(seg);
             } while (blob_status == 0 || conn->status[1] == isc_segment);
 
-            p = (char *)malloc(strlen(blob_output.data) + 1);
-            memcpy(p, blob_output.data, strlen(blob_output.data) + 1);
+            *len = blob_output.len;
+            p = _FQresultAlloc(result, *len + 1);
+            memcpy(p, blob_output.data, *len + 1);
 
             /* clean up */
-            isc_close_blob(conn->status, &blob_handle);
+            FB_TRACE(conn, "isc_close_blob", isc_close_blob(conn->status, &blob_handle));
             termFQExpBuffer(&blob_output);
 
+            FB_STATS_ADD(result, blobs_opened, 1);
+            FB_STATS_ADD(result, round_trips, segments + 2);
+
             break;
         }
 
 #if defined SQL_BOOLEAN
 		/* Firebird 3.0 and later */
 		case SQL_BOOLEAN:
-			p = (char *)malloc(2);
+			p = _FQresultAlloc(result, 2);
 			sprintf(p, "%c", *var->sqldata == FB_TRUE ? 't' : 'f');
 			break;
 #endif
@@ -3408,7 +7516,7 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 		{
 			char *p_ptr;
 			char *db_key = var->sqldata;
-			p = (char *)malloc(var->sqllen + 2);
+			p = _FQresultAlloc(result, var->sqllen + 2);
 			p_ptr = p;
 
 			for (; db_key < var->sqldata + var->sqllen; db_key++)
@@ -3417,53 +7525,11 @@ _FQformatDatum(FBconn *conn, FQresTupleAttDesc *att_desc, XSQLVAR *var)
 		}
 
 		default:
-			p = (char *)malloc(64);
+			p = _FQresultAlloc(result, 64);
 			sprintf(p, "Unhandled datatype %i", datatype);
 	}
 
-	tuple_att->value = p;
-
-    /* Calculate display width */
-	/* Special case for RDB$DB_KEY */
-	if (datatype == SQL_DB_KEY)
-	{
-		tuple_att->len = var->sqllen;
-		tuple_att->dsplen = FB_DB_KEY_LEN;
-	}
-	else
-	{
-	   bool get_dsp_len = false;
-		tuple_att->len = strlen(p);
-
-		if (conn->get_dsp_len == true)
-		{
-			switch(datatype)
-			{
-				case SQL_TEXT:
-				case SQL_VARYING:
-					get_dsp_len = true;
-					break;
-
-				case SQL_BLOB:
-					/* TODO: get blob subtype */
-					get_dsp_len = true;
-					break;
-			}
-		}
-
-		if (get_dsp_len == true)
-		{
-			tuple_att->dsplen = FQdspstrlen(tuple_att->value, FQclientEncodingId(conn));
-			tuple_att->dsplen_line = _FQdspstrlen_line(tuple_att, FQclientEncodingId(conn));
-		}
-		else
-		{
-			tuple_att->dsplen = tuple_att->len;
-			tuple_att->dsplen_line = tuple_att->len;
-		}
-	}
-
-	return tuple_att;
+	return p;
 }
 
 
@@ -3512,7 +7578,7 @@ _FQparseDbKey(const char *db_key)
 	char *formatted_value;
 	unsigned char *t;
 
-	formatted_value = (char *)malloc(FB_DB_KEY_LEN + 1);
+	formatted_value = (char *)_FQmalloc(FB_DB_KEY_LEN + 1);
 	formatted_value[0] = '\0';
 	for (t = (unsigned char *) db_key; t < (unsigned char *) db_key + 8; t++)
 	{
@@ -3534,7 +7600,7 @@ _FQparseDbKey(const char *db_key)
 char *
 _FQdeparseDbKey(const char *db_key)
 {
-	unsigned char *deparsed_value = (unsigned char *)malloc(64);
+	unsigned char *deparsed_value = (unsigned char *)_FQmalloc(64);
 	unsigned char *outptr;
 	const char *inptr;
 	char buf[5];
@@ -3556,82 +7622,115 @@ _FQdeparseDbKey(const char *db_key)
 }
 
 
+/**
+ * FQnextResult()
+ *
+ * Returns the result following the provided one in a chain of results
+ * returned by FQexecScript(), or NULL if there are no more results.
+ */
+FBresult *
+FQnextResult(const FBresult *res)
+{
+	if (!res)
+		return NULL;
+
+	return res->next;
+}
+
+
 /**
  * FQclear()
  *
  * Free the storage attached to an FBresult object. Never free() the object
  * itself as that will result in dangling pointers and memory leaks.
+ *
+ * If the result is the first of a chain of results returned by
+ * FQexecScript(), all results in the chain are freed.
  */
 void
 FQclear(FBresult *result)
+{
+	while (result != NULL)
+	{
+		FBresult *next = result->next;
+
+		_FQclearResult(result);
+		result = next;
+	}
+}
+
+
+/**
+ * _FQclearResult()
+ *
+ * Free an individual FBresult object.
+ */
+static void
+_FQclearResult(FBresult *result)
 {
 	int i;
 
-	if (!result)
-		return;
+	/*
+	 * Memory is freed with the size it was allocated with, so the
+	 * result's remaining total deducted from the connection's account
+	 * below covers only the FBresult itself.
+	 */
 
-	if (result->ntups > 0)
+	/* Free header section, present even if no rows were returned */
+	if (result->header)
 	{
-		/* Free header section */
-		if (result->header)
+		for (i = 0; i < result->ncols; i++)
 		{
-			for (i = 0; i < result->ncols; i++)
-			{
-				if (result->header[i])
-				{
-					if (result->header[i]->desc != NULL)
-						free(result->header[i]->desc);
+			FQresTupleAttDesc *desc = result->header[i];
 
-					if (result->header[i]->alias != NULL)
-						free(result->header[i]->alias);
+			if (desc == NULL)
+				continue;
 
-					if (result->header[i]->relname != NULL)
-						free(result->header[i]->relname);
+			_FQresultFree(result, desc->desc, desc->desc_len + 1);
 
-					free(result->header[i]);
-				}
-			}
-		}
+			if (desc->alias != NULL)
+				_FQresultFree(result, desc->alias, desc->alias_len + 1);
 
-		free(result->header);
+			if (desc->relname != NULL)
+				_FQresultFree(result, desc->relname, desc->relname_len + 1);
 
-		/* Free any tuples */
-		if (result->tuple_first)
-		{
-			FQresTuple *tuple_ptr = result->tuple_first;
-			for (i = 0; i  < result->ntups; i++)
-			{
-				int j;
+			_FQresultFree(result, desc, sizeof(FQresTupleAttDesc));
+		}
 
-				FQresTuple *tuple_next = tuple_ptr->next;
+		_FQresultFree(result, result->header, sizeof(FQresTupleAttDesc *) * result->ncols);
+	}
 
-				if (!tuple_next)
-					break;
+	/* Free any tuples */
+	while (result->tuple_first != NULL)
+	{
+		FQresTuple *tuple_next = result->tuple_first->next;
 
-				for (j = 0; j < result->ncols; j++)
-				{
+		for (i = 0; i < result->ncols; i++)
+			_FQresultFree(result, result->tuple_first->values[i], sizeof(FQresTupleAtt));
 
-					if (tuple_ptr->values[j] != NULL)
-					{
-						if (tuple_ptr->values[j]->value != NULL)
-							free(tuple_ptr->values[j]->value);
-						free(tuple_ptr->values[j]);
-					}
-				}
+		_FQresultFree(result, result->tuple_first->values, sizeof(FQresTupleAtt *) * result->ncols);
+		_FQresultFree(result, result->tuple_first, sizeof(FQresTuple));
 
-				free(tuple_ptr->values);
-				free(tuple_ptr);
+		result->tuple_first = tuple_next;
+	}
 
-				tuple_ptr = tuple_next;
-			}
+	if (result->tuples)
+		_FQresultFree(result, result->tuples, sizeof(FQresTuple *) * result->ntups);
 
-			if (result->tuples)
-				free(result->tuples);
-		}
+	/* Free storage for tuple values */
+	while (result->value_blocks != NULL)
+	{
+		FQresultBlock *block_next = result->value_blocks->next;
+
+		_FQresultFree(result, result->value_blocks, offsetof(FQresultBlock, data) + result->value_blocks->size);
+		result->value_blocks = block_next;
 	}
 
+	if (result->stats != NULL)
+		_FQresultFree(result, result->stats, sizeof(FQresStats));
+
 	if (result->errMsg)
-		free(result->errMsg);
+		_FQresultFree(result, result->errMsg, strlen(result->errMsg) + 1);
 
 	if (result->errFields)
 	{
@@ -3640,8 +7739,8 @@ FQclear(FBresult *result)
 		while (mfield != NULL)
 		{
 			FBMessageField *mfield_next = mfield->next;
-			free(mfield->value);
-			free(mfield);
+			_FQresultFree(result, mfield->value, strlen(mfield->value) + 1);
+			_FQresultFree(result, mfield, sizeof(FBMessageField));
 			mfield = mfield_next;
 		}
 	}
@@ -3652,17 +7751,85 @@ FQclear(FBresult *result)
 	 */
 	if (result->sqlda_in != NULL)
 	{
-		free(result->sqlda_in);
+		_FQresultFree(result, result->sqlda_in, XSQLDA_LENGTH(result->sqlda_in->sqln));
 		result->sqlda_in = NULL;
 	}
 
 	if (result->sqlda_out != NULL)
 	{
-		free(result->sqlda_out);
+		_FQresultFree(result, result->sqlda_out, XSQLDA_LENGTH(result->sqlda_out->sqln));
 		result->sqlda_out  = NULL;
 	}
 
-	free(result);
+	if (result->mem_account != NULL)
+	{
+		result->mem_account->size -= result->mem_size;
+		_FQmemAccountRelease(result->mem_account);
+	}
+
+	result->allocator.free_func(result, result->allocator.arg);
+}
+
+
+/**
+ * _FQexecGetPlan()
+ *
+ * Retrieve the plan of a prepared statement, returning it in "plan"
+ * (NULL if no plan is available); the caller must free it. Returns
+ * the status of isc_dsql_sql_info().
+ */
+static ISC_STATUS
+_FQexecGetPlan(FBconn *conn, ISC_STATUS *status, isc_stmt_handle *stmt_handle, char **plan)
+{
+	char  plan_info[1];
+	char  initial_buffer[FB_PLAN_BUFFER_SIZE];
+	char *plan_buffer = initial_buffer;
+	short buffer_size = sizeof(initial_buffer);
+	int   plan_length;
+
+	*plan = NULL;
+
+	plan_info[0] = isc_info_sql_get_plan;
+
+	for (;;)
+	{
+		if (FB_TRACE(conn, "isc_dsql_sql_info", isc_dsql_sql_info(status, stmt_handle, sizeof(plan_info), plan_info,
+							  buffer_size, plan_buffer)))
+		{
+			if (plan_buffer != initial_buffer)
+				_FQfree(plan_buffer);
+
+			return status[1];
+		}
+
+		if (plan_buffer[0] != isc_info_truncated || buffer_size == FB_PLAN_BUFFER_MAX)
+			break;
+
+		/* the plan did not fit in the buffer; retry with a larger one */
+		if (plan_buffer != initial_buffer)
+			_FQfree(plan_buffer);
+
+		buffer_size = buffer_size > FB_PLAN_BUFFER_MAX / 4 ? FB_PLAN_BUFFER_MAX : buffer_size * 4;
+		plan_buffer = (char *)_FQmalloc(buffer_size);
+	}
+
+	/* a plan too long for the largest buffer is omitted */
+	if (plan_buffer[0] == isc_info_sql_get_plan)
+	{
+		plan_length = (unsigned short) isc_vax_integer((char *)plan_buffer + 1, 2);
+
+		if (plan_length)
+		{
+			*plan = (char *)_FQmalloc(plan_length + 1);
+			memset(*plan, '\0', plan_length + 1);
+			memcpy(*plan, plan_buffer + 3, plan_length);
+		}
+	}
+
+	if (plan_buffer != initial_buffer)
+		_FQfree(plan_buffer);
+
+	return 0;
 }
 
 
@@ -3680,12 +7847,9 @@ FQexplainStatement(FBconn *conn, const char *stmt)
 {
 	FBresult	  *result;
 
-	char  plan_info[1];
-	char  plan_buffer[2048];
 	char *plan_out = NULL;
-	short plan_length;
 
-	result = _FQinitResult(false);
+	result = _FQinitResult(conn, false);
 
 	if (!conn)
 	{
@@ -3696,47 +7860,43 @@ FQexplainStatement(FBconn *conn, const char *stmt)
 	}
 
 
-	if (isc_dsql_allocate_statement(conn->status, &conn->db, &result->stmt_handle) != 0)
+	_FQtraceStatement(conn, stmt);
+
+	if (_FQallocStatement(conn, &result->stmt_handle) != 0)
 	{
 		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_allocate_statement");
 		_FQsetResultError(conn, result);
 
+		_FQexecClearResult(conn, result);
 		FQclear(result);
 		return NULL;
 	}
 
 	/* Prepare the statement. */
-	if (isc_dsql_prepare(conn->status, &conn->trans, &result->stmt_handle, 0, stmt, SQL_DIALECT_V6, result->sqlda_out))
+	conn->metrics.prepares++;
+
+	if (FB_TRACE(conn, "isc_dsql_prepare", isc_dsql_prepare(conn->status, &conn->trans, &result->stmt_handle, 0, stmt, SQL_DIALECT_V6, result->sqlda_out)))
 	{
 		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_prepare");
 		_FQsetResultError(conn, result);
 
+		_FQexecClearResult(conn, result);
 		FQclear(result);
 		return NULL;
 	}
 
-	plan_info[0] = isc_info_sql_get_plan;
-
-	if (isc_dsql_sql_info(conn->status, &result->stmt_handle, sizeof(plan_info), plan_info,
-						  sizeof(plan_buffer), plan_buffer))
+	if (_FQexecGetPlan(conn, conn->status, &result->stmt_handle, &plan_out))
 	{
 		_FQsaveMessageField(&result, FB_DIAG_DEBUG, "error - isc_dsql_sql_info");
 		_FQsetResultError(conn, result);
 
+		_FQexecClearResult(conn, result);
 		FQclear(result);
 
 		return NULL;
 	}
 
-	plan_length = (short) isc_vax_integer((char *)plan_buffer + 1, 2);
-
-	if (plan_length)
-	{
-		plan_out = (char *)malloc(plan_length + 1);
-		memset(plan_out, '\0', plan_length + 1);
-		memcpy(plan_out, plan_buffer + 3, plan_length);
-	}
-
+	_FQexecClearResult(conn, result);
 	FQclear(result);
 	return plan_out;
 }
@@ -3745,15 +7905,15 @@ FQexplainStatement(FBconn *conn, const char *stmt)
 /**
  * FQlog()
  *
- * Primitive logging output, mainly for debugging purposes.
- *
- * TODO
- * - optional log destination (specify in FBconn?)
+ * Primitive logging output, mainly for debugging purposes. Messages at
+ * or above the connection's client_min_messages level are passed to
+ * its log receiver, which by default writes them to STDOUT.
  */
 void
 FQlog(FBconn *conn, short loglevel, const char *msg, ...)
 {
 	va_list argp;
+	char message[FB_LOG_MESSAGE_LEN];
 
 	if (!conn)
 		return;
@@ -3763,15 +7923,312 @@ FQlog(FBconn *conn, short loglevel, const char *msg, ...)
 		return;
 
 	va_start(argp, msg);
-	vprintf(msg, argp);
+	vsnprintf(message, sizeof(message), msg, argp);
 	va_end(argp);
 
-	puts("");
+	conn->log_receiver(conn->log_arg, loglevel, message);
+}
+
+
+/**
+ * _FQdefaultLogReceiver()
+ *
+ * Default log receiver; writes the message to STDOUT.
+ */
+static void
+_FQdefaultLogReceiver(void *arg, short loglevel, const char *message)
+{
+	puts(message);
 
 	fflush(stdout);
 }
 
 
+/**
+ * FQsetClientMinMessages()
+ *
+ * Set the lowest level of message which will be logged by FQlog();
+ * the default is DEBUG1.
+ */
+void
+FQsetClientMinMessages(FBconn *conn, short loglevel)
+{
+	if (conn != NULL)
+		conn->client_min_messages = loglevel;
+}
+
+
+/**
+ * FQsetNoticeProcessor()
+ *
+ * Set the function which is called with the text of each notice
+ * (non-fatal error) generated for the connection, and return the
+ * previous one. As with libpq, passing NULL returns the current
+ * notice processor without changing it.
+ */
+FQnoticeProcessor
+FQsetNoticeProcessor(FBconn *conn, FQnoticeProcessor proc, void *arg)
+{
+	FQnoticeProcessor old;
+
+	if (conn == NULL)
+		return NULL;
+
+	old = conn->notice_processor;
+
+	if (proc != NULL)
+	{
+		conn->notice_processor = proc;
+		conn->notice_arg = arg;
+	}
+
+	return old;
+}
+
+
+/**
+ * FQsetLogReceiver()
+ *
+ * Set the function which is called with each message logged by FQlog()
+ * for the connection, and return the previous one; passing NULL returns
+ * the current log receiver without changing it. Any background log
+ * writer started with FQsetAsyncLog() is stopped.
+ */
+FQlogReceiver
+FQsetLogReceiver(FBconn *conn, FQlogReceiver receiver, void *arg)
+{
+	FQlogReceiver old;
+
+	if (conn == NULL)
+		return NULL;
+
+	old = conn->log_receiver;
+
+	if (receiver != NULL)
+	{
+		_FQasyncLogStop(conn);
+
+		conn->log_receiver = receiver;
+		conn->log_arg = arg;
+	}
+
+	return old;
+}
+
+
+/* State shared between a connection and its background log writer */
+struct FQasyncLog
+{
+	int				fd;
+	char		   *messages;		/* ring of nmessages buffers of FB_LOG_MESSAGE_LEN bytes */
+	int				nmessages;
+	int				head;			/* next message to be written */
+	int				count;			/* number of messages not yet written */
+	long			dropped;		/* messages discarded as the ring was full */
+	bool			stopping;
+	pthread_t		thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t	message_added;
+};
+
+
+/**
+ * FQsetAsyncLog()
+ *
+ * Start a background thread which writes messages logged by FQlog()
+ * to the file descriptor "fd", so logging does not block the caller on
+ * I/O. Messages are buffered in a ring of "nmessages" entries (or
+ * FB_ASYNC_LOG_MESSAGES, if 0 or less) and discarded if it is full.
+ *
+ * If "fd" is -1, any existing background writer is stopped once its
+ * buffered messages have been written. In either case any previously
+ * set log receiver is replaced; returns false if the thread could not
+ * be started, in which case the default log receiver is used.
+ */
+bool
+FQsetAsyncLog(FBconn *conn, int fd, int nmessages)
+{
+	FQasyncLog *log;
+
+	if (conn == NULL)
+		return false;
+
+	_FQasyncLogStop(conn);
+
+	conn->log_receiver = _FQdefaultLogReceiver;
+	conn->log_arg = NULL;
+
+	if (fd < 0)
+		return true;
+
+	if (nmessages <= 0)
+		nmessages = FB_ASYNC_LOG_MESSAGES;
+
+	log = (FQasyncLog *)_FQmalloc(sizeof(FQasyncLog));
+	memset(log, 0, sizeof(FQasyncLog));
+	log->fd = fd;
+	log->nmessages = nmessages;
+	log->messages = (char *)_FQmalloc((size_t)nmessages * FB_LOG_MESSAGE_LEN);
+
+	pthread_mutex_init(&log->mutex, NULL);
+	pthread_cond_init(&log->message_added, NULL);
+
+	if (pthread_create(&log->thread, NULL, _FQasyncLogThread, log) != 0)
+	{
+		pthread_cond_destroy(&log->message_added);
+		pthread_mutex_destroy(&log->mutex);
+		_FQfree(log->messages);
+		_FQfree(log);
+
+		return false;
+	}
+
+	conn->async_log = log;
+	conn->log_receiver = _FQasyncLogReceiver;
+	conn->log_arg = log;
+
+	return true;
+}
+
+
+/**
+ * _FQasyncLogReceiver()
+ *
+ * Log receiver used by FQsetAsyncLog(); queues the message for the
+ * background writer.
+ */
+static void
+_FQasyncLogReceiver(void *arg, short loglevel, const char *message)
+{
+	FQasyncLog *log = (FQasyncLog *)arg;
+
+	pthread_mutex_lock(&log->mutex);
+
+	if (log->count == log->nmessages)
+	{
+		log->dropped++;
+	}
+	else
+	{
+		int slot = (log->head + log->count) % log->nmessages;
+
+		snprintf(log->messages + (size_t)slot * FB_LOG_MESSAGE_LEN, FB_LOG_MESSAGE_LEN, "%s\n", message);
+		log->count++;
+
+		pthread_cond_signal(&log->message_added);
+	}
+
+	pthread_mutex_unlock(&log->mutex);
+}
+
+
+/**
+ * _FQasyncLogThread()
+ *
+ * Background writer for FQsetAsyncLog(); each time it wakes, all queued
+ * messages are written with a single write(), until stopped.
+ */
+static void *
+_FQasyncLogThread(void *arg)
+{
+	FQasyncLog *log = (FQasyncLog *)arg;
+	FQExpBufferData buf;
+
+	initFQExpBuffer(&buf);
+
+	for (;;)
+	{
+		bool stopping;
+
+		pthread_mutex_lock(&log->mutex);
+
+		while (log->count == 0 && log->stopping == false)
+			pthread_cond_wait(&log->message_added, &log->mutex);
+
+		while (log->count > 0)
+		{
+			appendFQExpBufferStr(&buf, log->messages + (size_t)log->head * FB_LOG_MESSAGE_LEN);
+			log->head = (log->head + 1) % log->nmessages;
+			log->count--;
+		}
+
+		if (log->dropped > 0)
+		{
+			appendFQExpBuffer(&buf, "libfq: %li log messages dropped\n", log->dropped);
+			log->dropped = 0;
+		}
+
+		stopping = log->stopping;
+
+		pthread_mutex_unlock(&log->mutex);
+
+		/* there is nowhere to report a write error, so the output is discarded */
+		if (_FQcopyWrite(log->fd, &buf) == false)
+			resetFQExpBuffer(&buf);
+
+		if (stopping == true)
+			break;
+	}
+
+	termFQExpBuffer(&buf);
+
+	return NULL;
+}
+
+
+/**
+ * _FQasyncLogStop()
+ *
+ * Stop the connection's background log writer, if any, once all
+ * queued messages have been written, and restore the default log
+ * receiver if it was in use.
+ */
+static void
+_FQasyncLogStop(FBconn *conn)
+{
+	FQasyncLog *log = conn->async_log;
+
+	if (log == NULL)
+		return;
+
+	pthread_mutex_lock(&log->mutex);
+	log->stopping = true;
+	pthread_cond_signal(&log->message_added);
+	pthread_mutex_unlock(&log->mutex);
+
+	pthread_join(log->thread, NULL);
+
+	pthread_cond_destroy(&log->message_added);
+	pthread_mutex_destroy(&log->mutex);
+	_FQfree(log->messages);
+	_FQfree(log);
+
+	conn->async_log = NULL;
+
+	if (conn->log_receiver == _FQasyncLogReceiver)
+	{
+		conn->log_receiver = _FQdefaultLogReceiver;
+		conn->log_arg = NULL;
+	}
+}
+
+
+/**
+ * _FQasyncLogMemorySize()
+ *
+ * Return the memory allocated for the connection's background log
+ * writer, if any.
+ */
+static size_t
+_FQasyncLogMemorySize(const FBconn *conn)
+{
+	if (conn->async_log == NULL)
+		return 0;
+
+	return sizeof(FQasyncLog) + (size_t)conn->async_log->nmessages * FB_LOG_MESSAGE_LEN;
+}
+
+
 /**
  * FQmblen()
  *
@@ -3780,16 +8237,18 @@ FQlog(FBconn *conn, short loglevel, const char *msg, ...)
 int
 FQmblen(const char *s, short encoding_id)
 {
-	int len = 1;
+	/* ASCII characters are single-byte in all supported encodings */
+	if ((*s & 0x80) == 0)
+		return 1;
 
 	switch(encoding_id)
 	{
 		case FBENC_UTF8:
-			len = pg_utf_mblen((const unsigned char *)s);
-			break;
+		case FBENC_UNICODE_FSS:
+			return pg_utf_mblen((const unsigned char *)s);
 	}
 
-	return len;
+	return mb_encoding_mblen((const unsigned char *)s, encoding_id);
 }
 
 
@@ -3801,15 +8260,14 @@ FQmblen(const char *s, short encoding_id)
 int
 FQdsplen(const unsigned char *s, short encoding_id)
 {
-	int len = 1;
 	switch(encoding_id)
 	{
 		case FBENC_UTF8:
-			len = pg_utf_dsplen(s);
-			break;
+		case FBENC_UNICODE_FSS:
+			return pg_utf_dsplen(s);
 	}
 
-	return len;
+	return mb_encoding_dsplen(s, encoding_id);
 }
 
 
@@ -3827,6 +8285,10 @@ FQdspstrlen(const char *s, short encoding_id)
 	int dsplen = 0;
 	int w;
 
+	/* fast path, counting runs of ASCII characters in bulk */
+	if (encoding_id == FBENC_UTF8 || encoding_id == FBENC_UNICODE_FSS)
+		return utf8_dspstrlen((const unsigned char *)s, len);
+
 	for (; *s && len > 0; s += chlen)
 	{
 		chlen = FQmblen(s, encoding_id);
@@ -3844,39 +8306,131 @@ FQdspstrlen(const char *s, short encoding_id)
 
 
 /**
- * _FQdspstrlen_line()
+ * _FQscanDatum()
  *
- * Returns the single-character-equivalent display length of the longest
- * line from string in the provided encoding
+ * Determine, in a single pass over the formatted value, its length in
+ * bytes, its display width, the display width of its longest line and
+ * the number of lines it contains. "\n", "\r" and "\r\n" are all
+ * treated as a line break.
+ *
+ * "len" is the byte length of the value if known, or -1 if the value
+ * is to be scanned up to its terminating NUL.
+ *
+ * If "get_dsp_len" is false, each byte is assumed to occupy a single
+ * column.
+ *
+ * As with FQdspstrlen(), the overall display width is the sum of the
+ * display widths of all characters including line breaks, and a
+ * trailing incomplete multibyte character is ignored.
  */
-int
-_FQdspstrlen_line(FQresTupleAtt *att, short encoding_id)
+static void
+_FQscanDatum(FQresTupleAtt *att, int len, short encoding_id, bool get_dsp_len)
 {
-	char *ptr = (char *)att->value;
-	int max_len = 0;
-	int cur_len = 0;
+	const unsigned char *ptr = (const unsigned char *)att->value;
+	const unsigned char *start = ptr;
+	const unsigned char *end;
+	const unsigned char *next_lf = NULL;
+	const unsigned char *next_cr = NULL;
+	int dsplen = 0;
+	int line_len = 0;
+	int max_line_len = 0;
+	int lines = 1;
+
+	if (len < 0)
+		len = strlen(att->value);
+
+	end = ptr + len;
 
-	while (ptr[0] != '\0')
+	while (ptr < end)
 	{
-		if (ptr[0] == '\n'
-		||  ptr[0] == '\r'
-		|| (ptr[0] == '\n' && ptr[1] == '\r')
-		|| (ptr[0] == '\r' && ptr[1] == '\n')
-		)
+		const unsigned char *line_end;
+
+		/*
+		 * Locate the next line break; each kind is searched for again
+		 * only once the previous occurrence has been passed.
+		 */
+		if (next_lf == NULL || next_lf < ptr)
 		{
-			if (cur_len > max_len)
-				max_len = cur_len;
+			next_lf = memchr(ptr, '\n', end - ptr);
 
-			cur_len = 0;
+			if (next_lf == NULL)
+				next_lf = end;
 		}
-		else
+
+		if (next_cr == NULL || next_cr < ptr)
 		{
-			cur_len++;
+			next_cr = memchr(ptr, '\r', end - ptr);
+
+			if (next_cr == NULL)
+				next_cr = end;
+		}
+
+		line_end = next_lf < next_cr ? next_lf : next_cr;
+
+		if (get_dsp_len == false)
+		{
+			dsplen += line_end - ptr;
+			line_len += line_end - ptr;
+			ptr = line_end;
+		}
+
+		while (ptr < line_end)
+		{
+			int consumed;
+			int chlen;
+			int w;
+
+			/* runs of ASCII characters are measured in bulk */
+			w = ascii_prefix_dsplen(ptr, line_end - ptr, &consumed);
+			dsplen += w;
+			line_len += w;
+			ptr += consumed;
+
+			if (ptr == line_end)
+				break;
+
+			chlen = FQmblen((const char *)ptr, encoding_id);
+
+			/* ignore a truncated character at the end of the string */
+			if (chlen > end - ptr)
+			{
+				ptr = end;
+				break;
+			}
+
+			w = FQdsplen(ptr, encoding_id);
+			dsplen += w;
+			line_len += w;
+			ptr += chlen;
+		}
+
+		if (ptr == line_end && ptr < end)
+		{
+			/* line breaks are control characters, with a display width of -1 */
+			dsplen += get_dsp_len ? -1 : 1;
+
+			if (ptr[0] == '\r' && ptr + 1 != end && ptr[1] == '\n')
+			{
+				dsplen += get_dsp_len ? -1 : 1;
+				ptr++;
+			}
+
+			if (line_len > max_line_len)
+				max_line_len = line_len;
+
+			line_len = 0;
+			lines++;
+			ptr++;
 		}
-		ptr++;
 	}
 
-	return max_len ? max_len : cur_len;
+	if (line_len > max_line_len)
+		max_line_len = line_len;
+
+	att->len = ptr - start;
+	att->dsplen = dsplen;
+	att->dsplen_line = max_line_len;
+	att->lines = lines;
 }
 
 